@@ -0,0 +1,43 @@
+#!/bin/bash
+# Ahead-of-time benchmark: runs each script on the tree-walker, then builds
+# it with --emit-cpp and runs the native program, and reports both times.
+# The two outputs must be identical.
+#
+#   g++ -std=c++17 -O2 src/*.cpp -o lfi3a
+#   bench/aot_bench.sh [file.lfi3a ...]
+#
+# Run from the repository root; defaults to bench/aot_workload.lfi3a.
+# Set LFI3A to use another binary and CXXFLAGS to change how the generated
+# code is compiled.
+
+LFI3A=${LFI3A:-./lfi3a}
+CXXFLAGS=${CXXFLAGS:--O2}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+if [ $# -eq 0 ]; then
+    set -- bench/aot_workload.lfi3a
+fi
+
+seconds() {
+    local start end
+    start=$(date +%s.%N)
+    "$@" > "$work/out.txt" 2>&1
+    end=$(date +%s.%N)
+    awk -v a="$start" -v b="$end" 'BEGIN { printf "%.3f", b - a }'
+}
+
+printf "%-32s %12s %12s %8s\n" script tree-walker aot speedup
+for script in "$@"; do
+    "$LFI3A" --emit-cpp "$script" > "$work/prog.cpp" || exit 1
+    g++ -std=c++17 $CXXFLAGS -Isrc/runtime "$work/prog.cpp" src/runtime/Runtime.cpp src/Value.cpp src/Array.cpp src/Map.cpp src/Builtins.cpp src/Output.cpp -o "$work/prog" -pthread || exit 1
+
+    tree=$(seconds "$LFI3A" "$script")
+    mv "$work/out.txt" "$work/tree.txt"
+    aot=$(seconds "$work/prog")
+    if ! cmp -s "$work/tree.txt" "$work/out.txt"; then
+        echo "$script: output differs from the tree-walker" >&2
+        exit 1
+    fi
+    printf "%-32s %11.3fs %11.3fs %7.1fx\n" "$script" "$tree" "$aot" "$(awk -v a="$tree" -v b="$aot" 'BEGIN { print a / b }')"
+done
@@ -0,0 +1,85 @@
+// Embedding benchmark: the cost of one small script run per request, as a
+// host service sees it.
+//
+//   g++ -std=c++17 -O2 -Isrc bench/embed_bench.cpp $(ls src/*.cpp | grep -v main.cpp) -o embed_bench
+//   ./embed_bench [requests] [path/to/lfi3a]
+//
+// "compile + run" compiles the script for every request, "run" compiles it
+// once and only sets a global and runs it, and "process" (given the path
+// of an lfi3a binary) starts a process per request, as a service without
+// the library would. Each row is microseconds per request. Every request
+// calls a native function from the script, or for "process", a dalla in
+// its place.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include "Lfi3a.hpp"
+
+static const char* SCRIPT =
+    "dir total = 0\n"
+    "kol (i = 0; i < 20; i++) {\n"
+    "    total = total + rate(amount + i)\n"
+    "}\n"
+    "kteb(\"total\", total)\n";
+
+static double perRequest(int requests, const std::function<void(int)>& request) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; ++i) request(i);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e6 / requests;
+}
+
+static void fail(const lfi3a::Result& result) {
+    std::fprintf(stderr, "Error: %s\n", result.message.c_str());
+    std::exit(1);
+}
+
+int main(int argc, char** argv) {
+    int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const char* binary = argc > 2 ? argv[2] : nullptr;
+
+    lfi3a::Engine engine;
+    engine.define("rate", [](const Value* args, size_t) { return Value::number(args[0].asNumber() * 0.07); });
+    size_t bytes = 0;
+    auto discard = [&](std::string_view chunk) { bytes += chunk.size(); };
+
+    std::printf("%d requests; us per request\n", requests);
+    double full = perRequest(requests, [&](int i) {
+        lfi3a::Script script;
+        lfi3a::Result result = engine.compile(SCRIPT, script);
+        script.setGlobal("amount", Value::number(i));
+        if (result) result = script.run(discard);
+        if (!result) fail(result);
+    });
+    std::printf("%-16s %10.2f\n", "compile + run", full);
+
+    lfi3a::Script script;
+    lfi3a::Result compiled = engine.compile(SCRIPT, script);
+    if (!compiled) fail(compiled);
+    double run = perRequest(requests, [&](int i) {
+        script.setGlobal("amount", Value::number(i));
+        lfi3a::Result result = script.run(discard);
+        if (!result) fail(result);
+    });
+    std::printf("%-16s %10.2f\n", "run", run);
+
+    if (binary) {
+        // Fewer of these: each one is a fork and exec
+        int spawns = requests / 20 > 0 ? requests / 20 : 1;
+        std::string path = "embed_bench_request.lfi3a";
+        std::ofstream(path) << "dalla rate(x) { rje3 x * 0.07 }\ndir amount = 1\n" << SCRIPT;
+        std::string command = std::string(binary) + " " + path + " > /dev/null";
+        double process = perRequest(spawns, [&](int) {
+            if (std::system(command.c_str()) != 0) std::exit(1);
+        });
+        std::remove(path.c_str());
+        std::remove((path + "c").c_str());
+        std::printf("%-16s %10.2f\n", "process", process);
+    }
+    std::printf("(%zu bytes of output)\n", bytes);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// Lexer throughput benchmark.
+//
+//   g++ -std=c++17 -O2 -Isrc bench/lexer_bench.cpp src/Lexer.cpp src/CharScan.cpp src/SourceFile.cpp src/Symbols.cpp -o lexer_bench
+//   ./lexer_bench [file.lfi3a] [repeats]
+//
+// Add -mavx2 for the AVX2 scanners or -DLFI3A_NO_SIMD for the scalar ones.
+// Without a file, a synthetic ~8 MB script is lexed.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "CharScan.hpp"
+#include "Lexer.hpp"
+#include "SourceFile.hpp"
+
+static std::string syntheticScript(size_t targetBytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < targetBytes) {
+        out += "// Compute the running total for item " + std::to_string(i) + "\n";
+        out += "dir total_" + std::to_string(i % 97) + " = price_per_unit * " + std::to_string(i) + ".25 + 3\n";
+        out += "ila (total_" + std::to_string(i % 97) + " >= 1000) {\n";
+        out += "        kteb(\"Item number\", " + std::to_string(i) + ", \"is above the threshold\")\n";
+        out += "} wla {\n        counter = counter + 1\n}\n\n";
+        ++i;
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    SourceFile file;
+    std::string synthetic;
+    std::string_view text;
+    
+    if (argc > 1) {
+        if (!file.open(argv[1])) {
+            std::fprintf(stderr, "Error: Cannot open file '%s'\n", argv[1]);
+            return 1;
+        }
+        text = file.text();
+    } else {
+        synthetic = syntheticScript(8 << 20);
+        text = synthetic;
+    }
+    int repeats = argc > 2 ? std::atoi(argv[2]) : 10;
+    
+    size_t tokens = 0;
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        SymbolTable symbols;
+        Lexer lexer(text, symbols);
+        tokens = 1;
+        while (lexer.next().type != END) tokens++;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    
+    double mb = text.size() / (1024.0 * 1024.0);
+    std::printf("scanner: %s\n", charScanLevel());
+    std::printf("input:   %.2f MB, %zu tokens\n", mb, tokens);
+    std::printf("best:    %.2f ms  (%.1f MB/s, %.1f M tokens/s)\n",
+                best * 1000, mb / best, tokens / best / 1e6);
+    return 0;
+}
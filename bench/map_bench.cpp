@@ -0,0 +1,111 @@
+// Map benchmark: the interpreter's map against std::unordered_map.
+//
+//   g++ -std=c++17 -O2 -Isrc bench/map_bench.cpp src/Map.cpp src/Value.cpp src/Array.cpp -o map_bench
+//   ./map_bench [keys] [repeats]
+//
+// Add -DLFI3A_NO_SIMD for the scalar control-byte scan. Each row is the
+// best of the repeats, in nanoseconds per operation. The unordered_map
+// side is keyed by double or std::string directly, as C++ code would be;
+// the map side takes Values, as scripts use it. Lookups of string keys
+// are timed twice: with the Values the keys were inserted with, whose
+// hashes are already known, and with fresh copies that must be hashed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Map.hpp"
+
+static int repeats = 5;
+
+// Best time of `repeats` runs of setup() then run(), in ns per operation.
+static double measure(size_t operations, const std::function<void()>& setup, const std::function<void()>& run) {
+    double fastest = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        fastest = std::min(fastest, elapsed.count());
+    }
+    return fastest * 1e9 / operations;
+}
+
+static void row(const char* name, double map, double unordered) {
+    std::printf("%-24s %10.1f %14.1f %8.2fx\n", name, map, unordered, unordered / map);
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    repeats = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(42));
+
+    std::vector<Value> numbers, strings, copies, absent;
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < n; ++i) {
+        numbers.push_back(Value::number(static_cast<double>(i)));
+        texts.push_back("key" + std::to_string(i * 7919));
+        strings.push_back(Value::string(texts.back()));
+        copies.push_back(Value::string(texts.back()));
+        absent.push_back(Value::string("no" + texts.back()));
+    }
+
+    Map map;
+    std::unordered_map<double, Value> byNumber;
+    std::unordered_map<std::string, Value> byString;
+    size_t found = 0;
+
+    std::printf("%zu keys, best of %d; ns per operation\n", n, repeats);
+    std::printf("%-24s %10s %14s %9s\n", "", "Map", "unordered_map", "speedup");
+
+    row("insert numbers",
+        measure(n, [&] { map = Map(); },
+                [&] { for (size_t i = 0; i < n; ++i) map.set(numbers[i], numbers[i]); }),
+        measure(n, [&] { byNumber = {}; },
+                [&] { for (size_t i = 0; i < n; ++i) byNumber[static_cast<double>(i)] = numbers[i]; }));
+    row("find numbers, shuffled",
+        measure(n, [] {}, [&] { for (size_t i : order) found += map.find(Value::number(static_cast<double>(i))) != nullptr; }),
+        measure(n, [] {}, [&] { for (size_t i : order) found += byNumber.count(static_cast<double>(i)); }));
+    row("find absent numbers",
+        measure(n, [] {}, [&] { for (size_t i = 0; i < n; ++i) found += map.find(Value::number(i + 0.5)) != nullptr; }),
+        measure(n, [] {}, [&] { for (size_t i = 0; i < n; ++i) found += byNumber.count(i + 0.5); }));
+    row("remove half, add again",
+        measure(n, [] {},
+                [&] {
+                    for (size_t i = 0; i < n; i += 2) map.remove(numbers[i]);
+                    for (size_t i = 0; i < n; i += 2) map.set(numbers[i], numbers[i]);
+                }),
+        measure(n, [] {},
+                [&] {
+                    for (size_t i = 0; i < n; i += 2) byNumber.erase(static_cast<double>(i));
+                    for (size_t i = 0; i < n; i += 2) byNumber[static_cast<double>(i)] = numbers[i];
+                }));
+
+    row("insert strings",
+        measure(n, [&] { map = Map(); },
+                [&] { for (size_t i = 0; i < n; ++i) map.set(strings[i], numbers[i]); }),
+        measure(n, [&] { byString = {}; },
+                [&] { for (size_t i = 0; i < n; ++i) byString[texts[i]] = numbers[i]; }));
+    row("find strings, shuffled",
+        measure(n, [] {}, [&] { for (size_t i : order) found += map.find(strings[i]) != nullptr; }),
+        measure(n, [] {}, [&] { for (size_t i : order) found += byString.count(texts[i]); }));
+    // Fresh copies every run, so no hash is known yet
+    row("find new strings",
+        measure(n, [&] { for (size_t i = 0; i < n; ++i) copies[i] = Value::string(texts[i]); },
+                [&] { for (size_t i : order) found += map.find(copies[i]) != nullptr; }),
+        measure(n, [] {}, [&] { for (size_t i : order) found += byString.count(texts[i]); }));
+    row("find absent strings",
+        measure(n, [] {}, [&] { for (size_t i = 0; i < n; ++i) found += map.find(absent[i]) != nullptr; }),
+        measure(n, [] {}, [&] { for (size_t i = 0; i < n; ++i) found += byString.count(absent[i].asString()); }));
+
+    std::printf("(%zu found)\n", found);
+    return 0;
+}
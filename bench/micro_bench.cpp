@@ -0,0 +1,389 @@
+// Per-phase microbenchmarks: lexer tokens/s, parser nodes/s, and the cost
+// of evaluating each kind of expression.
+//
+//   g++ -std=c++17 -O2 -Isrc bench/micro_bench.cpp $(ls src/*.cpp | grep -v main.cpp) -o micro_bench
+//   ./micro_bench [--bytes=<n>] [--iterations=<n>] [--repeat=<n>] [--vm] [--counters] [name ...]
+//
+// The lexer and parser run on a synthetic script of about --bytes bytes
+// (default 4 MB); "parse" includes the lexing it pulls. Each eval case runs
+// `x = <expr>` --iterations times (default 2000000) in a kol loop inside a
+// function, unoptimized, and reports the time per iteration above the same
+// loop with `x = 0`: the cost of the expression node and its operands.
+// --vm runs the eval cases on the bytecode VM instead of the tree-walker.
+//
+// --counters adds hardware counters per unit of work, read with
+// perf_event_open; it needs perf_event_paranoid <= 2 and a machine (or VM)
+// that exposes a PMU. Names given on the command line pick cases by
+// prefix, e.g. "eval.call" or "lex".
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Compiler.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "VM.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Cycles, instructions and misses of the code between start() and stop(),
+// user space only, as one perf event group.
+class Counters {
+public:
+    static constexpr int COUNT = 4;
+    static constexpr const char* NAMES[COUNT] = {"cycles", "instructions", "branch-misses", "cache-misses"};
+
+    bool open() {
+#ifdef __linux__
+        const uint64_t events[COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+        for (int i = 0; i < COUNT; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = events[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0) {
+                error = std::strerror(errno);
+                close();
+                return false;
+            }
+        }
+        return true;
+#else
+        error = "perf_event_open needs Linux";
+        return false;
+#endif
+    }
+
+    void close() {
+#ifdef __linux__
+        for (int& fd : fds) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+    bool active() const { return fds[0] >= 0; }
+    const char* lastError() const { return error; }
+
+    void start() {
+#ifdef __linux__
+        if (!active()) return;
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    void stop(uint64_t values[COUNT]) {
+        std::fill(values, values + COUNT, 0);
+#ifdef __linux__
+        if (!active()) return;
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t data[1 + COUNT];
+        if (read(fds[0], data, sizeof(data)) == static_cast<ssize_t>(sizeof(data))) {
+            std::copy(data + 1, data + 1 + COUNT, values);
+        }
+#endif
+    }
+
+    ~Counters() { close(); }
+
+private:
+    int fds[COUNT] = {-1, -1, -1, -1};
+    const char* error = "";
+};
+
+struct Options {
+    size_t bytes = 4 << 20;
+    uint64_t iterations = 2000000;
+    int repeat = 5;
+    bool vm = false;
+    bool counters = false;
+    std::vector<std::string> filters;
+};
+
+// One measured run: seconds and counter values.
+struct Sample {
+    double seconds = 1e30;
+    uint64_t counts[Counters::COUNT] = {};
+};
+
+static Counters counters;
+
+// Best of `repeat` runs of f, by time, with the counters of that run.
+static Sample best(int repeat, const std::function<void()>& f) {
+    Sample result;
+    for (int r = 0; r < repeat; ++r) {
+        Sample sample;
+        counters.start();
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        counters.stop(sample.counts);
+        sample.seconds = elapsed.count();
+        if (sample.seconds < result.seconds) result = sample;
+    }
+    return result;
+}
+
+// A case's line: `units` is the amount of work in the sample, `baseline`
+// is subtracted first when the case is measured against another run.
+static void report(const char* name, const char* unit, double units, const Sample& sample,
+                   const Sample* baseline = nullptr) {
+    double seconds = sample.seconds - (baseline ? baseline->seconds : 0);
+    if (baseline) {
+        std::printf("%-16s %10.2f ns/%-6s", name, std::max(seconds, 0.0) * 1e9 / units, unit);
+    } else {
+        std::printf("%-16s %10.2f M%s/s ", name, units / seconds / 1e6, unit);
+    }
+    if (counters.active()) {
+        for (int i = 0; i < Counters::COUNT; ++i) {
+            double count = static_cast<double>(sample.counts[i]) - (baseline ? baseline->counts[i] : 0.0);
+            std::printf(" %10.2f", count / units);
+        }
+        double cycles = static_cast<double>(sample.counts[0]);
+        std::printf(" %6.2f", cycles > 0 ? sample.counts[1] / cycles : 0.0);
+    }
+    std::printf("\n");
+}
+
+static bool selected(const Options& options, const std::string& name) {
+    if (options.filters.empty()) return true;
+    for (const std::string& filter : options.filters) {
+        if (name.compare(0, filter.size(), filter) == 0) return true;
+    }
+    return false;
+}
+
+// Statements of every kind, with comments, strings and numbers in the
+// proportions of a hand-written script.
+static std::string syntheticScript(size_t targetBytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < targetBytes) {
+        std::string n = std::to_string(i);
+        out += "// Running total for item " + n + "\n";
+        out += "dalla item" + n + "(price, count) {\n";
+        out += "    dir total = price * count + " + n + ".25 - 3\n";
+        out += "    ila (total >= 1000 w count != 0) {\n";
+        out += "        kteb(\"Item number\", " + n + ", \"is above the threshold\")\n";
+        out += "    } wila (total < 0 wla price == 0) {\n";
+        out += "        total = (total - 1) / 2\n";
+        out += "    }\n";
+        out += "    kol (i = 0; i < count; i++) {\n";
+        out += "        total = total + item" + std::to_string(i / 2) + "(i, -1)\n";
+        out += "    }\n";
+        out += "    rje3 total\n";
+        out += "}\n\n";
+        ++i;
+    }
+    return out;
+}
+
+static size_t countNodes(ASTNodePtr node) {
+    if (!node) return 0;
+    size_t count = 1;
+    for (ASTNodePtr child : node->children) {
+        count += countNodes(child);
+    }
+    if (node->type == NodeType::FUNCTION_DECL) count += countNodes(node->function->body);
+    return count;
+}
+
+static Program parse(std::string_view text) {
+    auto symbols = std::make_shared<SymbolTable>();
+    Lexer lexer(text, *symbols);
+    Parser parser(lexer, symbols);
+    return parser.parse();
+}
+
+static void lexAndParse(const Options& options) {
+    std::string text = syntheticScript(options.bytes);
+
+    if (selected(options, "lex")) {
+        size_t tokens = 0;
+        Sample sample = best(options.repeat, [&] {
+            SymbolTable symbols;
+            Lexer lexer(text, symbols);
+            tokens = 1;
+            while (lexer.next().type != END) tokens++;
+        });
+        report("lex", "tok", static_cast<double>(tokens), sample);
+    }
+
+    if (selected(options, "parse")) {
+        size_t nodes = 0;
+        Sample sample = best(options.repeat, [&] {
+            Program program = parse(text);
+            nodes = 0;
+            for (ASTNodePtr statement : program.statements) {
+                nodes += countNodes(statement);
+            }
+        });
+        report("parse", "node", static_cast<double>(nodes), sample);
+    }
+}
+
+// `x = <expression>` in a loop, with locals a = 7, b = 2 and s = "ab", a
+// global g = 3 and a one-line function id.
+static std::string evalScript(const std::string& expression, uint64_t iterations) {
+    return "dir g = 3\n"
+           "dalla id(v) { rje3 v }\n"
+           "dalla run(n, a, b, s) {\n"
+           "    dir x = 0\n"
+           "    kol (i = 0; i < n; i++) {\n"
+           "        x = " + expression + "\n"
+           "    }\n"
+           "    rje3 x\n"
+           "}\n"
+           "run(" + std::to_string(iterations) + ", 7, 2, \"ab\")\n";
+}
+
+// An eval script, parsed and resolved (and compiled for --vm) up front so
+// that only running it is timed.
+class EvalScript {
+public:
+    EvalScript(const Options& options, const std::string& expression)
+        : vm(options.vm), program(parse(evalScript(expression, options.iterations))) {
+        Resolver resolver;
+        resolver.resolve(program);
+        if (vm) {
+            Compiler compiler;
+            bytecode = compiler.compile(program);
+        }
+    }
+
+    void run() const {
+        if (vm) {
+            VM engine;
+            engine.run(bytecode);
+        } else {
+            Interpreter engine;
+            engine.run(program);
+        }
+    }
+
+private:
+    bool vm;
+    Program program;
+    BytecodeProgram bytecode;
+};
+
+static void evaluate(const Options& options) {
+    struct Case {
+        const char* name;
+        const char* expression;
+    };
+    const Case cases[] = {
+        {"eval.local", "a"},
+        {"eval.global", "g"},
+        {"eval.neg", "-a"},
+        {"eval.add", "a + b"},
+        {"eval.sub", "a - b"},
+        {"eval.mul", "a * b"},
+        {"eval.div", "a / b"},
+        {"eval.lt", "a < b"},
+        {"eval.eq", "a == b"},
+        {"eval.and", "a w b"},
+        {"eval.or", "a wla b"},
+        {"eval.concat", "s + a"},
+        {"eval.call", "id(a)"},
+    };
+
+    bool any = false;
+    for (const Case& c : cases) {
+        any = any || selected(options, c.name);
+    }
+    if (!any) return;
+
+    double iterations = static_cast<double>(options.iterations);
+    EvalScript emptyLoop(options, "0");
+    Sample none;
+    none.seconds = 0;
+    report("eval.loop", "iter", iterations, best(options.repeat, [&] { emptyLoop.run(); }), &none);
+    for (const Case& c : cases) {
+        if (!selected(options, c.name)) continue;
+        // Alternate with the empty loop, so that both see the same machine
+        EvalScript script(options, c.expression);
+        Sample empty, sample;
+        for (int r = 0; r < options.repeat; ++r) {
+            Sample e = best(1, [&] { emptyLoop.run(); });
+            if (e.seconds < empty.seconds) empty = e;
+            Sample s = best(1, [&] { script.run(); });
+            if (s.seconds < sample.seconds) sample = s;
+        }
+        report(c.name, "iter", iterations, sample, &empty);
+    }
+}
+
+static bool numberOption(const std::string& arg, const char* name, uint64_t& value) {
+    size_t length = std::strlen(name);
+    if (arg.compare(0, length, name) != 0) return false;
+    std::string digits = arg.substr(length);
+    if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) {
+        std::fprintf(stderr, "Error: Invalid number in '%s'\n", arg.c_str());
+        std::exit(1);
+    }
+    value = std::strtoull(digits.c_str(), nullptr, 10);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        uint64_t value = 0;
+        if (numberOption(arg, "--bytes=", value)) {
+            options.bytes = value;
+        } else if (numberOption(arg, "--iterations=", value)) {
+            options.iterations = std::max<uint64_t>(value, 1);
+        } else if (numberOption(arg, "--repeat=", value)) {
+            options.repeat = static_cast<int>(std::max<uint64_t>(value, 1));
+        } else if (arg == "--vm") {
+            options.vm = true;
+        } else if (arg == "--counters") {
+            options.counters = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::fprintf(stderr, "Error: Unknown option '%s'\n", arg.c_str());
+            return 1;
+        } else {
+            options.filters.push_back(arg);
+        }
+    }
+
+    if (options.counters && !counters.open()) {
+        std::fprintf(stderr, "hardware counters unavailable: %s\n", counters.lastError());
+    }
+
+    std::printf("%-16s %16s", "case", "time");
+    if (counters.active()) {
+        for (const char* name : Counters::NAMES) {
+            std::printf(" %10.10s", name);
+        }
+        std::printf(" %6s", "IPC");
+    }
+    std::printf("\n");
+
+    lexAndParse(options);
+    evaluate(options);
+    return 0;
+}
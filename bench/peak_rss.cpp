@@ -0,0 +1,50 @@
+// Runs a command and writes its peak RSS in KB to a file, for
+// bench/run_bench.py.
+//
+//   g++ -O2 bench/peak_rss.cpp -o peak_rss
+//   ./peak_rss <result file> <command> [args...]
+//
+// Linux counts the RSS of whatever process forks a child towards that
+// child's peak, so the command is started from this small process rather
+// than from the Python runner. Exits with the command's status.
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: peak_rss <result file> <command> [args...]\n");
+        return 2;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        std::perror("fork");
+        return 2;
+    }
+    if (child == 0) {
+        execvp(argv[2], argv + 2);
+        std::perror(argv[2]);
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage = {};
+    while (wait4(child, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            std::perror("wait4");
+            return 2;
+        }
+    }
+    std::FILE* result = std::fopen(argv[1], "w");
+    if (!result) {
+        std::perror(argv[1]);
+        return 2;
+    }
+    // ru_maxrss is in KB on Linux
+    std::fprintf(result, "%ld\n", usage.ru_maxrss);
+    std::fclose(result);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
@@ -0,0 +1,71 @@
+// kteb output benchmark: prints the same lines under each flush policy.
+//
+//   g++ -std=c++17 -O2 -Isrc bench/print_bench.cpp src/Output.cpp src/Value.cpp src/Array.cpp src/Map.cpp -o print_bench
+//   ./print_bench [lines] > /dev/null
+//
+// Redirect stdout to a file or a pipe to see how much the per-line
+// flushing costs; results are reported on stderr.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include "Output.hpp"
+
+// What kteb(i, "squared is", i * i) prints, one line per i.
+static void printLines(Output& out, int lines) {
+    Value label = Value::string("squared is");
+    for (int i = 0; i < lines; ++i) {
+        out.write(Value::number(i));
+        out.write(' ');
+        out.write(label);
+        out.write(' ');
+        out.write(Value::number(static_cast<double>(i) * i));
+        out.endLine();
+    }
+}
+
+template <typename F>
+static double timed(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    int lines = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    
+    // The interpreter before buffering: std::cout with std::endl per line
+    double endlTime = timed([&] {
+        Value label = Value::string("squared is");
+        for (int i = 0; i < lines; ++i) {
+            std::cout << Value::number(i).toString() << " " << label.toString() << " "
+                      << Value::number(static_cast<double>(i) * i).toString() << std::endl;
+        }
+    });
+    std::fprintf(stderr, "%-14s %9.2f ms\n", "cout+endl", endlTime * 1000);
+    
+    struct Case {
+        const char* name;
+        Output::Flush flush;
+        size_t limit;
+    };
+    const Case cases[] = {
+        {"line", Output::Flush::LINE, 0},
+        {"bytes=4096", Output::Flush::BYTES, 4096},
+        {"bytes=65536", Output::Flush::BYTES, 65536},
+        {"exit", Output::Flush::AT_EXIT, 0},
+    };
+    for (const Case& c : cases) {
+        size_t writes = 0;
+        double t = timed([&] {
+            Output out(c.flush, c.limit);
+            printLines(out, lines);
+            out.flush();
+            writes = out.writeCalls();
+        });
+        std::fprintf(stderr, "%-14s %9.2f ms  %zu writes\n", c.name, t * 1000, writes);
+    }
+    return 0;
+}
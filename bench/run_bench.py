@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""End-to-end benchmark suite: runs each workload in bench/workloads, plus a
+large generated script for the lexer and parser, and prints wall time, peak
+RSS and iterations per second as JSON.
+
+    g++ -std=c++17 -O2 src/*.cpp -o lfi3a
+    bench/run_bench.py > before.json
+    ... change the interpreter, rebuild ...
+    bench/run_bench.py --baseline before.json > after.json
+
+Run from the repository root. Each workload states how many iterations it
+does in an "// iterations: N" comment; for the generated script an
+iteration is a source line. Scripts always run with --no-cache, so parsing
+is measured too. With --baseline, every entry also gets the baseline time
+and peak RSS and their change in percent, a table goes to stderr, and the
+exit status is 1 if a workload got slower or bigger by more than
+--threshold percent or now prints something different.
+
+Each run starts from bench/peak_rss.cpp, built into a temporary directory
+with $CXX (default g++), which reports the peak RSS of that run alone.
+Linux counts the RSS of the process that starts a child towards the
+child's peak, so readings at the reported "rss_floor_kb", the helper's
+own, only mean "no more than that".
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH = os.path.dirname(os.path.abspath(__file__))
+WORKLOADS = os.path.join(BENCH, "workloads")
+GENERATED = "large_source"
+GENERATED_FUNCTIONS = 20000
+
+
+def generate_large_source(path):
+    """Many small functions that are parsed but mostly never called."""
+    lines = ["// Generated by bench/run_bench.py: lexer and parser load."]
+    for i in range(GENERATED_FUNCTIONS):
+        lines += [
+            "dalla f%d(a, b) {" % i,
+            "    dir s = a * %d + b - %d.5  // keep the lexer busy" % (i, i),
+            "    ila (s > %d w a != b) {" % i,
+            '        s = s + "x%d"' % i,
+            "    } wila (s <= 0 wla b == %d) {" % i,
+            "        s = (s - 1) / 2",
+            "    }",
+            "    rje3 s",
+            "}",
+        ]
+    lines += ["dir total = 0"]
+    lines += ["total = total + f%d(%d, 1)" % (i, i) for i in range(0, GENERATED_FUNCTIONS, 1000)]
+    lines += ['kteb("total", total)']
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    return len(lines)
+
+
+def declared_iterations(path):
+    with open(path) as f:
+        match = re.search(r"^// iterations: (\d+)$", f.read(), re.MULTILINE)
+    if not match:
+        sys.exit("%s: no '// iterations: N' comment" % path)
+    return int(match.group(1))
+
+
+def build_helper(work):
+    """Compiles bench/peak_rss.cpp into work; returns its path."""
+    helper = os.path.join(work, "peak_rss")
+    compiler = os.environ.get("CXX", "g++")
+    result = subprocess.run([compiler, "-O2", os.path.join(BENCH, "peak_rss.cpp"), "-o", helper],
+                            stderr=subprocess.PIPE)
+    if result.returncode != 0:
+        sys.exit("cannot build bench/peak_rss.cpp with %s:\n%s" % (compiler, result.stderr.decode(errors="replace")))
+    return helper
+
+
+def run_once(helper, command):
+    """Returns wall seconds, peak RSS in KB and a hash of stdout."""
+    with tempfile.TemporaryFile() as out, tempfile.TemporaryFile() as err, \
+            tempfile.NamedTemporaryFile("r") as rss:
+        start = time.perf_counter()
+        returncode = subprocess.call([helper, rss.name] + command, stdout=out, stderr=err)
+        wall = time.perf_counter() - start
+        if returncode != 0:
+            err.seek(0)
+            sys.exit("%s failed (exit %d):\n%s" % (" ".join(command), returncode,
+                                                   err.read().decode(errors="replace")))
+        out.seek(0)
+        digest = hashlib.sha256()
+        for chunk in iter(lambda: out.read(1 << 16), b""):
+            digest.update(chunk)
+        peak = int(rss.read())
+    return wall, peak, digest.hexdigest()[:16]
+
+
+def measure(helper, binary, flags, runs, path, iterations):
+    command = [binary, "--no-cache"] + flags + [path]
+    run_once(helper, command)  # warm the page cache
+    walls = []
+    peak = 0
+    digest = None
+    for _ in range(runs):
+        wall, rss, digest = run_once(helper, command)
+        walls.append(wall)
+        peak = max(peak, rss)
+    wall = statistics.median(walls)
+    return {
+        "wall_s": round(wall, 4),
+        "wall_min_s": round(min(walls), 4),
+        "peak_rss_kb": peak,
+        "iterations": iterations,
+        "iterations_per_s": round(iterations / wall),
+        "output": digest,
+    }
+
+
+def compare(results, baseline, threshold):
+    """Annotates results with the baseline; returns False on a regression."""
+    ok = True
+    print("%-16s %10s %10s %8s %10s %10s %8s" % ("workload", "baseline", "now", "change",
+                                               "base RSS", "RSS", "change"), file=sys.stderr)
+    for name, entry in results.items():
+        old = baseline.get("workloads", {}).get(name)
+        if old is None:
+            print("%-16s %10s %9.3fs %8s %10s %8dK %8s" % (name, "-", entry["wall_s"], "new",
+                                                         "-", entry["peak_rss_kb"], "new"), file=sys.stderr)
+            continue
+        change = (entry["wall_s"] / old["wall_s"] - 1) * 100
+        rss_change = (entry["peak_rss_kb"] / old["peak_rss_kb"] - 1) * 100
+        entry["baseline_wall_s"] = old["wall_s"]
+        entry["change_pct"] = round(change, 1)
+        entry["baseline_peak_rss_kb"] = old["peak_rss_kb"]
+        entry["rss_change_pct"] = round(rss_change, 1)
+        notes = []
+        if old.get("output") not in (None, entry["output"]):
+            notes.append("output differs")
+        if change > threshold:
+            notes.append("slower")
+        if rss_change > threshold:
+            notes.append("bigger")
+        ok = ok and not notes
+        print("%-16s %9.3fs %9.3fs %+7.1f%% %9dK %9dK %+7.1f%%%s"
+              % (name, old["wall_s"], entry["wall_s"], change, old["peak_rss_kb"], entry["peak_rss_kb"],
+                 rss_change, "".join("  " + note for note in notes)), file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--binary", default="./lfi3a", help="interpreter to run (default ./lfi3a)")
+    parser.add_argument("--flags", default="", help='extra options for every run, e.g. "--vm"')
+    parser.add_argument("--runs", type=int, default=5, help="timed runs per workload; the median is reported")
+    parser.add_argument("--baseline", help="JSON from an earlier run to compare against")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="percent slowdown or RSS growth against the baseline that counts as a regression")
+    parser.add_argument("workloads", nargs="*",
+                        help="names to run (default: all, plus %s)" % GENERATED)
+    args = parser.parse_args()
+
+    available = sorted(f[:-len(".lfi3a")] for f in os.listdir(WORKLOADS) if f.endswith(".lfi3a"))
+    names = args.workloads or available + [GENERATED]
+    flags = args.flags.split()
+
+    results = {}
+    with tempfile.TemporaryDirectory() as work:
+        helper = build_helper(work)
+        floor = run_once(helper, ["true"])[1]
+        for name in names:
+            if name == GENERATED:
+                path = os.path.join(work, GENERATED + ".lfi3a")
+                iterations = generate_large_source(path)
+            elif name in available:
+                path = os.path.join(WORKLOADS, name + ".lfi3a")
+                iterations = declared_iterations(path)
+            else:
+                sys.exit("unknown workload '%s'; have %s" % (name, ", ".join(available + [GENERATED])))
+            print("running %s" % name, file=sys.stderr)
+            results[name] = measure(helper, args.binary, flags, args.runs, path, iterations)
+
+    ok = True
+    if args.baseline:
+        with open(args.baseline) as f:
+            ok = compare(results, json.load(f), args.threshold)
+
+    json.dump({"binary": args.binary, "flags": flags, "runs": args.runs, "rss_floor_kb": floor,
+               "workloads": results}, sys.stdout, indent=2)
+    print()
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
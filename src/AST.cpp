@@ -0,0 +1,128 @@
+#include "AST.hpp"
+#include <ostream>
+
+static const char* nodeTypeName(NodeType type) {
+    switch (type) {
+        case NodeType::NUMBER: return "NUMBER";
+        case NodeType::STRING: return "STRING";
+        case NodeType::BOOLEAN: return "BOOLEAN";
+        case NodeType::IDENTIFIER: return "IDENTIFIER";
+        case NodeType::BINARY_OP: return "BINARY_OP";
+        case NodeType::UNARY_OP: return "UNARY_OP";
+        case NodeType::CALL: return "CALL";
+        case NodeType::ARRAY: return "ARRAY";
+        case NodeType::INDEX: return "INDEX";
+        case NodeType::MAP: return "MAP";
+        case NodeType::VAR_DECL: return "VAR_DECL";
+        case NodeType::PRINT: return "PRINT";
+        case NodeType::IF: return "IF";
+        case NodeType::WHILE: return "WHILE";
+        case NodeType::FOR: return "FOR";
+        case NodeType::FUNCTION_DECL: return "FUNCTION_DECL";
+        case NodeType::RETURN: return "RETURN";
+        case NodeType::BLOCK: return "BLOCK";
+        case NodeType::ASSIGNMENT: return "ASSIGNMENT";
+        case NodeType::SET_INDEX: return "SET_INDEX";
+        case NodeType::BUILTIN: return "BUILTIN";
+        case NodeType::NATIVE: return "NATIVE";
+        case NodeType::CACHED: return "CACHED";
+        case NodeType::CLEAR_CACHE: return "CLEAR_CACHE";
+    }
+    return "?";
+}
+
+static const char* opName(Op op) {
+    switch (op) {
+        case Op::NONE: return "";
+        case Op::ADD: return "+";
+        case Op::SUB: return "-";
+        case Op::MUL: return "*";
+        case Op::DIV: return "/";
+        case Op::EQ: return "==";
+        case Op::NE: return "!=";
+        case Op::LT: return "<";
+        case Op::GT: return ">";
+        case Op::LE: return "<=";
+        case Op::GE: return ">=";
+        case Op::AND: return "w";
+        case Op::OR: return "wla";
+        case Op::NEG: return "-";
+        case Op::POST_INC: return "++";
+    }
+    return "?";
+}
+
+static void dumpNode(const Program& program, ASTNodePtr node, int depth, std::ostream& out) {
+    out << std::string(depth * 2, ' ');
+    if (!node) {
+        out << "(empty)\n";
+        return;
+    }
+    
+    out << nodeTypeName(node->type);
+    switch (node->type) {
+        case NodeType::NUMBER:
+            out << ' ' << formatNumber(node->number);
+            break;
+        case NodeType::STRING:
+            out << " \"" << program.strings[node->slot].asString() << '"';
+            break;
+        case NodeType::BOOLEAN:
+            out << ' ' << (node->number != 0 ? "s7i7" : "ghalat");
+            break;
+        case NodeType::BINARY_OP:
+        case NodeType::UNARY_OP:
+            out << ' ' << opName(node->op);
+            break;
+        case NodeType::SET_INDEX:
+            if (node->op != Op::NONE) out << ' ' << opName(node->op) << '=';
+            break;
+        case NodeType::IDENTIFIER:
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+        case NodeType::CACHED:
+        case NodeType::CLEAR_CACHE:
+            out << ' ' << node->value;
+            if (node->slot >= 0) {
+                if (node->isLocal) {
+                    out << " (local " << node->slot << ')';
+                } else {
+                    out << " (global)";
+                }
+            }
+            if (node->inPlace) out << " (in place)";
+            break;
+        case NodeType::CALL:
+        case NodeType::BUILTIN:
+        case NodeType::NATIVE:
+            out << ' ' << node->value;
+            break;
+        case NodeType::FUNCTION_DECL: {
+            out << ' ' << node->value << '(';
+            const char* separator = "";
+            for (Symbol param : node->function->params) {
+                out << separator << program.symbols->name(param);
+                separator = ", ";
+            }
+            out << ')';
+            if (node->function->memoSlot >= 0) out << " pure";
+            break;
+        }
+        default:
+            break;
+    }
+    out << '\n';
+    
+    for (ASTNodePtr child : node->children) {
+        dumpNode(program, child, depth + 1, out);
+    }
+    if (node->type == NodeType::FUNCTION_DECL) {
+        dumpNode(program, node->function->body, depth + 1, out);
+    }
+}
+
+void dumpAST(const Program& program, std::ostream& out) {
+    for (ASTNodePtr node : program.statements) {
+        dumpNode(program, node, 0, out);
+    }
+}
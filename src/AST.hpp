@@ -1,15 +1,21 @@
 #ifndef LFI3A_AST_HPP
 #define LFI3A_AST_HPP
 
-#include <string>
-#include <vector>
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
+#include <string_view>
+#include <vector>
+#include "Arena.hpp"
+#include "Symbols.hpp"
+#include "Value.hpp"
 
-// Forward declaration
+// Nodes are allocated from the owning Program's arena and never freed
+// individually, so plain pointers are enough.
 struct ASTNode;
-using ASTNodePtr = std::shared_ptr<ASTNode>;
+using ASTNodePtr = ASTNode*;
 
-enum class NodeType {
+enum class NodeType : uint8_t {
     // Literals
     NUMBER,
     STRING,
@@ -20,6 +26,9 @@ enum class NodeType {
     BINARY_OP,
     UNARY_OP,
     CALL,
+    ARRAY,        // [children...]
+    INDEX,        // children[0][children[1]]
+    MAP,          // {children[0]: children[1], children[2]: children[3], ...}
     
     // Statements
     VAR_DECL,
@@ -30,18 +39,94 @@ enum class NodeType {
     FUNCTION_DECL,
     RETURN,
     BLOCK,
-    ASSIGNMENT
+    ASSIGNMENT,
+    SET_INDEX,    // children[0][children[1]] = children[2], or op= it
+    
+    // Introduced by Resolver
+    BUILTIN,      // a CALL to a builtin function, the Builtin in slot
+    NATIVE,       // a CALL to a function the host registered, its index in slot
+    
+    // Introduced by Optimizer
+    CACHED,       // children[0], evaluated once and then kept in the node's variable
+    CLEAR_CACHE   // forgets the value kept by CACHED nodes with the same variable
+};
+
+// Operators, decided by the parser.
+enum class Op : uint8_t {
+    NONE,
+    ADD,        // +
+    SUB,        // -
+    MUL,        // *
+    DIV,        // /
+    EQ,         // ==
+    NE,         // !=
+    LT,         // <
+    GT,         // >
+    LE,         // <=
+    GE,         // >=
+    AND,        // w
+    OR,         // wla
+    NEG,        // unary -
+    POST_INC    // x++
+};
+
+// Where a node starts in the source, counted from 1. Nodes the Optimizer
+// makes up take the location of the code they stand for.
+struct SourceLocation {
+    uint32_t line = 0;
+    uint32_t column = 0;
+};
+
+struct FunctionInfo {
+    Span<Symbol> params;
+    ASTNodePtr body = nullptr;
+    
+    // Filled in by Resolver: the locals after the parameters, as the index
+    // of the global each one starts out as.
+    Span<int> localGlobals;
+    
+    // Filled in by Purity: index into Program::pureFunctions, or -1.
+    int32_t memoSlot = -1;
 };
 
 struct ASTNode {
     NodeType type;
-    std::string value;  // For literals and identifiers
-    std::string op;     // For operators
-    std::vector<ASTNodePtr> children;  // For expressions, statements, etc.
+    Op op = Op::NONE;
+    
+    // Filled in by Resolver. Variables get a frame slot (isLocal) or a
+    // global slot; CALL and FUNCTION_DECL get the function's slot. Global
+    // and function slots are the name's Symbol. STRING literals keep their
+    // index into Program::strings here. CACHED and CLEAR_CACHE nodes use
+    // a hidden variable, named by the Optimizer, the same way. BUILTIN
+    // nodes keep the Builtin here, NATIVE nodes the native's index.
+    bool isLocal = false;
+    int32_t slot = -1;
     
-    // For function declarations
-    std::vector<std::string> params;
-    ASTNodePtr body;
+    // ASSIGNMENT only, from Resolver: the value is x + e1 + ... + en for
+    // the variable x assigned, and adding the terms to x one by one, where
+    // x is, gives the same result. A string x then grows without copying.
+    bool inPlace = false;
+    
+    Symbol symbol = 0;        // identifier or function name
+    int32_t site = -1;        // CALL only: call site number, from Resolver
+    double number = 0;        // NUMBER value; 1 or 0 for BOOLEAN
+    std::string_view value;   // identifier, function name or literal text
+    Span<ASTNodePtr> children;
+    FunctionInfo* function = nullptr;  // FUNCTION_DECL only
+    SourceLocation location;           // first token of the node
+};
+
+// A parsed program and the arena that owns its nodes.
+struct Program {
+    Arena arena;
+    std::vector<ASTNodePtr> statements;
+    std::vector<Value> strings;  // string literal values
+    std::shared_ptr<SymbolTable> symbols;  // also names the Optimizer's hidden variables
+    uint32_t callSites = 0;                // CALL nodes numbered by Resolver
+    std::vector<ASTNodePtr> pureFunctions; // FUNCTION_DECLs Purity found memoizable
 };
 
+// Prints the tree one node per line, children indented under their parent.
+void dumpAST(const Program& program, std::ostream& out);
+
 #endif
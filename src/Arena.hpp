@@ -0,0 +1,94 @@
+#ifndef LFI3A_ARENA_HPP
+#define LFI3A_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A contiguous, arena-owned array.
+template <typename T>
+struct Span {
+    T* data = nullptr;
+    uint32_t count = 0;
+
+    uint32_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return data[i]; }
+    T* begin() const { return data; }
+    T* end() const { return data + count; }
+};
+
+// Bump allocator for objects that live as long as a parsed program. Only
+// trivially destructible types may be allocated: nothing is ever destroyed
+// individually, the blocks are simply freed together.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (!cursor || p + size > reinterpret_cast<uintptr_t>(limit)) {
+            size_t blockSize = size + align > BLOCK_SIZE ? size + align : BLOCK_SIZE;
+            blocks.emplace_back(new char[blockSize]);
+            cursor = blocks.back().get();
+            limit = cursor + blockSize;
+            p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cursor = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    Span<T> copy(const std::vector<T>& items) {
+        return copy(items.data(), items.size());
+    }
+
+    template <typename T>
+    Span<T> copy(std::initializer_list<T> items) {
+        return copy(items.begin(), items.size());
+    }
+
+    template <typename T>
+    Span<T> copy(const T* items, size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        Span<T> span;
+        if (count == 0) return span;
+        span.data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        span.count = static_cast<uint32_t>(count);
+        std::uninitialized_copy(items, items + count, span.data);
+        return span;
+    }
+
+    std::string_view copy(std::string_view text) {
+        if (text.empty()) return std::string_view();
+        char* chars = static_cast<char*>(allocate(text.size(), 1));
+        std::memcpy(chars, text.data(), text.size());
+        return std::string_view(chars, text.size());
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include "Array.hpp"
+#include <cmath>
+#include <memory>
+
+#if !defined(LFI3A_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define LFI3A_SIMD_DOUBLES 4
+#elif !defined(LFI3A_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define LFI3A_SIMD_DOUBLES 2
+#endif
+
+// Element operations, for single doubles and for vectors of them. lower
+// and higher behave like minpd and maxpd: the second operand when either
+// is NaN.
+static inline double plus(double a, double b) { return a + b; }
+static inline double minus(double a, double b) { return a - b; }
+static inline double times(double a, double b) { return a * b; }
+static inline double over(double a, double b) { return a / b; }
+static inline double lower(double a, double b) { return a < b ? a : b; }
+static inline double higher(double a, double b) { return a > b ? a : b; }
+
+#if defined(LFI3A_SIMD_DOUBLES) && LFI3A_SIMD_DOUBLES == 4
+typedef __m256d Vec;
+static inline Vec load(const double* p) { return _mm256_loadu_pd(p); }
+static inline void store(double* p, Vec v) { _mm256_storeu_pd(p, v); }
+static inline Vec splat(double x) { return _mm256_set1_pd(x); }
+static inline Vec plus(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+static inline Vec minus(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+static inline Vec times(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+static inline Vec over(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+static inline Vec lower(Vec a, Vec b) { return _mm256_min_pd(a, b); }
+static inline Vec higher(Vec a, Vec b) { return _mm256_max_pd(a, b); }
+#elif defined(LFI3A_SIMD_DOUBLES)
+typedef __m128d Vec;
+static inline Vec load(const double* p) { return _mm_loadu_pd(p); }
+static inline void store(double* p, Vec v) { _mm_storeu_pd(p, v); }
+static inline Vec splat(double x) { return _mm_set1_pd(x); }
+static inline Vec plus(Vec a, Vec b) { return _mm_add_pd(a, b); }
+static inline Vec minus(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+static inline Vec times(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+static inline Vec over(Vec a, Vec b) { return _mm_div_pd(a, b); }
+static inline Vec lower(Vec a, Vec b) { return _mm_min_pd(a, b); }
+static inline Vec higher(Vec a, Vec b) { return _mm_max_pd(a, b); }
+#else
+#define LFI3A_SIMD_DOUBLES 1
+typedef double Vec;
+static inline Vec load(const double* p) { return *p; }
+static inline void store(double* p, Vec v) { *p = v; }
+static inline Vec splat(double x) { return x; }
+#endif
+
+static constexpr size_t WIDTH = LFI3A_SIMD_DOUBLES;
+static constexpr size_t LANES = 8;
+static constexpr size_t VECTORS = LANES / WIDTH;
+
+// Lane j of the accumulators, j < LANES.
+static inline void spill(const Vec* acc, double* lanes) {
+    for (size_t k = 0; k < VECTORS; ++k) {
+        store(lanes + k * WIDTH, acc[k]);
+    }
+}
+
+double sumOf(const double* p, size_t n) {
+    Vec acc[VECTORS];
+    for (Vec& v : acc) v = splat(0);
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t k = 0; k < VECTORS; ++k) {
+            acc[k] = plus(acc[k], load(p + i + k * WIDTH));
+        }
+    }
+    double lanes[LANES];
+    spill(acc, lanes);
+    double total = ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+    for (; i < n; ++i) total += p[i];
+    return total;
+}
+
+double dotOf(const double* a, const double* b, size_t n) {
+    Vec acc[VECTORS];
+    for (Vec& v : acc) v = splat(0);
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t k = 0; k < VECTORS; ++k) {
+            acc[k] = plus(acc[k], times(load(a + i + k * WIDTH), load(b + i + k * WIDTH)));
+        }
+    }
+    double lanes[LANES];
+    spill(acc, lanes);
+    double total = ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+    for (; i < n; ++i) total += a[i] * b[i];
+    return total;
+}
+
+// Starting from `start`, which no element can beat, so NaN elements are
+// passed over; when `start` is still the answer, it may be all there was.
+template <typename Pick>
+static double extreme(const double* p, size_t n, double start, Pick pick) {
+    Vec acc[VECTORS];
+    for (Vec& v : acc) v = splat(start);
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t k = 0; k < VECTORS; ++k) {
+            acc[k] = pick(load(p + i + k * WIDTH), acc[k]);
+        }
+    }
+    double lanes[LANES];
+    spill(acc, lanes);
+    double result = start;
+    for (double lane : lanes) result = pick(lane, result);
+    for (; i < n; ++i) result = pick(p[i], result);
+    if (result == start) {
+        for (i = 0; i < n; ++i) {
+            if (p[i] == start) return start;
+        }
+        return NAN;
+    }
+    return result;
+}
+
+double minOf(const double* p, size_t n) {
+    return extreme(p, n, INFINITY, [](auto x, auto m) { return lower(x, m); });
+}
+
+double maxOf(const double* p, size_t n) {
+    return extreme(p, n, -INFINITY, [](auto x, auto m) { return higher(x, m); });
+}
+
+template <typename F>
+static void mapArrays(const double* a, const double* b, double* out, size_t n, F f) {
+    size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+        store(out + i, f(load(a + i), load(b + i)));
+    }
+    for (; i < n; ++i) out[i] = f(a[i], b[i]);
+}
+
+// f(a[i], x) for each i, or f(x, a[i]) when the number comes first.
+template <typename F>
+static void mapNumber(const double* a, double x, bool numberFirst, double* out, size_t n, F f) {
+    size_t i = 0;
+    Vec v = splat(x);
+    if (numberFirst) {
+        for (; i + WIDTH <= n; i += WIDTH) store(out + i, f(v, load(a + i)));
+        for (; i < n; ++i) out[i] = f(x, a[i]);
+    } else {
+        for (; i + WIDTH <= n; i += WIDTH) store(out + i, f(load(a + i), v));
+        for (; i < n; ++i) out[i] = f(a[i], x);
+    }
+}
+
+template <typename F>
+static void map(const double* a, const double* b, double x, bool numberFirst, double* out, size_t n, F f) {
+    if (b) {
+        mapArrays(a, b, out, n, f);
+    } else {
+        mapNumber(a, x, numberFirst, out, n, f);
+    }
+}
+
+const char* arrayKernelLevel() {
+#if LFI3A_SIMD_DOUBLES == 4
+    return "avx2";
+#elif LFI3A_SIMD_DOUBLES == 2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+Array::Array(std::vector<Value> values) {
+    for (const Value& value : values) {
+        if (!value.isNumber()) {
+            values_ = std::move(values);
+            numeric_ = false;
+            return;
+        }
+    }
+    numbers_.reserve(values.size());
+    for (const Value& value : values) {
+        numbers_.push_back(value.asNumber());
+    }
+}
+
+const std::vector<double>* Array::numbers() {
+    if (numeric_) return &numbers_;
+    for (const Value& value : values_) {
+        if (!value.isNumber()) return nullptr;
+    }
+    numbers_.clear();
+    numbers_.reserve(values_.size());
+    for (const Value& value : values_) {
+        numbers_.push_back(value.asNumber());
+    }
+    values_.clear();
+    values_.shrink_to_fit();
+    numeric_ = true;
+    return &numbers_;
+}
+
+void Array::box() {
+    values_.reserve(numbers_.size());
+    for (double n : numbers_) {
+        values_.push_back(Value::number(n));
+    }
+    numbers_.clear();
+    numbers_.shrink_to_fit();
+    numeric_ = false;
+}
+
+void Array::setBoxed(size_t i, Value value) {
+    if (numeric_) box();
+    values_[i] = std::move(value);
+}
+
+void Array::pushBoxed(Value value) {
+    if (numeric_) box();
+    values_.push_back(std::move(value));
+}
+
+std::string arrayToString(const Array& array) {
+    // Arrays being printed, outermost first
+    static thread_local std::vector<const Array*> printing;
+    for (const Array* outer : printing) {
+        if (outer == &array) return "[...]";
+    }
+    printing.push_back(&array);
+    std::string text = "[";
+    for (size_t i = 0; i < array.size(); ++i) {
+        if (i > 0) text += ", ";
+        text += array.get(i).toString();
+    }
+    printing.pop_back();
+    return text + "]";
+}
+
+std::string expectedNumbers(const Value& value) {
+    return "Expected an array of numbers but got '" + value.toString() + "'";
+}
+
+std::string expectedNumber(const Value& value) {
+    return "Expected a number but got '" + value.toString() + "'";
+}
+
+bool isElementwise(const Value& l, const Value& r) {
+    double n;
+    return (l.isArray() && (r.isArray() || r.tryNumber(n))) || (r.isArray() && l.tryNumber(n));
+}
+
+std::string elementwise(ArrayOp op, const Value& l, const Value& r, Value& result) {
+    // The array side, and the other side as an array or a number
+    const std::vector<double>* a = nullptr;
+    const std::vector<double>* b = nullptr;
+    double x = 0;
+    bool numberFirst = !l.isArray();
+    const Value& array = numberFirst ? r : l;
+    const Value& other = numberFirst ? l : r;
+    if (numberFirst && !l.tryNumber(x)) return expectedNumber(l);
+    if (!(a = array.asArray().numbers())) return expectedNumbers(array);
+    if (other.isArray()) {
+        if (!(b = other.asArray().numbers())) return expectedNumbers(other);
+        if (b->size() != a->size()) {
+            return "Arrays of different lengths (" + std::to_string(l.asArray().size()) + " and " +
+                   std::to_string(r.asArray().size()) + ")";
+        }
+    } else if (!numberFirst && !r.tryNumber(x)) {
+        return expectedNumber(r);
+    }
+
+    size_t n = a->size();
+    std::vector<double> out(n);
+    const double* bp = b ? b->data() : nullptr;
+    switch (op) {
+        case ArrayOp::ADD:
+            map(a->data(), bp, x, numberFirst, out.data(), n, [](auto p, auto q) { return plus(p, q); });
+            break;
+        case ArrayOp::SUB:
+            map(a->data(), bp, x, numberFirst, out.data(), n, [](auto p, auto q) { return minus(p, q); });
+            break;
+        case ArrayOp::MUL:
+            map(a->data(), bp, x, numberFirst, out.data(), n, [](auto p, auto q) { return times(p, q); });
+            break;
+        case ArrayOp::DIV: {
+            // Every divisor is checked first, as a scalar / would be
+            const double* divisors = numberFirst ? a->data() : bp;
+            bool zero = divisors ? false : x == 0 && n > 0;
+            for (size_t i = 0; divisors && i < n && !zero; ++i) {
+                zero = divisors[i] == 0;
+            }
+            if (zero) return "Division by zero";
+            map(a->data(), bp, x, numberFirst, out.data(), n, [](auto p, auto q) { return over(p, q); });
+            break;
+        }
+    }
+    result = Value::array(std::make_shared<Array>(std::move(out)));
+    return std::string();
+}
+
+std::string negate(const Value& operand, Value& result) {
+    const std::vector<double>* a = operand.asArray().numbers();
+    if (!a) return expectedNumbers(operand);
+    std::vector<double> out(a->size());
+    // -0 - x is exactly -x, zeros included
+    mapNumber(a->data(), -0.0, true, out.data(), a->size(), [](auto p, auto q) { return minus(p, q); });
+    result = Value::array(std::make_shared<Array>(std::move(out)));
+    return std::string();
+}
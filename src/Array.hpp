@@ -0,0 +1,95 @@
+#ifndef LFI3A_ARRAY_HPP
+#define LFI3A_ARRAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Value.hpp"
+
+// The elements of an array value. While every element is a number they are
+// kept unboxed, as one contiguous run of doubles that the kernels below
+// work through several at a time. Storing anything else boxes them into
+// Values; the numeric operations unbox them again once they find nothing
+// but numbers.
+class Array {
+public:
+    Array() = default;
+    explicit Array(std::vector<double> numbers) : numbers_(std::move(numbers)) {}
+    explicit Array(std::vector<Value> values);
+
+    size_t size() const { return numeric_ ? numbers_.size() : values_.size(); }
+
+    Value get(size_t i) const { return numeric_ ? Value::number(numbers_[i]) : values_[i]; }
+
+    void set(size_t i, Value value) {
+        if (numeric_ && value.isNumber()) {
+            numbers_[i] = value.asNumber();
+        } else {
+            setBoxed(i, std::move(value));
+        }
+    }
+
+    void push(Value value) {
+        if (numeric_ && value.isNumber()) {
+            numbers_.push_back(value.asNumber());
+        } else {
+            pushBoxed(std::move(value));
+        }
+    }
+
+    // The elements as doubles, or null if some element is not a number.
+    const std::vector<double>* numbers();
+
+private:
+    std::vector<double> numbers_;
+    std::vector<Value> values_;
+    bool numeric_ = true;
+
+    void box();
+    void setBoxed(size_t i, Value value);
+    void pushBoxed(Value value);
+};
+
+// "[1, 2, 3]"; an array that contains itself prints as "[...]" in there.
+std::string arrayToString(const Array& array);
+
+// Messages for an operand that is not an array of numbers, or not a number.
+std::string expectedNumbers(const Value& value);
+std::string expectedNumber(const Value& value);
+
+// The operations below return an error message for the engine to report,
+// or an empty string once result is set.
+
+enum class ArrayOp : uint8_t { ADD, SUB, MUL, DIV };
+
+// Whether + works element by element: one side is an array and the other
+// an array or a number. Otherwise + with an array concatenates text.
+bool isElementwise(const Value& l, const Value& r);
+
+// l op r where l or r is an array. Arrays must have the same length; a
+// number on either side applies to every element.
+std::string elementwise(ArrayOp op, const Value& l, const Value& r, Value& result);
+
+// -operand for an array operand.
+std::string negate(const Value& operand, Value& result);
+
+// Kernels over contiguous doubles. With SSE2 (always available on x86-64)
+// or AVX2 (when compiled with -mavx2) they handle 2 or 4 elements per
+// instruction; otherwise, or when LFI3A_NO_SIMD is defined, one.
+//
+// Reductions keep eight running lanes, element i going to lane i % 8,
+// combine them in a fixed order and then take the last n % 8 elements in
+// turn, whatever the vector width. A sum can therefore differ in its last
+// bits from a left-to-right loop, but never between builds. min and max
+// skip NaN elements, unless there is nothing else.
+double sumOf(const double* p, size_t n);
+double minOf(const double* p, size_t n);  // n > 0
+double maxOf(const double* p, size_t n);  // n > 0
+double dotOf(const double* a, const double* b, size_t n);
+
+// "avx2", "sse2" or "scalar": the code path the kernels were built with.
+const char* arrayKernelLevel();
+
+#endif
@@ -0,0 +1,158 @@
+#include "Builtins.hpp"
+#include <cmath>
+#include <memory>
+
+static std::string notAnArray(const Value& value) {
+    return "Expected an array but got '" + value.toString() + "'";
+}
+
+static std::string notAMap(const Value& value) {
+    return "Expected a map but got '" + value.toString() + "'";
+}
+
+std::string indexError(const Value& container, const Value& index) {
+    if (container.isMap()) {
+        if (!Map::isKey(index)) return invalidKey(index);
+        return "Key '" + index.toString() + "' is not in the map";
+    }
+    if (!container.isArray()) return "Expected an array or a map but got '" + container.toString() + "'";
+    double i = index.isNumber() ? index.asNumber() : -1;
+    if (!index.isNumber() || i != std::floor(i)) return "Index must be a whole number, got '" + index.toString() + "'";
+    return "Index " + formatNumber(i) + " is out of range for an array of length " +
+           std::to_string(container.asArray().size());
+}
+
+static const char* const BUILTIN_NAMES[] = {"len",  "push", "sum",    "min",  "max",   "dot",
+                                            "has", "get",  "delete", "keys", "values"};
+
+bool findBuiltin(std::string_view name, Builtin& out) {
+    for (size_t i = 0; i < sizeof(BUILTIN_NAMES) / sizeof(BUILTIN_NAMES[0]); ++i) {
+        if (name == BUILTIN_NAMES[i]) {
+            out = static_cast<Builtin>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* builtinName(Builtin builtin) {
+    return BUILTIN_NAMES[static_cast<size_t>(builtin)];
+}
+
+static std::string arityError(Builtin builtin, size_t expected, size_t argc) {
+    return std::string(builtinName(builtin)) + " takes " + std::to_string(expected) +
+           (expected == 1 ? " argument" : " arguments") + " but got " + std::to_string(argc);
+}
+
+// min(x, y, ...) and max(x, y, ...) on plain numbers, first to last.
+static std::string extremeOfArguments(Builtin builtin, const Value* args, size_t argc, Value& result) {
+    double best = 0;
+    for (size_t i = 0; i < argc; ++i) {
+        double n;
+        if (!args[i].tryNumber(n)) return expectedNumber(args[i]);
+        if (i == 0 || (builtin == Builtin::MIN ? n < best : n > best)) best = n;
+    }
+    result = Value::number(best);
+    return std::string();
+}
+
+std::string callBuiltin(Builtin builtin, const Value* args, size_t argc, Value& result) {
+    switch (builtin) {
+        case Builtin::LEN:
+            if (argc != 1) return arityError(builtin, 1, argc);
+            if (args[0].isString()) {
+                result = Value::number(static_cast<double>(args[0].asString().size()));
+            } else if (args[0].isArray()) {
+                result = Value::number(static_cast<double>(args[0].asArray().size()));
+            } else if (args[0].isMap()) {
+                result = Value::number(static_cast<double>(args[0].asMap().size()));
+            } else {
+                return "Expected an array, a map or a string but got '" + args[0].toString() + "'";
+            }
+            return std::string();
+
+        case Builtin::PUSH: {
+            if (argc != 2) return arityError(builtin, 2, argc);
+            if (!args[0].isArray()) return notAnArray(args[0]);
+            Array& array = args[0].asArray();
+            array.push(args[1]);
+            result = Value::number(static_cast<double>(array.size()));
+            return std::string();
+        }
+
+        case Builtin::SUM: {
+            if (argc != 1) return arityError(builtin, 1, argc);
+            if (!args[0].isArray()) return notAnArray(args[0]);
+            const std::vector<double>* a = args[0].asArray().numbers();
+            if (!a) return expectedNumbers(args[0]);
+            result = Value::number(sumOf(a->data(), a->size()));
+            return std::string();
+        }
+
+        case Builtin::MIN:
+        case Builtin::MAX: {
+            if (argc == 0) return std::string(builtinName(builtin)) + " takes at least 1 argument";
+            if (argc > 1 || !args[0].isArray()) return extremeOfArguments(builtin, args, argc, result);
+            const std::vector<double>* a = args[0].asArray().numbers();
+            if (!a) return expectedNumbers(args[0]);
+            if (a->empty()) return std::string(builtinName(builtin)) + " of an empty array";
+            result = Value::number(builtin == Builtin::MIN ? minOf(a->data(), a->size()) : maxOf(a->data(), a->size()));
+            return std::string();
+        }
+
+        case Builtin::DOT: {
+            if (argc != 2) return arityError(builtin, 2, argc);
+            for (size_t i = 0; i < 2; ++i) {
+                if (!args[i].isArray()) return notAnArray(args[i]);
+            }
+            const std::vector<double>* a = args[0].asArray().numbers();
+            if (!a) return expectedNumbers(args[0]);
+            const std::vector<double>* b = args[1].asArray().numbers();
+            if (!b) return expectedNumbers(args[1]);
+            if (a->size() != b->size()) {
+                return "Arrays of different lengths (" + std::to_string(a->size()) + " and " +
+                       std::to_string(b->size()) + ")";
+            }
+            result = Value::number(dotOf(a->data(), b->data(), a->size()));
+            return std::string();
+        }
+
+        // A key that no map can have is simply not there
+        case Builtin::HAS: {
+            if (argc != 2) return arityError(builtin, 2, argc);
+            if (!args[0].isMap()) return notAMap(args[0]);
+            result = Value::boolean(Map::isKey(args[1]) && args[0].asMap().find(args[1]));
+            return std::string();
+        }
+
+        case Builtin::GET: {
+            if (argc != 3) return arityError(builtin, 3, argc);
+            if (!args[0].isMap()) return notAMap(args[0]);
+            Value* found = Map::isKey(args[1]) ? args[0].asMap().find(args[1]) : nullptr;
+            result = found ? *found : args[2];
+            return std::string();
+        }
+
+        case Builtin::DELETE: {
+            if (argc != 2) return arityError(builtin, 2, argc);
+            if (!args[0].isMap()) return notAMap(args[0]);
+            result = Value::boolean(Map::isKey(args[1]) && args[0].asMap().remove(args[1]));
+            return std::string();
+        }
+
+        case Builtin::KEYS:
+        case Builtin::VALUES: {
+            if (argc != 1) return arityError(builtin, 1, argc);
+            if (!args[0].isMap()) return notAMap(args[0]);
+            const Map& map = args[0].asMap();
+            std::vector<Value> items;
+            items.reserve(map.size());
+            for (const Map::Entry& entry : map.entries()) {
+                if (!entry.key.isNil()) items.push_back(builtin == Builtin::KEYS ? entry.key : entry.value);
+            }
+            result = Value::array(std::make_shared<Array>(std::move(items)));
+            return std::string();
+        }
+    }
+    return std::string();
+}
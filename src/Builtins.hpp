@@ -0,0 +1,90 @@
+#ifndef LFI3A_BUILTINS_HPP
+#define LFI3A_BUILTINS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "Array.hpp"
+#include "Map.hpp"
+#include "Value.hpp"
+
+// What every engine does the same way with arrays and maps: indexing and
+// the builtin functions.
+
+// container[index] into out. Returns false unless container is an array
+// and index a whole number below its length, or a map with the key index;
+// indexError() then says which.
+inline bool getElement(const Value& container, const Value& index, Value& out) {
+    if (container.isArray()) {
+        if (!index.isNumber()) return false;
+        const Array& elements = container.asArray();
+        double i = index.asNumber();
+        if (!(i >= 0 && i < static_cast<double>(elements.size())) || i != static_cast<double>(static_cast<size_t>(i))) {
+            return false;
+        }
+        out = elements.get(static_cast<size_t>(i));
+        return true;
+    }
+    if (container.isMap() && Map::isKey(index)) {
+        Value* found = container.asMap().find(index);
+        if (!found) return false;
+        // A copy first: out may be the container itself
+        out = Value(*found);
+        return true;
+    }
+    return false;
+}
+
+// container[index] = value. An array needs the same index as above; a map
+// takes any key for which Map::isKey() holds.
+inline bool setElement(const Value& container, const Value& index, Value value) {
+    if (container.isArray()) {
+        if (!index.isNumber()) return false;
+        Array& elements = container.asArray();
+        double i = index.asNumber();
+        if (!(i >= 0 && i < static_cast<double>(elements.size())) || i != static_cast<double>(static_cast<size_t>(i))) {
+            return false;
+        }
+        elements.set(static_cast<size_t>(i), std::move(value));
+        return true;
+    }
+    if (container.isMap() && Map::isKey(index)) {
+        container.asMap().set(index, std::move(value));
+        return true;
+    }
+    return false;
+}
+
+std::string indexError(const Value& container, const Value& index);
+
+// Functions a script can call without declaring them. A dalla of the same
+// name anywhere in the script replaces the builtin everywhere.
+enum class Builtin : uint8_t {
+    LEN,     // len(x): elements of an array, keys of a map, or bytes of a string
+    PUSH,    // push(a, v): appends v to a; returns the new length
+    SUM,     // sum(a)
+    MIN,     // min(a), or the smallest of min(x, y, ...)
+    MAX,     // max(a), or the largest of max(x, y, ...)
+    DOT,     // dot(a, b): sum of a[i] * b[i]
+    HAS,     // has(m, k): whether map m has the key k
+    GET,     // get(m, k, d): m[k], or d when m has no key k
+    DELETE,  // delete(m, k): removes k from m; returns whether it was there
+    KEYS,    // keys(m): the keys of m as an array, oldest first
+    VALUES   // values(m): the values of m, in the same order
+};
+
+bool findBuiltin(std::string_view name, Builtin& out);
+const char* builtinName(Builtin builtin);
+
+// Returns an error message, or an empty string once result is set.
+std::string callBuiltin(Builtin builtin, const Value* args, size_t argc, Value& result);
+
+// A function the program embedding lfi3a registers (see Lfi3a.hpp). It
+// gets the arguments as evaluated and returns the value of the call; it
+// reports an error by throwing ScriptError.
+using NativeFunction = std::function<Value(const Value* args, size_t argc)>;
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef LFI3A_BYTECODE_HPP
+#define LFI3A_BYTECODE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Value.hpp"
+
+// Every opcode, in dispatch-table order. The VM builds its computed-goto
+// table from this list, so new opcodes only need to be added here.
+#define LFI3A_OPCODES(X) \
+    X(CONSTANT)          /* push constants[a]                          */ \
+    X(TRUE)              /* push s7i7                                  */ \
+    X(FALSE)             /* push ghalat                                */ \
+    X(NIL)               /* push nil                                   */ \
+    X(POP)               /* drop top of stack                          */ \
+    X(DUP2)              /* push the top two values again, in order    */ \
+    X(GET_GLOBAL)        /* push globals[a]                            */ \
+    X(SET_GLOBAL)        /* globals[a] = pop                           */ \
+    X(GET_LOCAL)         /* push locals[a]                             */ \
+    X(SET_LOCAL)         /* locals[a] = pop                            */ \
+    X(INIT_LOCAL)        /* locals[a] = globals[b], without checks     */ \
+    X(INC_GLOBAL)        /* push globals[a], then globals[a] += 1      */ \
+    X(INC_LOCAL)         /* push locals[a], then locals[a] += 1        */ \
+    X(GET_CACHED_GLOBAL) /* if globals[a] is set, push it and ip = b   */ \
+    X(GET_CACHED_LOCAL)  /* if locals[a] is set, push it and ip = b    */ \
+    X(ADD_TO_GLOBAL)     /* pop v and a copy of globals[a]; += v       */ \
+    X(ADD_TO_LOCAL)      /* pop v and a copy of locals[a]; += v        */ \
+    X(ADD)                                                                \
+    X(SUB)                                                                \
+    X(MUL)                                                                \
+    X(DIV)                                                                \
+    X(EQ)                                                                 \
+    X(NE)                                                                 \
+    X(LT)                                                                 \
+    X(GT)                                                                 \
+    X(LE)                                                                 \
+    X(GE)                                                                 \
+    X(AND)                                                                \
+    X(OR)                                                                 \
+    X(NEG)                                                                \
+    X(ARRAY)             /* push an array of the top a values          */ \
+    X(MAP)               /* push a map of the top 2a values, k1 v1 ... */ \
+    X(GET_INDEX)         /* pop index and container, push c[index]     */ \
+    X(SET_INDEX)         /* pop v, index, container; c[index] = v      */ \
+    X(BUILTIN)           /* call Builtin a on the top b values         */ \
+    X(JUMP)              /* ip = a                                     */ \
+    X(JUMP_IF_FALSE)     /* if !truthy(pop) ip = a                     */ \
+    X(PRINT_ARG)         /* print pop, then a space if a               */ \
+    X(PRINT_END)         /* end the line kteb printed                  */ \
+    X(DEFINE_FUNCTION)   /* function name a now refers to functions[b] */ \
+    X(CALL)              /* call site a, passing b arguments           */ \
+    X(TAIL_CALL)         /* like CALL, but replaces the current frame  */ \
+    X(RETURN)            /* return pop to the caller                   */ \
+    X(LINE)              /* a statement on line a starts (--profile)   */
+
+enum class OpCode : uint8_t {
+#define LFI3A_OPCODE_ENUM(name) name,
+    LFI3A_OPCODES(LFI3A_OPCODE_ENUM)
+#undef LFI3A_OPCODE_ENUM
+};
+
+struct Instruction {
+    OpCode op;
+    int32_t a = 0;
+    int32_t b = 0;
+};
+
+struct CompiledFunction {
+    std::string name;
+    int arity = 0;
+    int numLocals = 0;      // parameters first, then other locals
+    int maxStack = 0;       // deepest operand stack needed above the locals
+    int memoSlot = -1;      // memo table index if the function is pure
+    std::vector<std::string> localNames;
+    std::vector<Instruction> code;
+};
+
+struct CallSite {
+    int32_t function;  // function name slot
+    int32_t argc;
+};
+
+struct BytecodeProgram {
+    std::vector<Value> constants;
+    std::vector<std::string> globalNames;
+    std::vector<std::string> functionNames;
+    std::vector<CallSite> callSites;  // operand a of CALL and TAIL_CALL
+    int pureFunctions = 0;            // number of memo tables the program can use
+    std::vector<CompiledFunction> functions;  // functions[0] is the script itself
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "CharScan.hpp"
+#include <cstdint>
+
+#if !defined(LFI3A_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define LFI3A_SIMD_WIDTH 32
+#elif !defined(LFI3A_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define LFI3A_SIMD_WIDTH 16
+#endif
+
+static inline bool isWhitespace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool isDigit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isIdentifierChar(unsigned char c) {
+    return isDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_';
+}
+
+#ifdef LFI3A_SIMD_WIDTH
+
+#if LFI3A_SIMD_WIDTH == 32
+typedef __m256i Vec;
+static const uint32_t FULL_MASK = 0xFFFFFFFFu;
+static inline Vec load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+static inline Vec splat(char c) { return _mm256_set1_epi8(c); }
+static inline Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline Vec any(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+static inline Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+static inline Vec minU8(Vec a, Vec b) { return _mm256_min_epu8(a, b); }
+static inline uint32_t mask(Vec a) { return static_cast<uint32_t>(_mm256_movemask_epi8(a)); }
+#else
+typedef __m128i Vec;
+static const uint32_t FULL_MASK = 0xFFFFu;
+static inline Vec load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+static inline Vec splat(char c) { return _mm_set1_epi8(c); }
+static inline Vec eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline Vec any(Vec a, Vec b) { return _mm_or_si128(a, b); }
+static inline Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+static inline Vec minU8(Vec a, Vec b) { return _mm_min_epu8(a, b); }
+static inline uint32_t mask(Vec a) { return static_cast<uint32_t>(_mm_movemask_epi8(a)); }
+#endif
+
+// Lanes whose byte lies in [lo, hi], via an unsigned x - lo <= hi - lo.
+static inline Vec inRange(Vec x, char lo, char hi) {
+    Vec shifted = sub(x, splat(lo));
+    return eq(minU8(shifted, splat(static_cast<char>(hi - lo))), shifted);
+}
+
+static inline size_t firstSet(uint32_t bits) {
+    return static_cast<size_t>(__builtin_ctz(bits));
+}
+
+static inline Vec whitespaceLanes(Vec x) {
+    return any(eq(x, splat(' ')), inRange(x, '\t', '\r'));
+}
+
+static inline Vec identifierLanes(Vec x) {
+    Vec lower = any(x, splat(0x20));
+    return any(any(inRange(lower, 'a', 'z'), inRange(x, '0', '9')), eq(x, splat('_')));
+}
+
+#endif
+
+size_t whitespaceRun(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef LFI3A_SIMD_WIDTH
+    for (; i + LFI3A_SIMD_WIDTH <= n; i += LFI3A_SIMD_WIDTH) {
+        uint32_t rest = ~mask(whitespaceLanes(load(p + i))) & FULL_MASK;
+        if (rest) return i + firstSet(rest);
+    }
+#endif
+    while (i < n && isWhitespace(static_cast<unsigned char>(p[i]))) ++i;
+    return i;
+}
+
+size_t identifierRun(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef LFI3A_SIMD_WIDTH
+    for (; i + LFI3A_SIMD_WIDTH <= n; i += LFI3A_SIMD_WIDTH) {
+        uint32_t rest = ~mask(identifierLanes(load(p + i))) & FULL_MASK;
+        if (rest) return i + firstSet(rest);
+    }
+#endif
+    while (i < n && isIdentifierChar(static_cast<unsigned char>(p[i]))) ++i;
+    return i;
+}
+
+size_t digitRun(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef LFI3A_SIMD_WIDTH
+    for (; i + LFI3A_SIMD_WIDTH <= n; i += LFI3A_SIMD_WIDTH) {
+        uint32_t rest = ~mask(inRange(load(p + i), '0', '9')) & FULL_MASK;
+        if (rest) return i + firstSet(rest);
+    }
+#endif
+    while (i < n && isDigit(static_cast<unsigned char>(p[i]))) ++i;
+    return i;
+}
+
+size_t findLineEnd(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef LFI3A_SIMD_WIDTH
+    for (; i + LFI3A_SIMD_WIDTH <= n; i += LFI3A_SIMD_WIDTH) {
+        Vec x = load(p + i);
+        uint32_t hits = mask(any(eq(x, splat('\n')), eq(x, splat('\0'))));
+        if (hits) return i + firstSet(hits);
+    }
+#endif
+    while (i < n && p[i] != '\n' && p[i] != '\0') ++i;
+    return i;
+}
+
+size_t findStringEnd(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef LFI3A_SIMD_WIDTH
+    for (; i + LFI3A_SIMD_WIDTH <= n; i += LFI3A_SIMD_WIDTH) {
+        Vec x = load(p + i);
+        uint32_t hits = mask(any(any(eq(x, splat('"')), eq(x, splat('\\'))), eq(x, splat('\0'))));
+        if (hits) return i + firstSet(hits);
+    }
+#endif
+    while (i < n && p[i] != '"' && p[i] != '\\' && p[i] != '\0') ++i;
+    return i;
+}
+
+size_t countNewlines(const char* p, size_t n) {
+    size_t i = 0;
+    size_t count = 0;
+#ifdef LFI3A_SIMD_WIDTH
+    for (; i + LFI3A_SIMD_WIDTH <= n; i += LFI3A_SIMD_WIDTH) {
+        count += static_cast<size_t>(__builtin_popcount(mask(eq(load(p + i), splat('\n')))));
+    }
+#endif
+    for (; i < n; ++i) {
+        if (p[i] == '\n') count++;
+    }
+    return count;
+}
+
+const char* charScanLevel() {
+#if defined(LFI3A_SIMD_WIDTH) && LFI3A_SIMD_WIDTH == 32
+    return "avx2";
+#elif defined(LFI3A_SIMD_WIDTH)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
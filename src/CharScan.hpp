@@ -0,0 +1,32 @@
+#ifndef LFI3A_CHARSCAN_HPP
+#define LFI3A_CHARSCAN_HPP
+
+#include <cstddef>
+
+// Byte-run scanners used by the Lexer. Each one looks at p[0..n) and
+// never reads past it. With SSE2 (always available on x86-64) or AVX2
+// (when compiled with -mavx2) they classify 16 or 32 bytes per step;
+// otherwise, or when LFI3A_NO_SIMD is defined, they are plain loops.
+
+// Length of the leading run of whitespace (' ', '\t', '\n', '\v', '\f', '\r').
+size_t whitespaceRun(const char* p, size_t n);
+
+// Length of the leading run of identifier characters ([A-Za-z0-9_]).
+size_t identifierRun(const char* p, size_t n);
+
+// Length of the leading run of decimal digits.
+size_t digitRun(const char* p, size_t n);
+
+// Index of the first '\n' or '\0', or n if there is none.
+size_t findLineEnd(const char* p, size_t n);
+
+// Index of the first '"', '\\', or '\0', or n if there is none.
+size_t findStringEnd(const char* p, size_t n);
+
+// Number of '\n' bytes in p[0..n).
+size_t countNewlines(const char* p, size_t n);
+
+// "avx2", "sse2" or "scalar": the code path the scanners were built with.
+const char* charScanLevel();
+
+#endif
@@ -0,0 +1,426 @@
+#include "Compiler.hpp"
+#include <string>
+#include <utility>
+
+BytecodeProgram Compiler::compile(const Program& src) {
+    source = &src;
+    program = BytecodeProgram();
+    for (Symbol symbol = 0; symbol < src.symbols->size(); ++symbol) {
+        program.globalNames.emplace_back(src.symbols->name(symbol));
+    }
+    program.functionNames = program.globalNames;
+    program.callSites.assign(src.callSites, CallSite{-1, 0});
+    program.pureFunctions = static_cast<int>(src.pureFunctions.size());
+    constantSlots.clear();
+    program.functions.emplace_back();
+    
+    CompiledFunction script;
+    script.name = "<script>";
+    current = &script;
+    depth = 0;
+    
+    for (ASTNodePtr node : src.statements) {
+        statement(node);
+    }
+    emit(OpCode::CONSTANT, constant(Value::number(0)));
+    emit(OpCode::RETURN);
+    
+    program.functions[0] = std::move(script);
+    current = nullptr;
+    source = nullptr;
+    return std::move(program);
+}
+
+void Compiler::compileFunction(ASTNodePtr node, int index) {
+    const FunctionInfo& info = *node->function;
+    CompiledFunction fn;
+    fn.name = std::string(node->value);
+    fn.arity = static_cast<int>(info.params.size());
+    fn.numLocals = fn.arity + static_cast<int>(info.localGlobals.size());
+    fn.memoSlot = info.memoSlot;
+    for (Symbol param : info.params) {
+        fn.localNames.emplace_back(source->symbols->name(param));
+    }
+    for (int global : info.localGlobals) {
+        fn.localNames.push_back(program.globalNames[global]);
+    }
+    
+    CompiledFunction* savedCurrent = current;
+    bool savedInFunction = inFunction;
+    int savedDepth = depth;
+    current = &fn;
+    inFunction = true;
+    depth = 0;
+    
+    // Locals that are not parameters start from the global of the same name
+    for (size_t i = 0; i < info.localGlobals.size(); ++i) {
+        emit(OpCode::INIT_LOCAL, fn.arity + static_cast<int32_t>(i), info.localGlobals[i]);
+    }
+    
+    statement(info.body);
+    emit(OpCode::CONSTANT, constant(Value::number(0)));
+    emit(OpCode::RETURN);
+    
+    current = savedCurrent;
+    inFunction = savedInFunction;
+    depth = savedDepth;
+    
+    program.functions[index] = std::move(fn);
+}
+
+void Compiler::statement(ASTNodePtr node) {
+    if (!node) return;
+    if (profile && node->type != NodeType::BLOCK && node->type != NodeType::CLEAR_CACHE) {
+        emit(OpCode::LINE, static_cast<int32_t>(node->location.line));
+    }
+    
+    switch (node->type) {
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+            if (node->inPlace) {
+                addInPlace(node, node->children[0]);
+                break;
+            }
+            expression(node->children[0]);
+            emitSet(node);
+            break;
+        
+        case NodeType::PRINT:
+            // Each argument is written before the next is evaluated, as
+            // the tree-walker does, so an error or a call that prints
+            // comes after what was written so far
+            for (size_t i = 0; i < node->children.size(); ++i) {
+                expression(node->children[i]);
+                emit(OpCode::PRINT_ARG, i + 1 < node->children.size() ? 1 : 0);
+            }
+            emit(OpCode::PRINT_END);
+            break;
+        
+        case NodeType::IF: {
+            std::vector<int> exits;
+            expression(node->children[0]);
+            int next = emitJump(OpCode::JUMP_IF_FALSE);
+            statement(node->children[1]);
+            exits.push_back(emitJump(OpCode::JUMP));
+            patchJump(next);
+            
+            for (size_t i = 2; i < node->children.size(); ++i) {
+                ASTNodePtr child = node->children[i];
+                if (child->type == NodeType::IF) {
+                    if (profile) emit(OpCode::LINE, static_cast<int32_t>(child->location.line));
+                    expression(child->children[0]);
+                    next = emitJump(OpCode::JUMP_IF_FALSE);
+                    statement(child->children[1]);
+                    exits.push_back(emitJump(OpCode::JUMP));
+                    patchJump(next);
+                } else {
+                    // This is the else block
+                    statement(child);
+                    break;
+                }
+            }
+            
+            for (int at : exits) {
+                patchJump(at);
+            }
+            break;
+        }
+        
+        case NodeType::WHILE: {
+            int start = static_cast<int>(current->code.size());
+            expression(node->children[0]);
+            int exit = emitJump(OpCode::JUMP_IF_FALSE);
+            statement(node->children[1]);
+            if (profile) emit(OpCode::LINE, static_cast<int32_t>(node->location.line));
+            emit(OpCode::JUMP, start);
+            patchJump(exit);
+            break;
+        }
+        
+        case NodeType::FOR: {
+            statement(node->children[0]); // init
+            int start = static_cast<int>(current->code.size());
+            expression(node->children[1]); // condition
+            int exit = emitJump(OpCode::JUMP_IF_FALSE);
+            statement(node->children[3]); // body
+            statement(node->children[2]); // increment
+            emit(OpCode::JUMP, start);
+            patchJump(exit);
+            break;
+        }
+        
+        case NodeType::FUNCTION_DECL: {
+            int index = static_cast<int>(program.functions.size());
+            program.functions.emplace_back();
+            compileFunction(node, index);
+            emit(OpCode::DEFINE_FUNCTION, node->slot, index);
+            break;
+        }
+        
+        case NodeType::RETURN:
+            if (inFunction && !node->children.empty() && node->children[0]->type == NodeType::CALL) {
+                ASTNodePtr call = node->children[0];
+                for (ASTNodePtr arg : call->children) {
+                    expression(arg);
+                }
+                emit(OpCode::TAIL_CALL, callSite(call), static_cast<int32_t>(call->children.size()));
+                break;
+            }
+            if (!node->children.empty()) {
+                expression(node->children[0]);
+            } else {
+                emit(OpCode::CONSTANT, constant(Value::number(0)));
+            }
+            emit(OpCode::RETURN);
+            break;
+        
+        case NodeType::BLOCK:
+            for (ASTNodePtr stmt : node->children) {
+                statement(stmt);
+            }
+            break;
+        
+        case NodeType::SET_INDEX:
+            expression(node->children[0]);
+            expression(node->children[1]);
+            if (node->op != Op::NONE) {
+                // a[i] op= v stores a[i] op v, with a and i computed once
+                emit(OpCode::DUP2);
+                emit(OpCode::GET_INDEX);
+            }
+            expression(node->children[2]);
+            switch (node->op) {
+                case Op::ADD: emit(OpCode::ADD); break;
+                case Op::SUB: emit(OpCode::SUB); break;
+                case Op::MUL: emit(OpCode::MUL); break;
+                case Op::DIV: emit(OpCode::DIV); break;
+                default: break;
+            }
+            emit(OpCode::SET_INDEX);
+            break;
+        
+        case NodeType::CLEAR_CACHE:
+            emit(OpCode::NIL);
+            emitSet(node);
+            break;
+        
+        default:
+            // Expression statement, e.g. a bare function call
+            expression(node);
+            emit(OpCode::POP);
+            break;
+    }
+}
+
+void Compiler::expression(ASTNodePtr node) {
+    if (!node) {
+        emit(OpCode::CONSTANT, constant(Value::number(0)));
+        return;
+    }
+    
+    switch (node->type) {
+        case NodeType::NUMBER:
+            emit(OpCode::CONSTANT, constant(Value::number(node->number)));
+            break;
+        
+        case NodeType::STRING:
+            emit(OpCode::CONSTANT, constant(source->strings[node->slot]));
+            break;
+        
+        case NodeType::BOOLEAN:
+            emit(node->number != 0 ? OpCode::TRUE : OpCode::FALSE);
+            break;
+        
+        case NodeType::IDENTIFIER:
+            emitGet(node);
+            break;
+        
+        case NodeType::CACHED: {
+            // Falls through to compute and store the value only while it is nil
+            int check = static_cast<int>(current->code.size());
+            emit(node->isLocal ? OpCode::GET_CACHED_LOCAL : OpCode::GET_CACHED_GLOBAL, node->slot, -1);
+            expression(node->children[0]);
+            emitSet(node);
+            emitGet(node);
+            current->code[check].b = static_cast<int32_t>(current->code.size());
+            break;
+        }
+        
+        case NodeType::BINARY_OP: {
+            expression(node->children[0]);
+            expression(node->children[1]);
+            
+            switch (node->op) {
+                case Op::ADD: emit(OpCode::ADD); break;
+                case Op::SUB: emit(OpCode::SUB); break;
+                case Op::MUL: emit(OpCode::MUL); break;
+                case Op::DIV: emit(OpCode::DIV); break;
+                case Op::EQ: emit(OpCode::EQ); break;
+                case Op::NE: emit(OpCode::NE); break;
+                case Op::LT: emit(OpCode::LT); break;
+                case Op::GT: emit(OpCode::GT); break;
+                case Op::LE: emit(OpCode::LE); break;
+                case Op::GE: emit(OpCode::GE); break;
+                case Op::AND: emit(OpCode::AND); break;
+                case Op::OR: emit(OpCode::OR); break;
+                default: break;
+            }
+            break;
+        }
+        
+        case NodeType::UNARY_OP: {
+            ASTNodePtr operand = node->children[0];
+            if (node->op == Op::NEG) {
+                expression(operand);
+                emit(OpCode::NEG);
+            } else if (node->op == Op::POST_INC && operand->type == NodeType::IDENTIFIER) {
+                emit(operand->isLocal ? OpCode::INC_LOCAL : OpCode::INC_GLOBAL, operand->slot);
+            } else {
+                expression(operand);
+                emit(OpCode::POP);
+                emit(OpCode::CONSTANT, constant(Value::number(0)));
+            }
+            break;
+        }
+        
+        case NodeType::CALL:
+            for (ASTNodePtr arg : node->children) {
+                expression(arg);
+            }
+            emit(OpCode::CALL, callSite(node), static_cast<int32_t>(node->children.size()));
+            break;
+        
+        case NodeType::ARRAY:
+            for (ASTNodePtr element : node->children) {
+                expression(element);
+            }
+            emit(OpCode::ARRAY, static_cast<int32_t>(node->children.size()));
+            break;
+        
+        case NodeType::MAP:
+            for (ASTNodePtr item : node->children) {
+                expression(item);
+            }
+            emit(OpCode::MAP, static_cast<int32_t>(node->children.size() / 2));
+            break;
+        
+        case NodeType::INDEX:
+            expression(node->children[0]);
+            expression(node->children[1]);
+            emit(OpCode::GET_INDEX);
+            break;
+        
+        case NodeType::BUILTIN:
+            for (ASTNodePtr arg : node->children) {
+                expression(arg);
+            }
+            emit(OpCode::BUILTIN, node->slot, static_cast<int32_t>(node->children.size()));
+            break;
+        
+        default:
+            emit(OpCode::CONSTANT, constant(Value::number(0)));
+            break;
+    }
+}
+
+void Compiler::emit(OpCode op, int32_t a, int32_t b) {
+    current->code.push_back({op, a, b});
+    
+    switch (op) {
+        case OpCode::CONSTANT:
+        case OpCode::TRUE:
+        case OpCode::FALSE:
+        case OpCode::NIL:
+        case OpCode::GET_GLOBAL:
+        case OpCode::GET_LOCAL:
+        case OpCode::INC_GLOBAL:
+        case OpCode::INC_LOCAL:
+            depth++;
+            break;
+        case OpCode::ARRAY:
+            depth += 1 - a;
+            break;
+        case OpCode::MAP:
+            depth += 1 - 2 * a;
+            break;
+        case OpCode::SET_INDEX:
+            depth -= 3;
+            break;
+        case OpCode::DUP2:
+            depth += 2;
+            break;
+        case OpCode::ADD_TO_GLOBAL:
+        case OpCode::ADD_TO_LOCAL:
+            depth -= 2;
+            break;
+        case OpCode::CALL:
+        case OpCode::TAIL_CALL:
+        case OpCode::BUILTIN:
+            depth += 1 - b;
+            break;
+        case OpCode::NEG:
+        case OpCode::JUMP:
+        case OpCode::GET_CACHED_GLOBAL:  // pushes only when it jumps past the computation
+        case OpCode::GET_CACHED_LOCAL:
+        case OpCode::INIT_LOCAL:
+        case OpCode::DEFINE_FUNCTION:
+        case OpCode::PRINT_END:
+        case OpCode::LINE:
+            break;
+        default:
+            depth--; // pops, stores and binary operators
+            break;
+    }
+    if (depth > current->maxStack) current->maxStack = depth;
+}
+
+int Compiler::emitJump(OpCode op) {
+    emit(op, -1);
+    return static_cast<int>(current->code.size()) - 1;
+}
+
+void Compiler::patchJump(int at) {
+    current->code[at].a = static_cast<int32_t>(current->code.size());
+}
+
+// x = x + e1 + ... + en as GET x, e1, ADD_TO x, and so on for each term.
+// ADD_TO drops the copy of x that GET pushed before adding, so a string x
+// can grow where it is.
+void Compiler::addInPlace(ASTNodePtr node, ASTNodePtr sum) {
+    if (sum->children[0]->type == NodeType::BINARY_OP) addInPlace(node, sum->children[0]);
+    emitGet(node);
+    expression(sum->children[1]);
+    emit(node->isLocal ? OpCode::ADD_TO_LOCAL : OpCode::ADD_TO_GLOBAL, node->slot);
+}
+
+void Compiler::emitGet(ASTNodePtr node) {
+    emit(node->isLocal ? OpCode::GET_LOCAL : OpCode::GET_GLOBAL, node->slot);
+}
+
+void Compiler::emitSet(ASTNodePtr node) {
+    emit(node->isLocal ? OpCode::SET_LOCAL : OpCode::SET_GLOBAL, node->slot);
+}
+
+int Compiler::callSite(ASTNodePtr call) {
+    program.callSites[call->site] = {call->slot, static_cast<int32_t>(call->children.size())};
+    return call->site;
+}
+
+int Compiler::constant(const Value& value) {
+    // Key on the exact bits of numbers so that distinct doubles never share a slot
+    std::string key;
+    if (value.isNumber()) {
+        double n = value.asNumber();
+        key.assign("n");
+        key.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    } else {
+        key = "s" + value.toString();
+    }
+    
+    auto it = constantSlots.find(key);
+    if (it != constantSlots.end()) return it->second;
+    int slot = static_cast<int>(program.constants.size());
+    program.constants.push_back(value);
+    constantSlots[key] = slot;
+    return slot;
+}
@@ -0,0 +1,43 @@
+#ifndef LFI3A_COMPILER_HPP
+#define LFI3A_COMPILER_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AST.hpp"
+#include "Bytecode.hpp"
+
+// Lowers a resolved Program into flat bytecode for the VM. Variable and
+// function slots come from Resolver.
+class Compiler {
+public:
+    BytecodeProgram compile(const Program& source);
+    
+    // Emits a LINE instruction as each statement starts, for Profiler.
+    void enableProfile() { profile = true; }
+
+private:
+    const Program* source = nullptr;
+    bool profile = false;
+    BytecodeProgram program;
+    CompiledFunction* current = nullptr;
+    bool inFunction = false;
+    std::unordered_map<std::string, int> constantSlots;
+    int depth = 0;
+
+    void compileFunction(ASTNodePtr node, int index);
+    void statement(ASTNodePtr node);
+    void expression(ASTNodePtr node);
+
+    void emit(OpCode op, int32_t a = 0, int32_t b = 0);
+    int emitJump(OpCode op);
+    void patchJump(int at);
+    void addInPlace(ASTNodePtr node, ASTNodePtr sum);
+    void emitGet(ASTNodePtr node);
+    void emitSet(ASTNodePtr node);
+
+    int constant(const Value& value);
+    int callSite(ASTNodePtr call);
+};
+
+#endif
@@ -0,0 +1,492 @@
+#include "CppEmitter.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+
+// A C++ string literal with the same bytes as `text`.
+static std::string quote(std::string_view text) {
+    std::string result = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += static_cast<char>(c);
+        } else if (c >= 0x20 && c < 0x7f && c != '?') {
+            result += static_cast<char>(c);
+        } else {
+            // Always three digits, so a following digit cannot extend it
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\%03o", c);
+            result += buf;
+        }
+    }
+    return result + "\"";
+}
+
+// An expression for the exact double `n`.
+static std::string numberLiteral(double n) {
+    char buf[64];
+    if (std::isfinite(n)) {
+        std::snprintf(buf, sizeof(buf), "Value::number(%a)", n);
+    } else {
+        uint64_t bits;
+        std::memcpy(&bits, &n, sizeof(bits));
+        std::snprintf(buf, sizeof(buf), "rt::fromBits(0x%016llxULL)", static_cast<unsigned long long>(bits));
+    }
+    return buf;
+}
+
+// The runtime function for a binary operator, or null.
+static const char* operatorFunction(Op op) {
+    switch (op) {
+        case Op::ADD: return "rt::add";
+        case Op::SUB: return "rt::sub";
+        case Op::MUL: return "rt::mul";
+        case Op::DIV: return "rt::div";
+        case Op::EQ: return "rt::eq";
+        case Op::NE: return "rt::ne";
+        case Op::LT: return "rt::lt";
+        case Op::GT: return "rt::gt";
+        case Op::LE: return "rt::le";
+        case Op::GE: return "rt::ge";
+        case Op::AND: return "rt::both";
+        case Op::OR: return "rt::either";
+        default: return nullptr;
+    }
+}
+
+// Whether evaluating `node` can assign a variable (x++ or a CACHED fill).
+// Calls cannot: only the same frame writes a variable.
+static bool writesVariables(ASTNodePtr node) {
+    if (!node) return false;
+    if (node->type == NodeType::CACHED) return true;
+    if (node->type == NodeType::UNARY_OP && node->op == Op::POST_INC) return true;
+    for (ASTNodePtr child : node->children) {
+        if (writesVariables(child)) return true;
+    }
+    return false;
+}
+
+// Temporaries named t<n> own their value and can be moved from; r<n> are
+// references to a variable and constants are expressions.
+static std::string take(const std::string& operand) {
+    return operand[0] == 't' ? "std::move(" + operand + ")" : operand;
+}
+
+static const char* flushName(Output::Flush flush) {
+    switch (flush) {
+        case Output::Flush::AT_EXIT: return "Output::Flush::AT_EXIT";
+        case Output::Flush::BYTES: return "Output::Flush::BYTES";
+        case Output::Flush::LINE: return "Output::Flush::LINE";
+        default: return "Output::Flush::AUTO";
+    }
+}
+
+void CppEmitter::emit(const Program& prog, const std::string& sourcePath, std::ostream& output) {
+    out = &output;
+    functions.clear();
+    functionIndex.clear();
+    for (ASTNodePtr node : prog.statements) {
+        collectFunctions(node);
+    }
+    size_t slots = prog.symbols->size() > 0 ? prog.symbols->size() : 1;
+
+    *out << "// Generated by lfi3a --emit-cpp from " << sourcePath << "\n"
+         << "// Build from the lfi3a source tree with:\n"
+         << "//   g++ -std=c++17 -O2 -Isrc/runtime prog.cpp src/runtime/Runtime.cpp src/Value.cpp src/Array.cpp src/Map.cpp src/Builtins.cpp src/Output.cpp -o prog -pthread\n"
+         << "#include <utility>\n"
+         << "#include \"Runtime.hpp\"\n\n";
+
+    *out << "[[maybe_unused]] static Value G[" << slots << "];\n"
+         << "[[maybe_unused]] static const rt::Function* F[" << slots << "];\n";
+    // String literals are plain data, turned into Values by main(), so a
+    // script with many of them does not need a huge static initializer
+    size_t strings = prog.strings.size() > 0 ? prog.strings.size() : 1;
+    *out << "[[maybe_unused]] static Value S[" << strings << "];\n";
+    if (!prog.strings.empty()) {
+        *out << "static const rt::StringData STRINGS[] = {\n";
+        for (const Value& value : prog.strings) {
+            std::string text = value.toString();
+            *out << "    {" << quote(text) << ", " << text.size() << "},\n";
+        }
+        *out << "};\n";
+    }
+    *out << "\n";
+
+    for (size_t i = 0; i < functions.size(); ++i) {
+        *out << "static Value " << functionName(i) << "(Value* args, int argc);\n";
+    }
+    for (size_t i = 0; i < functions.size(); ++i) {
+        *out << "static const rt::Function " << functionName(i) << "_info = {"
+             << quote(functions[i]->value) << ", " << functionName(i) << "};\n";
+    }
+    if (!functions.empty()) *out << "\n";
+
+    for (size_t i = 0; i < functions.size(); ++i) {
+        emitFunction(i);
+    }
+
+    // Top-level code goes into several functions, since compilers slow
+    // down badly on a single huge one. Each returns false after rje3.
+    inFunction = false;
+    size_t parts = 0;
+    for (size_t i = 0; i < prog.statements.size() || i == 0; i += STATEMENTS_PER_PART) {
+        *out << "static bool script" << parts++ << "() {\n";
+        temps = 0;
+        depth = 1;
+        for (size_t j = i; j < prog.statements.size() && j < i + STATEMENTS_PER_PART; ++j) {
+            statement(prog.statements[j]);
+        }
+        *out << "    return true;\n"
+             << "}\n\n";
+    }
+
+    *out << "static bool (*const script[])() = {\n";
+    for (size_t i = 0; i < parts; ++i) {
+        *out << "    script" << i << ",\n";
+    }
+    *out << "};\n\n";
+
+    *out << "int main() {\n"
+         << "    rt::start(" << flushName(flush) << ", " << flushLimit << ");\n";
+    if (!prog.strings.empty()) {
+        *out << "    rt::makeStrings(S, STRINGS, " << prog.strings.size() << ");\n";
+    }
+    *out << "    for (auto part : script) {\n"
+         << "        if (!part()) break;\n"
+         << "    }\n"
+         << "    rt::finish();\n"
+         << "    return 0;\n"
+         << "}\n";
+}
+
+void CppEmitter::collectFunctions(ASTNodePtr node) {
+    if (!node) return;
+    if (node->type == NodeType::FUNCTION_DECL) {
+        functionIndex[node] = functions.size();
+        functions.push_back(node);
+        collectFunctions(node->function->body);
+        return;
+    }
+    for (ASTNodePtr child : node->children) {
+        collectFunctions(child);
+    }
+}
+
+void CppEmitter::emitFunction(size_t index) {
+    const FunctionInfo& function = *functions[index]->function;
+    size_t arity = function.params.size();
+    size_t locals = arity + function.localGlobals.size();
+
+    if (arity > 0) {
+        *out << "static Value " << functionName(index) << "(Value* args, int argc) {\n";
+    } else {
+        *out << "static Value " << functionName(index) << "(Value*, int) {\n";
+    }
+    if (locals > 0) *out << "    Value L[" << locals << "];\n";
+    if (arity > 0) *out << "    rt::bind(L, " << arity << ", args, argc);\n";
+    for (size_t i = 0; i < function.localGlobals.size(); ++i) {
+        *out << "    L[" << arity + i << "] = G[" << function.localGlobals[i] << "];\n";
+    }
+
+    inFunction = true;
+    temps = 0;
+    depth = 1;
+    statement(function.body);
+    *out << "    return Value::number(0);\n"
+         << "}\n\n";
+}
+
+void CppEmitter::statement(ASTNodePtr node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT: {
+            if (node->inPlace) {
+                line("rt::get(" + variable(node) + ", " + quote(node->value) + ");");
+                addInPlace(node, node->children[0]);
+                break;
+            }
+            std::string value = full(node->children[0]);
+            line(variable(node) + " = " + take(value) + ";");
+            break;
+        }
+
+        case NodeType::PRINT: {
+            for (size_t i = 0; i < node->children.size(); ++i) {
+                if (i > 0) line("rt::printSpace();");
+                std::string value = full(node->children[i]);
+                line("rt::print(" + value + ");");
+            }
+            line("rt::printEnd();");
+            break;
+        }
+
+        case NodeType::IF: {
+            std::string condition = full(node->children[0]);
+            line("if (rt::truthy(" + condition + ")) {");
+            ++depth;
+            statement(node->children[1]);
+            --depth;
+            if (node->children.size() > 2) {
+                line("} else {");
+                ++depth;
+                elseChain(node, 2);
+                --depth;
+            }
+            line("}");
+            break;
+        }
+
+        case NodeType::WHILE: {
+            line("for (;;) {");
+            ++depth;
+            std::string condition = full(node->children[0]);
+            line("if (!rt::truthy(" + condition + ")) break;");
+            statement(node->children[1]);
+            --depth;
+            line("}");
+            break;
+        }
+
+        case NodeType::FOR: {
+            statement(node->children[0]);
+            line("for (;;) {");
+            ++depth;
+            std::string condition = full(node->children[1]);
+            line("if (!rt::truthy(" + condition + ")) break;");
+            statement(node->children[3]);
+            statement(node->children[2]);
+            --depth;
+            line("}");
+            break;
+        }
+
+        case NodeType::FUNCTION_DECL:
+            line("F[" + std::to_string(node->slot) + "] = &" + functionName(functionIndex[node]) + "_info;");
+            break;
+
+        case NodeType::RETURN: {
+            if (!inFunction) {
+                // Top-level rje3 ends the program once its value is computed
+                if (!node->children.empty()) full(node->children[0]);
+                line("return false;");
+            } else if (node->children.empty()) {
+                line("return Value::number(0);");
+            } else if (node->children[0]->type == NodeType::CALL) {
+                stable = !writesVariables(node->children[0]);
+                std::string args;
+                std::string target = call(node->children[0], args);
+                line("return rt::tailCall(" + target + ", " + args + ");");
+            } else {
+                std::string value = full(node->children[0]);
+                // A temporary is returned as is, so the copy is elided
+                line("return " + value + ";");
+            }
+            break;
+        }
+
+        case NodeType::BLOCK:
+            for (ASTNodePtr stmt : node->children) {
+                statement(stmt);
+            }
+            break;
+
+        case NodeType::SET_INDEX: {
+            stable = !writesVariables(node);
+            std::string array = expression(node->children[0]);
+            std::string index = expression(node->children[1]);
+            if (node->op == Op::NONE) {
+                std::string value = expression(node->children[2]);
+                line("rt::setIndex(" + array + ", " + index + ", " + take(value) + ");");
+                break;
+            }
+            // a[i] op= v, with a and i computed once
+            std::string element = temp("rt::index(" + array + ", " + index + ")");
+            std::string value = expression(node->children[2]);
+            line("rt::setIndex(" + array + ", " + index + ", " + operatorFunction(node->op) + "(" + element + ", " +
+                 value + "));");
+            break;
+        }
+
+        case NodeType::CLEAR_CACHE:
+            line(variable(node) + " = Value();");
+            break;
+
+        default: {
+            // Expression statement, e.g. a bare function call
+            std::string value = full(node);
+            if (value[0] == 'r') line("(void)" + value + ";");
+            break;
+        }
+    }
+}
+
+// x = x + e1 + ... + en, x checked already: each term goes to rt::addTo,
+// which appends to a string only x holds.
+void CppEmitter::addInPlace(ASTNodePtr node, ASTNodePtr sum) {
+    if (sum->children[0]->type == NodeType::BINARY_OP) addInPlace(node, sum->children[0]);
+    std::string right = full(sum->children[1]);
+    line("rt::addTo(" + variable(node) + ", " + right + ");");
+}
+
+void CppEmitter::elseChain(ASTNodePtr node, size_t from) {
+    // Same search as the interpreter: the first elif whose condition holds,
+    // or the else block; anything else among the children is skipped
+    for (size_t i = from; i < node->children.size(); ++i) {
+        ASTNodePtr child = node->children[i];
+        if (child->type == NodeType::IF) {
+            std::string condition = full(child->children[0]);
+            line("if (rt::truthy(" + condition + ")) {");
+            ++depth;
+            statement(child->children[1]);
+            --depth;
+            if (i + 1 < node->children.size()) {
+                line("} else {");
+                ++depth;
+                elseChain(node, i + 1);
+                --depth;
+            }
+            line("}");
+            return;
+        }
+        if (child->type == NodeType::BLOCK) {
+            statement(child);
+            return;
+        }
+    }
+}
+
+std::string CppEmitter::full(ASTNodePtr node) {
+    stable = !writesVariables(node);
+    return expression(node);
+}
+
+std::string CppEmitter::expression(ASTNodePtr node) {
+    if (!node) return "Value::number(0)";
+
+    switch (node->type) {
+        case NodeType::NUMBER:
+            return numberLiteral(node->number);
+
+        case NodeType::STRING:
+            return "S[" + std::to_string(node->slot) + "]";
+
+        case NodeType::BOOLEAN:
+            return node->number != 0 ? "Value::boolean(true)" : "Value::boolean(false)";
+
+        case NodeType::IDENTIFIER: {
+            std::string read = "rt::get(" + variable(node) + ", " + quote(node->value) + ")";
+            if (!stable) return temp(read);
+            // Nothing in this statement can change the variable before the
+            // reference is used, so it need not be copied
+            std::string name = "r" + std::to_string(temps++);
+            line("const Value& " + name + " = " + read + ";");
+            return name;
+        }
+
+        case NodeType::CACHED: {
+            // An array or a map is computed again every time, as its elements can change
+            line("if (" + variable(node) + ".isNil() || " + variable(node) + ".isContainer()) {");
+            ++depth;
+            std::string value = expression(node->children[0]);
+            line(variable(node) + " = " + take(value) + ";");
+            --depth;
+            line("}");
+            return temp(variable(node));
+        }
+
+        case NodeType::BINARY_OP: {
+            std::string left = expression(node->children[0]);
+            std::string right = expression(node->children[1]);
+            const char* function = operatorFunction(node->op);
+            if (!function) return "Value::number(0)";
+            return temp(std::string(function) + "(" + left + ", " + right + ")");
+        }
+
+        case NodeType::UNARY_OP: {
+            std::string operand = expression(node->children[0]);
+            if (node->op == Op::NEG) {
+                return temp("rt::neg(" + operand + ")");
+            }
+            if (node->op == Op::POST_INC && node->children[0]->type == NodeType::IDENTIFIER) {
+                return temp("rt::postIncrement(" + variable(node->children[0]) + ", " + operand + ")");
+            }
+            return "Value::number(0)";
+        }
+
+        case NodeType::CALL: {
+            std::string args;
+            std::string target = call(node, args);
+            return temp("rt::call(" + target + ", " + args + ")");
+        }
+
+        case NodeType::ARRAY:
+            return temp("rt::makeArray(" + arguments(node) + ")");
+
+        case NodeType::MAP:
+            return temp("rt::makeMap(" + arguments(node) + ")");
+
+        case NodeType::INDEX: {
+            std::string array = expression(node->children[0]);
+            std::string index = expression(node->children[1]);
+            return temp("rt::index(" + array + ", " + index + ")");
+        }
+
+        case NodeType::BUILTIN:
+            return temp("rt::builtin(" + std::to_string(node->slot) + ", " + arguments(node) + ")");
+
+        default:
+            return "Value::number(0)";
+    }
+}
+
+// Resolves the callee and evaluates the arguments, in that order. Returns
+// the callee; `args` gets the array and count to pass along with it.
+std::string CppEmitter::call(ASTNodePtr node, std::string& args) {
+    std::string target = "f" + std::to_string(temps++);
+    line("const rt::Function* " + target + " = rt::resolve(F[" + std::to_string(node->slot) + "], " + quote(node->value) + ");");
+    args = arguments(node);
+    return target;
+}
+
+// Evaluates the children into a fresh array; returns it and the count.
+std::string CppEmitter::arguments(ASTNodePtr node) {
+    std::vector<std::string> values;
+    for (ASTNodePtr child : node->children) {
+        values.push_back(expression(child));
+    }
+    if (values.empty()) return "nullptr, 0";
+
+    std::string array = "a" + std::to_string(temps++);
+    std::string init = "Value " + array + "[] = {";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) init += ", ";
+        init += take(values[i]);
+    }
+    line(init + "};");
+    return array + ", " + std::to_string(values.size());
+}
+
+std::string CppEmitter::variable(ASTNodePtr node) const {
+    return (node->isLocal ? "L[" : "G[") + std::to_string(node->slot) + "]";
+}
+
+std::string CppEmitter::functionName(size_t index) const {
+    std::string name = "dalla" + std::to_string(index) + "_";
+    for (char c : functions[index]->value) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') name += c;
+    }
+    return name;
+}
+
+std::string CppEmitter::temp(const std::string& init) {
+    std::string name = "t" + std::to_string(temps++);
+    line("Value " + name + " = " + init + ";");
+    return name;
+}
+
+void CppEmitter::line(const std::string& text) {
+    *out << std::string(depth * 4, ' ') << text << "\n";
+}
@@ -0,0 +1,55 @@
+#ifndef LFI3A_CPP_EMITTER_HPP
+#define LFI3A_CPP_EMITTER_HPP
+
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AST.hpp"
+#include "Output.hpp"
+
+// Translates a resolved (and usually optimized) Program into a standalone
+// C++17 program that links against src/runtime/Runtime.cpp. The generated
+// program prints what Interpreter would print and fails with the same
+// errors, so it can replace the tree-walker for a finished script.
+//
+// Each dalla becomes a C++ function with its locals in a Value array;
+// globals and the current function bindings are file-level arrays indexed
+// by slot. Expressions are lowered into one temporary per node so their
+// operands run left to right, as in the interpreter.
+class CppEmitter {
+public:
+    CppEmitter(Output::Flush flush, size_t flushLimit) : flush(flush), flushLimit(flushLimit) {}
+
+    void emit(const Program& program, const std::string& sourcePath, std::ostream& out);
+
+private:
+    static constexpr size_t STATEMENTS_PER_PART = 64;
+
+    Output::Flush flush;
+    size_t flushLimit;
+    std::ostream* out = nullptr;
+    std::vector<ASTNodePtr> functions;                // every FUNCTION_DECL, nested ones too
+    std::unordered_map<const ASTNode*, size_t> functionIndex;
+    int depth = 0;
+    int temps = 0;
+    bool inFunction = false;
+    bool stable = false;  // whether the current statement's variables keep their values while it runs
+
+    void collectFunctions(ASTNodePtr node);
+    void emitFunction(size_t index);
+    void statement(ASTNodePtr node);
+    void elseChain(ASTNodePtr node, size_t from);
+    void addInPlace(ASTNodePtr node, ASTNodePtr sum);
+    std::string expression(ASTNodePtr node);
+    std::string call(ASTNodePtr node, std::string& args);
+    std::string arguments(ASTNodePtr node);
+    std::string full(ASTNodePtr node);
+
+    std::string variable(ASTNodePtr node) const;
+    std::string functionName(size_t index) const;
+    std::string temp(const std::string& init);
+    void line(const std::string& text);
+};
+
+#endif
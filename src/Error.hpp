@@ -0,0 +1,18 @@
+#ifndef LFI3A_ERROR_HPP
+#define LFI3A_ERROR_HPP
+
+#include <stdexcept>
+#include <string>
+
+// A syntax error, or a runtime error in the tree-walker. what() is the
+// message that follows "Error: " when lfi3a reports it. Whoever runs the
+// script decides what happens next: lfi3a prints it and exits with
+// status 1, --serve sends it back to the client and carries on, and the
+// library (Lfi3a.hpp) returns it in a Result. Native functions throw it
+// to fail the script that called them.
+class ScriptError : public std::runtime_error {
+public:
+    explicit ScriptError(const std::string& message) : std::runtime_error(message) {}
+};
+
+#endif
@@ -1,52 +1,85 @@
 #include "Interpreter.hpp"
+#include "Error.hpp"
 #include <iostream>
 #include <sstream>
 #include <cmath>
 #include <algorithm>
+#include <utility>
+#include "Stack.hpp"
 
-void Interpreter::run(const std::vector<ASTNodePtr>& nodes) {
-    for (const auto& node : nodes) {
+// evaluate() and execute() recurse once per level of a script's calls, so
+// every local in them costs stack on each level. Cases that need big locals
+// run in helpers kept out of line.
+#if defined(__GNUC__) || defined(__clang__)
+#define LFI3A_NOINLINE __attribute__((noinline))
+#else
+#define LFI3A_NOINLINE
+#endif
+
+// Loop turns and calls between readings of the clock for setTimeLimit()
+static constexpr uint32_t TICKS_PER_CHECK = 1024;
+
+void Interpreter::run(const Program& prog, const std::vector<Value>& initialGlobals) {
+    stackLimit = callStackLimit();
+    deadline = std::chrono::steady_clock::now() + timeLimit;
+    ticksLeft = TICKS_PER_CHECK;
+    
+    program = &prog;
+    globals.assign(prog.symbols->size(), Value());
+    std::copy_n(initialGlobals.begin(), std::min(initialGlobals.size(), globals.size()), globals.begin());
+    functions.assign(prog.symbols->size(), nullptr);
+    callCaches.assign(prog.callSites, CallCache());
+    callWatchers.assign(prog.symbols->size(), {});
+    memos.assign(memoize ? prog.pureFunctions.size() : 0, MemoTable(memoCapacity));
+    memoKeys.clear();
+    frames.clear();
+    frameBase = 0;
+    callDepth = 0;
+    tailCall = nullptr;
+    
+    for (ASTNodePtr node : prog.statements) {
         if (hasReturned) break;
         execute(node);
     }
+    out.flush();
+    
+    for (size_t i = 0; i < memos.size(); ++i) {
+        if (memos[i].hits + memos[i].misses > 0) memos[i].report(prog.pureFunctions[i]->value, std::cerr);
+    }
 }
 
-void Interpreter::execute(const ASTNodePtr& node) {
+void Interpreter::execute(ASTNodePtr node) {
     if (!node) return;
+    if (profiler && node->type != NodeType::BLOCK && node->type != NodeType::CLEAR_CACHE) {
+        profiler->line(node->location.line);
+    }
     
     switch (node->type) {
-        case NodeType::VAR_DECL: {
-            std::string value = evaluate(node->children[0]);
-            vars[node->value] = value;
-            break;
-        }
-        
+        case NodeType::VAR_DECL:
         case NodeType::ASSIGNMENT: {
-            std::string value = evaluate(node->children[0]);
-            vars[node->value] = value;
+            if (node->inPlace) {
+                addInPlace(node, node->children[0]);
+                break;
+            }
+            Value value = evaluate(node->children[0]);
+            variable(node) = std::move(value);
             break;
         }
         
-        case NodeType::PRINT: {
-            for (size_t i = 0; i < node->children.size(); ++i) {
-                if (i > 0) std::cout << " ";
-                std::cout << evaluate(node->children[i]);
-            }
-            std::cout << std::endl;
+        case NodeType::PRINT:
+            print(node);
             break;
-        }
         
         case NodeType::IF: {
-            std::string condValue = evaluate(node->children[0]);
-            if (isTruthy(condValue)) {
+            if (isTruthy(evaluate(node->children[0]))) {
                 execute(node->children[1]);
             } else {
                 // Check for else if and else
                 for (size_t i = 2; i < node->children.size(); ++i) {
-                    auto& child = node->children[i];
+                    ASTNodePtr child = node->children[i];
                     if (child->type == NodeType::IF) {
-                        std::string elifCond = evaluate(child->children[0]);
-                        if (isTruthy(elifCond)) {
+                        if (profiler) profiler->line(child->location.line);
+                        if (isTruthy(evaluate(child->children[0]))) {
                             execute(child->children[1]);
                             return;
                         }
@@ -64,6 +97,8 @@ void Interpreter::execute(const ASTNodePtr& node) {
             while (isTruthy(evaluate(node->children[0]))) {
                 execute(node->children[1]);
                 if (hasReturned) break;
+                if (profiler) profiler->line(node->location.line);
+                tick();
             }
             break;
         }
@@ -73,219 +108,438 @@ void Interpreter::execute(const ASTNodePtr& node) {
             while (isTruthy(evaluate(node->children[1]))) { // condition
                 execute(node->children[3]); // body
                 if (hasReturned) break;
-                evaluate(node->children[2]); // increment (evaluate, not execute)
+                execute(node->children[2]); // increment
+                tick();
             }
             break;
         }
         
         case NodeType::FUNCTION_DECL: {
-            functions[node->value] = node;
+            if (functions[node->slot] != node) {
+                // Sites that cached the previous definition resolve again
+                for (int32_t site : callWatchers[node->slot]) {
+                    callCaches[site].target = nullptr;
+                }
+                callWatchers[node->slot].clear();
+                functions[node->slot] = node;
+            }
             break;
         }
         
         case NodeType::RETURN: {
+            if (callDepth > 0 && !node->children.empty() && node->children[0]->type == NodeType::CALL) {
+                // Tail call: the enclosing CALL runs it, so the C++ stack stays flat
+                prepareTailCall(node->children[0]);
+                hasReturned = true;
+                break;
+            }
             if (!node->children.empty()) {
                 returnValue = evaluate(node->children[0]);
             } else {
-                returnValue = "0";
+                returnValue = Value::number(0);
             }
             hasReturned = true;
             break;
         }
         
         case NodeType::BLOCK: {
-            for (const auto& stmt : node->children) {
+            for (ASTNodePtr stmt : node->children) {
                 execute(stmt);
                 if (hasReturned) break;
             }
             break;
         }
         
+        case NodeType::SET_INDEX:
+            setIndex(node);
+            break;
+        
+        case NodeType::CLEAR_CACHE:
+            variable(node) = Value();
+            break;
+        
         default:
+            // Expression statement, e.g. a bare function call
+            evaluate(node);
             break;
     }
 }
 
-std::string Interpreter::evaluate(const ASTNodePtr& node) {
-    if (!node) return "0";
+Value Interpreter::evaluate(ASTNodePtr node) {
+    if (!node) return Value::number(0);
     
     switch (node->type) {
         case NodeType::NUMBER:
-            return node->value;
+            return Value::number(node->number);
         
         case NodeType::STRING:
-            return node->value;
+            return program->strings[node->slot];
         
         case NodeType::BOOLEAN:
-            return node->value; // "s7i7" or "ghalat"
+            return Value::boolean(node->number != 0);
         
         case NodeType::IDENTIFIER: {
-            auto it = vars.find(node->value);
-            if (it != vars.end()) {
-                return it->second;
+            const Value& value = variable(node);
+            if (!value.isNil()) {
+                return value;
             }
-            std::cerr << "Error: Undefined variable '" << node->value << "'\n";
-            exit(1);
+            runtimeError("Undefined variable '" + std::string(node->value) + "'");
         }
         
+        case NodeType::CACHED: {
+            // Expressions never produce nil, so nil means not computed yet.
+            // An array or a map is never kept: its elements can change.
+            if (variable(node).isNil()) {
+                Value value = evaluate(node->children[0]);
+                if (value.isContainer()) return value;
+                variable(node) = std::move(value);
+            }
+            return variable(node);
+        }
+        
+        case NodeType::ARRAY:
+            return arrayLiteral(node);
+        
+        case NodeType::MAP:
+            return mapLiteral(node);
+        
+        case NodeType::INDEX:
+            return getIndex(node);
+        
+        case NodeType::BUILTIN:
+        case NodeType::NATIVE:
+            return callLibrary(node);
+        
         case NodeType::BINARY_OP: {
-            std::string left = evaluate(node->children[0]);
-            std::string right = evaluate(node->children[1]);
-            std::string op = node->op;
+            Value left = evaluate(node->children[0]);
+            Value right = evaluate(node->children[1]);
             
-            if (op == "+") {
-                // Try numeric addition first, if that fails, do string concat
-                try {
-                    double l = std::stod(left);
-                    double r = std::stod(right);
-                    double result = l + r;
-                    if (result == (int)result) {
-                        return std::to_string((int)result);
-                    }
-                    return std::to_string(result);
-                } catch (...) {
-                    // String concatenation
-                    return left + right;
-                }
-            } else if (op == "-") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                double result = l - r;
-                if (result == (int)result) {
-                    return std::to_string((int)result);
-                }
-                return std::to_string(result);
-            } else if (op == "*") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                double result = l * r;
-                if (result == (int)result) {
-                    return std::to_string((int)result);
-                }
-                return std::to_string(result);
-            } else if (op == "/") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                if (r == 0) {
-                    std::cerr << "Error: Division by zero\n";
-                    exit(1);
-                }
-                double result = l / r;
-                if (result == (int)result) {
-                    return std::to_string((int)result);
-                }
-                return std::to_string(result);
-            } else if (op == "==") {
-                return (left == right) ? "s7i7" : "ghalat";
-            } else if (op == "!=") {
-                return (left != right) ? "s7i7" : "ghalat";
-            } else if (op == "<") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                return (l < r) ? "s7i7" : "ghalat";
-            } else if (op == ">") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                return (l > r) ? "s7i7" : "ghalat";
-            } else if (op == "<=") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                return (l <= r) ? "s7i7" : "ghalat";
-            } else if (op == ">=") {
-                double l = std::stod(left);
-                double r = std::stod(right);
-                return (l >= r) ? "s7i7" : "ghalat";
-            } else if (op == "w") {
-                return (isTruthy(left) && isTruthy(right)) ? "s7i7" : "ghalat";
-            } else if (op == "wla") {
-                return (isTruthy(left) || isTruthy(right)) ? "s7i7" : "ghalat";
+            switch (node->op) {
+                case Op::ADD:
+                case Op::SUB:
+                case Op::MUL:
+                case Op::DIV:
+                    return arithmetic(node->op, std::move(left), right);
+                case Op::EQ:
+                    return Value::boolean(left.equals(right));
+                case Op::NE:
+                    return Value::boolean(!left.equals(right));
+                case Op::LT:
+                    return Value::boolean(toNumber(left) < toNumber(right));
+                case Op::GT:
+                    return Value::boolean(toNumber(left) > toNumber(right));
+                case Op::LE:
+                    return Value::boolean(toNumber(left) <= toNumber(right));
+                case Op::GE:
+                    return Value::boolean(toNumber(left) >= toNumber(right));
+                case Op::AND:
+                    return Value::boolean(isTruthy(left) && isTruthy(right));
+                case Op::OR:
+                    return Value::boolean(isTruthy(left) || isTruthy(right));
+                default:
+                    break;
             }
             break;
         }
         
         case NodeType::UNARY_OP: {
-            std::string operand = evaluate(node->children[0]);
-            std::string op = node->op;
+            Value operand = evaluate(node->children[0]);
             
-            if (op == "-") {
-                double val = std::stod(operand);
-                double result = -val;
-                if (result == (int)result) {
-                    return std::to_string((int)result);
+            if (node->op == Op::NEG) {
+                if (operand.isArray()) {
+                    Value result;
+                    check(negate(operand, result));
+                    return result;
                 }
-                return std::to_string(result);
-            } else if (op == "post++") {
-                // For now, just increment
+                return Value::number(-toNumber(operand));
+            } else if (node->op == Op::POST_INC) {
                 if (node->children[0]->type == NodeType::IDENTIFIER) {
-                    double val = std::stod(operand);
-                    vars[node->children[0]->value] = std::to_string((int)(val + 1));
-                    if (val == (int)val) {
-                        return std::to_string((int)val);
-                    }
-                    return std::to_string(val);
+                    double val = toNumber(operand);
+                    variable(node->children[0]) = Value::number(val + 1);
+                    return Value::number(val);
                 }
             }
             break;
         }
         
         case NodeType::CALL: {
-            auto it = functions.find(node->value);
-            if (it != functions.end()) {
-                // Function exists
-                auto funcNode = it->second;
-                
-                // Save current variables
-                auto savedVars = vars;
-                bool savedHasReturned = hasReturned;
-                std::string savedReturnValue = returnValue;
-                
-                hasReturned = false;
-                returnValue = "0";
-                
-                // Bind parameters
-                for (size_t i = 0; i < funcNode->params.size() && i < node->children.size(); ++i) {
-                    vars[funcNode->params[i]] = evaluate(node->children[i]);
-                }
-                
-                // Execute function body
-                execute(funcNode->body);
-                
-                std::string result = returnValue;
-                
-                // Restore variables
-                vars = savedVars;
-                hasReturned = savedHasReturned;
-                returnValue = savedReturnValue;
-                
-                return result;
-            } else {
-                std::cerr << "Error: Undefined function '" << node->value << "'\n";
-                exit(1);
-            }
+            CallCache cache = resolveCall(node);
+            size_t newBase = frames.size();
+            bindArguments(node, cache);
+            return invoke(cache.target, newBase);
         }
         
         default:
             break;
     }
     
-    return "0";
+    return Value::number(0);
 }
 
-bool Interpreter::isTruthy(const std::string& value) {
-    if (value == "ghalat" || value == "0" || value == "" || value == "0.0") {
-        return false;
+// Runs target's body on the frame bound at newBase, then pops the frame.
+// A function Purity marked pure goes through its memo table here rather
+// than in a wrapper, so memoized recursion takes no more stack per call.
+LFI3A_NOINLINE Value Interpreter::invoke(const ASTNode* target, size_t newBase) {
+    int memoSlot = memoize ? target->function->memoSlot : -1;
+    if (memoSlot >= 0) {
+        if (const Value* cached = memoFind(target, newBase)) {
+            frames.resize(newBase);
+            return *cached;
+        }
     }
-    return true;
+    char here;
+    if (reinterpret_cast<uintptr_t>(&here) < stackLimit) runtimeError("Too much recursion");
+    tick();
+    size_t savedFrameBase = frameBase;
+    bool savedHasReturned = hasReturned;
+    Value savedReturnValue = std::move(returnValue);
+    
+    frameBase = newBase;
+    hasReturned = false;
+    returnValue = Value::number(0);
+    callDepth++;
+    
+    // Execute function body, then any tail calls it made
+    if (profiler) profiler->enter(target->slot);
+    execute(target->function->body);
+    while (tailCall) {
+        tick();
+        target = tailCall;
+        tailCall = nullptr;
+        hasReturned = false;
+        returnValue = Value::number(0);
+        if (profiler) {
+            profiler->leave();
+            profiler->enter(target->slot);
+        }
+        execute(target->function->body);
+    }
+    if (profiler) profiler->leave();
+    
+    callDepth--;
+    Value result = std::move(returnValue);
+    
+    // Pop the frame
+    frames.resize(newBase);
+    frameBase = savedFrameBase;
+    hasReturned = savedHasReturned;
+    returnValue = std::move(savedReturnValue);
+    
+    if (memoSlot >= 0) memoStore(memoSlot, result);
+    return result;
+}
+
+// The cached result of the pure call bound at newBase, or null after
+// keeping its arguments for memoStore().
+LFI3A_NOINLINE const Value* Interpreter::memoFind(const ASTNode* target, size_t newBase) {
+    MemoTable::Key key(frames.begin() + newBase, frames.end() - target->function->localGlobals.size());
+    if (const Value* cached = memos[target->function->memoSlot].find(key)) return cached;
+    memoKeys.push_back(std::move(key));
+    return nullptr;
+}
+
+LFI3A_NOINLINE void Interpreter::memoStore(int memoSlot, const Value& result) {
+    memos[memoSlot].insert(std::move(memoKeys.back()), result);
+    memoKeys.pop_back();
+}
+
+
+Interpreter::CallCache Interpreter::resolveCall(ASTNodePtr call) {
+    CallCache& cache = callCaches[call->site];
+    if (!cache.target) {
+        ASTNodePtr target = functions[call->slot];
+        if (!target) {
+            runtimeError("Undefined function '" + std::string(call->value) + "'");
+        }
+        cache.target = target;
+        cache.bound = std::min<uint32_t>(call->children.size(), target->function->params.size());
+        callWatchers[call->slot].push_back(call->site);
+    }
+    return cache;
+}
+
+void Interpreter::bindArguments(ASTNodePtr call, const CallCache& cache) {
+    // Evaluate arguments straight into the new frame's slots. Nested calls
+    // pop their own frames, so the frame stack is back at base + i after
+    // each argument.
+    const FunctionInfo& function = *cache.target->function;
+    size_t base = frames.size();
+    for (uint32_t i = 0; i < cache.bound; ++i) {
+        frames.push_back(evaluate(call->children[i]));
+    }
+    for (uint32_t i = cache.bound; i < call->children.size(); ++i) {
+        evaluate(call->children[i]);  // extra arguments still run
+    }
+    if (cache.bound < function.params.size()) {
+        frames.resize(base + function.params.size());
+    }
+    for (int global : function.localGlobals) {
+        frames.push_back(globals[global]);
+    }
+}
+
+LFI3A_NOINLINE void Interpreter::prepareTailCall(ASTNodePtr call) {
+    // Bind the callee's arguments above the current frame, then move them
+    // down over it
+    CallCache cache = resolveCall(call);
+    size_t top = frames.size();
+    bindArguments(call, cache);
+    std::move(frames.begin() + top, frames.end(), frames.begin() + frameBase);
+    frames.resize(frameBase + (frames.size() - top));
+    tailCall = cache.target;
+}
+
+LFI3A_NOINLINE void Interpreter::print(ASTNodePtr node) {
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (i > 0) out.write(' ');
+        out.write(evaluate(node->children[i]));
+    }
+    out.endLine();
+}
+
+LFI3A_NOINLINE Value Interpreter::arrayLiteral(ASTNodePtr node) {
+    std::vector<Value> elements;
+    elements.reserve(node->children.size());
+    for (ASTNodePtr child : node->children) {
+        elements.push_back(evaluate(child));
+    }
+    return Value::array(std::make_shared<Array>(std::move(elements)));
+}
+
+LFI3A_NOINLINE Value Interpreter::mapLiteral(ASTNodePtr node) {
+    auto map = std::make_shared<Map>();
+    for (size_t i = 0; i < node->children.size(); i += 2) {
+        Value key = evaluate(node->children[i]);
+        if (!Map::isKey(key)) runtimeError(invalidKey(key));
+        map->set(key, evaluate(node->children[i + 1]));
+    }
+    return Value::map(std::move(map));
+}
+
+LFI3A_NOINLINE Value Interpreter::getIndex(ASTNodePtr node) {
+    Value array = evaluate(node->children[0]);
+    Value index = evaluate(node->children[1]);
+    Value element;
+    if (!getElement(array, index, element)) runtimeError(indexError(array, index));
+    return element;
+}
+
+// a[i] = e, or a[i] op= e
+LFI3A_NOINLINE void Interpreter::setIndex(ASTNodePtr node) {
+    Value array = evaluate(node->children[0]);
+    Value index = evaluate(node->children[1]);
+    Value element;
+    if (node->op != Op::NONE && !getElement(array, index, element)) runtimeError(indexError(array, index));
+    Value value = evaluate(node->children[2]);
+    if (node->op != Op::NONE) value = arithmetic(node->op, std::move(element), value);
+    if (!setElement(array, index, std::move(value))) runtimeError(indexError(array, index));
+}
+
+// A BUILTIN or NATIVE node
+LFI3A_NOINLINE Value Interpreter::callLibrary(ASTNodePtr node) {
+    std::vector<Value> args;
+    args.reserve(node->children.size());
+    for (ASTNodePtr child : node->children) {
+        args.push_back(evaluate(child));
+    }
+    if (node->type == NodeType::NATIVE) return (*natives)[node->slot](args.data(), args.size());
+    Value result;
+    check(callBuiltin(static_cast<Builtin>(node->slot), args.data(), args.size(), result));
+    return result;
+}
+
+// +, -, * and / on values, as in x + y. Adding to a string no other value
+// holds appends to it in place, so a chain like a + b + c + d, or x = x + e
+// repeated, copies each piece once.
+Value Interpreter::arithmetic(Op op, Value left, const Value& right) {
+    switch (op) {
+        case Op::ADD: {
+            // Numeric addition if both sides are numbers, otherwise string concat
+            double l, r;
+            if (left.tryNumber(l) && right.tryNumber(r)) {
+                return Value::number(l + r);
+            }
+            if (isElementwise(left, right)) return arrayArithmetic(ArrayOp::ADD, left, right);
+            if (left.isUnsharedString()) {
+                left.append(right);
+                return left;
+            }
+            return Value::string(toString(left) + toString(right));
+        }
+        case Op::SUB:
+            if (left.isArray() || right.isArray()) return arrayArithmetic(ArrayOp::SUB, left, right);
+            return Value::number(toNumber(left) - toNumber(right));
+        case Op::MUL:
+            if (left.isArray() || right.isArray()) return arrayArithmetic(ArrayOp::MUL, left, right);
+            return Value::number(toNumber(left) * toNumber(right));
+        default: {
+            if (left.isArray() || right.isArray()) return arrayArithmetic(ArrayOp::DIV, left, right);
+            double l = toNumber(left);
+            double r = toNumber(right);
+            if (r == 0) {
+                runtimeError("Division by zero");
+            }
+            return Value::number(l / r);
+        }
+    }
+}
+
+// An ASSIGNMENT marked inPlace: x = x + e1 + ... + en. x must be defined
+// before e1 runs, as for the plain form, but is only read after each
+// term, when the variable holds the one reference to a string x.
+void Interpreter::addInPlace(ASTNodePtr node, ASTNodePtr sum) {
+    ASTNodePtr left = sum->children[0];
+    if (left->type == NodeType::BINARY_OP) {
+        addInPlace(node, left);
+    } else if (variable(node).isNil()) {
+        runtimeError("Undefined variable '" + std::string(node->value) + "'");
+    }
+    Value right = evaluate(sum->children[1]);
+    // Looked up again: a call in the term may have moved the frames
+    Value& target = variable(node);
+    target = arithmetic(Op::ADD, std::exchange(target, Value()), right);
+}
+
+Value& Interpreter::variable(ASTNodePtr node) {
+    return node->isLocal ? frames[frameBase + node->slot] : globals[node->slot];
+}
+
+bool Interpreter::isTruthy(const Value& value) {
+    return value.isTruthy();
+}
+
+double Interpreter::toNumber(const Value& value) {
+    double n;
+    if (value.tryNumber(n)) return n;
+    runtimeError("Expected a number but got '" + value.toString() + "'");
+}
+
+Value Interpreter::arrayArithmetic(ArrayOp op, const Value& left, const Value& right) {
+    Value result;
+    check(elementwise(op, left, right, result));
+    return result;
+}
+
+void Interpreter::check(const std::string& error) {
+    if (!error.empty()) runtimeError(error);
+}
+
+std::string Interpreter::toString(const Value& value) {
+    return value.toString();
 }
 
-std::string Interpreter::toNumber(const std::string& value) {
-    try {
-        return std::to_string(std::stod(value));
-    } catch (...) {
-        return "0";
+LFI3A_NOINLINE void Interpreter::checkDeadline() {
+    ticksLeft = TICKS_PER_CHECK;
+    if (std::chrono::steady_clock::now() >= deadline) {
+        std::chrono::duration<double> limit = timeLimit;
+        std::ostringstream message;
+        message << "Script ran for longer than " << limit.count() << " s";
+        runtimeError(message.str());
     }
 }
 
-std::string Interpreter::toString(const std::string& value) {
-    return value;
+void Interpreter::runtimeError(const std::string& message) {
+    // Flush first so the error lands after everything already printed
+    out.flush();
+    throw ScriptError(message);
 }
@@ -1,26 +1,103 @@
 #ifndef LFI3A_INTERPRETER_HPP
 #define LFI3A_INTERPRETER_HPP
 
-#include <unordered_map>
-#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <utility>
 #include <vector>
 #include "AST.hpp"
+#include "Builtins.hpp"
+#include "Memo.hpp"
+#include "Output.hpp"
+#include "Profiler.hpp"
+#include "Value.hpp"
 
 class Interpreter {
 public:
-    void run(const std::vector<ASTNodePtr>& nodes);
+    explicit Interpreter(Output::Flush flush = Output::Flush::AUTO, size_t flushLimit = Output::DEFAULT_LIMIT,
+                         Output::Sink sink = nullptr)
+        : out(flush, flushLimit, std::move(sink)) {}
+    // Globals start out nil, or as the value at their Symbol in
+    // initialGlobals.
+    void run(const Program& program, const std::vector<Value>& initialGlobals = {});
+    
+    // The functions NATIVE nodes call, by index. They must outlive run().
+    void setNatives(const std::vector<NativeFunction>& natives) { this->natives = &natives; }
+    
+    // By Symbol, as the last run() left them.
+    const std::vector<Value>& globalValues() const { return globals; }
+    
+    // Caches results of the functions Purity marked pure, up to capacity
+    // entries each, and reports hits and misses on stderr after run().
+    void enableMemo(size_t capacity) { memoCapacity = capacity; memoize = true; }
+    
+    // Reports statements and calls to profiler as they run.
+    void enableProfile(Profiler& profiler) { this->profiler = &profiler; }
+    
+    // Stops run() with a runtime error once it has run for longer than
+    // limit, checked as loops go round and functions are called.
+    void setTimeLimit(std::chrono::milliseconds limit) { timeLimit = limit; }
+    
     
 private:
-    std::unordered_map<std::string, std::string> vars;
-    std::unordered_map<std::string, ASTNodePtr> functions;
-    std::string returnValue;
+    Output out;
+    bool memoize = false;
+    size_t memoCapacity = MemoTable::DEFAULT_CAPACITY;
+    std::vector<MemoTable> memos;  // indexed by FunctionInfo::memoSlot
+    std::vector<MemoTable::Key> memoKeys;  // arguments of the pure calls in progress
+    Profiler* profiler = nullptr;
+    const std::vector<NativeFunction>* natives = nullptr;
+    const Program* program = nullptr;
+    std::vector<Value> globals;
+    std::vector<ASTNodePtr> functions;  // indexed by function slot
+    std::vector<Value> frames;          // local slots of all active calls
+    size_t frameBase = 0;               // first slot of the current call
+    Value returnValue;
     bool hasReturned = false;
+    int callDepth = 0;
+    uintptr_t stackLimit = 0;  // lowest stack address a call may start at (Stack.hpp)
+    std::chrono::milliseconds timeLimit{0};  // 0: none
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t ticksLeft = 0;  // loop turns and calls until the clock is read again
+    const ASTNode* tailCall = nullptr;  // set by rje3 f(...), run by the enclosing CALL
+    
+    // What a call site last resolved to. Kept per Interpreter rather than in
+    // the shared AST, and reset only when a dalla redefines the function.
+    struct CallCache {
+        ASTNodePtr target = nullptr;
+        uint32_t bound = 0;  // arguments that become parameters; the rest are dropped
+    };
+    std::vector<CallCache> callCaches;               // indexed by ASTNode::site
+    std::vector<std::vector<int32_t>> callWatchers;  // function slot -> sites caching it
     
-    std::string evaluate(const ASTNodePtr& node);
-    void execute(const ASTNodePtr& node);
-    bool isTruthy(const std::string& value);
-    std::string toNumber(const std::string& value);
-    std::string toString(const std::string& value);
+    CallCache resolveCall(ASTNodePtr call);
+    void bindArguments(ASTNodePtr call, const CallCache& cache);
+    void prepareTailCall(ASTNodePtr call);
+    void tick() {
+        if (timeLimit.count() > 0 && --ticksLeft == 0) checkDeadline();
+    }
+    void checkDeadline();
+    Value& variable(ASTNodePtr node);
+    Value evaluate(ASTNodePtr node);
+    Value invoke(const ASTNode* target, size_t newBase);
+    const Value* memoFind(const ASTNode* target, size_t newBase);
+    void memoStore(int memoSlot, const Value& result);
+    void execute(ASTNodePtr node);
+    // Cases of execute() and evaluate(), kept out of line
+    void print(ASTNodePtr node);
+    void setIndex(ASTNodePtr node);
+    Value arrayLiteral(ASTNodePtr node);
+    Value mapLiteral(ASTNodePtr node);
+    Value getIndex(ASTNodePtr node);
+    Value callLibrary(ASTNodePtr node);
+    bool isTruthy(const Value& value);
+    double toNumber(const Value& value);
+    std::string toString(const Value& value);
+    Value arithmetic(Op op, Value left, const Value& right);
+    void addInPlace(ASTNodePtr node, ASTNodePtr sum);
+    Value arrayArithmetic(ArrayOp op, const Value& left, const Value& right);
+    void check(const std::string& error);  // reports a non-empty error from Array.hpp
+    [[noreturn]] void runtimeError(const std::string& message);
 };
 
 #endif
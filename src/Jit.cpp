@@ -0,0 +1,839 @@
+#include "Jit.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define LFI3A_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static uint64_t bitsOf(double n) {
+    uint64_t bits;
+    std::memcpy(&bits, &n, sizeof(bits));
+    return bits;
+}
+
+static double nilSlot() {
+    double n;
+    std::memcpy(&n, &Jit::NIL_BITS, sizeof(n));
+    return n;
+}
+
+bool toJitSlot(const Value& value, JitType type, double& slot) {
+    switch (type) {
+        case JitType::NIL:
+            if (!value.isNil()) return false;
+            slot = nilSlot();
+            return true;
+        case JitType::BOOLEAN:
+            if (!value.isBoolean()) return false;
+            slot = value.asBoolean() ? 1 : 0;
+            return true;
+        case JitType::MAYBE_NIL:
+            if (value.isNil()) {
+                slot = nilSlot();
+                return true;
+            }
+            // fall through
+        case JitType::NUMBER:
+            if (!value.isNumber() || bitsOf(value.asNumber()) == Jit::NIL_BITS) return false;
+            slot = value.asNumber();
+            return true;
+        case JitType::STRING:
+            break;
+    }
+    return false;
+}
+
+Value fromJitSlot(double slot, JitType type, const BytecodeProgram& program) {
+    switch (type) {
+        case JitType::NUMBER:
+            return Value::number(slot);
+        case JitType::BOOLEAN:
+            return Value::boolean(slot != 0);
+        case JitType::MAYBE_NIL:
+            return bitsOf(slot) == Jit::NIL_BITS ? Value() : Value::number(slot);
+        case JitType::STRING:
+            return program.constants[static_cast<size_t>(slot)];
+        case JitType::NIL:
+            break;
+    }
+    return Value();
+}
+
+#ifdef LFI3A_JIT
+
+namespace {
+
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13 };
+enum Xmm : uint8_t { XMM0, XMM1, XMM2 };
+enum Cond : uint8_t { CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_P = 0xA, CC_NP = 0xB };
+
+// Just the x86-64 instructions Translator needs. Memory operands are always
+// [rbx + disp32], the current frame.
+class Assembler {
+public:
+    std::vector<uint8_t> bytes;
+
+    int newLabel() {
+        labels.push_back(-1);
+        return static_cast<int>(labels.size()) - 1;
+    }
+    void bind(int label) { labels[label] = static_cast<int64_t>(bytes.size()); }
+    int64_t offset(int label) const { return labels[label]; }
+
+    void push(Reg r) { if (r >= R8) byte(0x41); byte(0x50 + (r & 7)); }
+    void pop(Reg r) { if (r >= R8) byte(0x41); byte(0x58 + (r & 7)); }
+    void ret() { byte(0xC3); }
+
+    void mov(Reg dst, Reg src) { rex(src, dst); byte(0x89); modrm(3, src, dst); }
+    void movImm(Reg dst, uint64_t imm) { rex(0, dst); byte(0xB8 + (dst & 7)); u64(imm); }
+    void movImm32(Reg dst, uint32_t imm) { byte(0xB8 + dst); u32(imm); }  // zero-extends; dst below r8
+    void load(Reg dst, int32_t disp) { rex(dst, RBX); byte(0x8B); mem(dst, disp); }
+    void store(int32_t disp, Reg src) { rex(src, RBX); byte(0x89); mem(src, disp); }
+    void lea(Reg dst, int32_t disp) { rex(dst, RBX); byte(0x8D); mem(dst, disp); }
+    void cmpMem(Reg r, int32_t disp) { rex(r, RBX); byte(0x3B); mem(r, disp); }
+    void testEax() { byte(0x85); modrm(3, RAX, RAX); }
+    void testRax() { rex(RAX, RAX); byte(0x85); modrm(3, RAX, RAX); }
+    void cmpEax(int8_t imm) { byte(0x83); modrm(3, 7, RAX); byte(static_cast<uint8_t>(imm)); }
+    void flipSign(Reg r) { rex(0, r); byte(0x0F); byte(0xBA); modrm(3, 7, r); byte(63); }  // btc r, 63
+
+    void loadsd(Xmm dst, int32_t disp) { byte(0xF2); byte(0x0F); byte(0x10); mem(dst, disp); }
+    void storesd(int32_t disp, Xmm src) { byte(0xF2); byte(0x0F); byte(0x11); mem(src, disp); }
+    void addsd(Xmm dst, Xmm src) { sse(0xF2, 0x58, dst, src); }
+    void subsd(Xmm dst, Xmm src) { sse(0xF2, 0x5C, dst, src); }
+    void mulsd(Xmm dst, Xmm src) { sse(0xF2, 0x59, dst, src); }
+    void divsd(Xmm dst, Xmm src) { sse(0xF2, 0x5E, dst, src); }
+    void ucomisd(Xmm a, Xmm b) { sse(0x66, 0x2E, a, b); }
+    void zero(Xmm x) { sse(0x66, 0x57, x, x); }  // xorpd
+    void movq(Xmm dst, Reg src) { byte(0x66); rex(dst, src); byte(0x0F); byte(0x6E); modrm(3, dst, src); }
+    void cvtsi2sd(Xmm dst, Reg src) { byte(0xF2); byte(0x0F); byte(0x2A); modrm(3, dst, src); }  // from a 32-bit register
+
+    // Byte registers al, cl and dl only
+    void setcc(Cond c, Reg r) { byte(0x0F); byte(0x90 + c); modrm(3, 0, r); }
+    void andByte(Reg dst, Reg src) { byte(0x20); modrm(3, src, dst); }
+    void orByte(Reg dst, Reg src) { byte(0x08); modrm(3, src, dst); }
+    void movzxByte(Reg dst, Reg src) { byte(0x0F); byte(0xB6); modrm(3, dst, src); }
+
+    void jmp(int label) { byte(0xE9); fixup(label); }
+    void jcc(Cond c, int label) { byte(0x0F); byte(0x80 + c); fixup(label); }
+    void jmp(Reg r) { byte(0xFF); modrm(3, 4, r); }
+    void call(const void* target) {
+        movImm(RAX, reinterpret_cast<uint64_t>(target));
+        byte(0xFF);
+        modrm(3, 2, RAX);
+    }
+
+    // Patches every jump now that all labels are bound.
+    void link() {
+        for (const auto& [at, label] : fixups) {
+            int32_t rel = static_cast<int32_t>(labels[label] - static_cast<int64_t>(at + 4));
+            std::memcpy(&bytes[at], &rel, sizeof(rel));
+        }
+    }
+
+private:
+    std::vector<int64_t> labels;
+    std::vector<std::pair<size_t, int>> fixups;
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+    void u32(uint32_t v) { for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+    void rex(uint8_t reg, uint8_t rm) { byte(0x48 | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0)); }
+    void modrm(uint8_t mod, uint8_t reg, uint8_t rm) { byte(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7))); }
+    void mem(uint8_t reg, int32_t disp) { modrm(2, reg, RBX); u32(static_cast<uint32_t>(disp)); }
+    void sse(uint8_t prefix, uint8_t op, Xmm dst, Xmm src) { byte(prefix); byte(0x0F); byte(op); modrm(3, dst, src); }
+    void fixup(int label) {
+        fixups.emplace_back(bytes.size(), label);
+        u32(0);
+    }
+};
+
+using State = std::vector<JitType>;
+
+// Infers the type of every slot at every instruction, then emits code for
+// the reachable ones. Both passes run through step(), so they cannot
+// disagree about what an instruction does. Registers while generated code
+// runs: rbx = frame, r12 = context, r13 = NIL_BITS.
+class Translator {
+public:
+    Translator(const BytecodeProgram& program, const JitHooks& hooks, JitCode& code)
+        : program(program), fn(program.functions[code.function]), hooks(hooks), code(code) {}
+
+    bool analyze();
+    void emit(Assembler& assembler);
+    // Where the code for instruction pc starts, or -1 if it is unreachable
+    int64_t offset(size_t pc) const { return reached[pc] ? as->offset(pcLabels[pc]) : -1; }
+
+private:
+    const BytecodeProgram& program;
+    const CompiledFunction& fn;
+    const JitHooks& hooks;
+    JitCode& code;
+    std::vector<bool> reached;
+    std::vector<int> worklist;
+    bool failed = false;
+
+    Assembler* as = nullptr;  // null while analyzing
+    std::vector<int> pcLabels;
+    std::vector<int> exitLabels;
+    std::vector<int> guards;  // per pc, label of the exit that retries the instruction on the VM
+    int epilogue = -1;
+
+    void step(int pc);
+    void flow(int target, const State& state);
+    int exitTo(int pc, const State& slots);
+    int guard(int pc);
+    void leave(int pc);
+    void callHook(const void* hook) { as->mov(RDI, R12); as->call(hook); }
+    void setBoolean(int32_t disp);
+
+    static int32_t slot(size_t index) { return static_cast<int32_t>(index * sizeof(double)); }
+};
+
+static bool join(JitType& into, JitType other) {
+    if (into == other) return true;
+    if (into == JitType::BOOLEAN || other == JitType::BOOLEAN || into == JitType::STRING || other == JitType::STRING) {
+        return false;
+    }
+    into = JitType::MAYBE_NIL;  // any mix of NIL, NUMBER and MAYBE_NIL
+    return true;
+}
+
+bool Translator::analyze() {
+    size_t count = fn.code.size();
+    reached.assign(count, false);
+    code.states.assign(count, State());
+
+    State entry(fn.numLocals, JitType::NIL);
+    for (int i = 0; i < fn.arity; ++i) {
+        entry[i] = JitType::MAYBE_NIL;
+    }
+    flow(0, entry);
+    while (!worklist.empty() && !failed) {
+        int pc = worklist.back();
+        worklist.pop_back();
+        step(pc);
+    }
+    return !failed;
+}
+
+void Translator::flow(int target, const State& state) {
+    if (as) return;  // the analysis already covered it
+    if (target < 0 || static_cast<size_t>(target) >= fn.code.size()) {
+        failed = true;
+        return;
+    }
+    State& existing = code.states[target];
+    if (!reached[target]) {
+        reached[target] = true;
+        existing = state;
+        worklist.push_back(target);
+        return;
+    }
+    if (existing.size() != state.size()) {
+        failed = true;
+        return;
+    }
+    bool changed = false;
+    for (size_t i = 0; i < state.size(); ++i) {
+        JitType before = existing[i];
+        if (!join(existing[i], state[i])) {
+            failed = true;
+            return;
+        }
+        changed |= existing[i] != before;
+    }
+    if (changed) worklist.push_back(target);
+}
+
+void Translator::emit(Assembler& assembler) {
+    as = &assembler;
+    size_t count = fn.code.size();
+    pcLabels.resize(count);
+    guards.assign(count, -1);
+    for (int& label : pcLabels) {
+        label = as->newLabel();
+    }
+    epilogue = as->newLabel();
+
+    as->push(RBX);
+    as->push(R12);
+    as->push(R13);  // three pushes keep rsp 16-byte aligned for hook calls
+    as->mov(R12, RDI);
+    as->mov(RBX, RSI);
+    as->movImm(R13, Jit::NIL_BITS);
+    as->jmp(RDX);
+
+    for (size_t pc = 0; pc < count; ++pc) {
+        if (!reached[pc]) continue;
+        as->bind(pcLabels[pc]);
+        step(static_cast<int>(pc));
+    }
+
+    int common = as->newLabel();
+    for (size_t i = 0; i < exitLabels.size(); ++i) {
+        as->bind(exitLabels[i]);
+        as->movImm32(RDX, static_cast<uint32_t>(i));
+        as->jmp(common);
+    }
+    as->bind(common);
+    as->mov(RDI, R12);
+    as->movImm(RSI, reinterpret_cast<uint64_t>(&code));
+    as->mov(RCX, RBX);
+    as->call(reinterpret_cast<const void*>(hooks.deopt));
+
+    as->bind(epilogue);
+    as->pop(R13);
+    as->pop(R12);
+    as->pop(RBX);
+    as->ret();
+    as->link();
+
+    code.labels.assign(count, nullptr);
+}
+
+int Translator::exitTo(int pc, const State& slots) {
+    code.exits.push_back({pc, slots});
+    exitLabels.push_back(as->newLabel());
+    return exitLabels.back();
+}
+
+int Translator::guard(int pc) {
+    if (guards[pc] < 0) guards[pc] = exitTo(pc, code.states[pc]);
+    return guards[pc];
+}
+
+void Translator::leave(int pc) {
+    if (as) as->jmp(guard(pc));
+}
+
+void Translator::setBoolean(int32_t disp) {
+    as->movzxByte(RAX, RAX);
+    as->cvtsi2sd(XMM0, RAX);
+    as->storesd(disp, XMM0);
+}
+
+void Translator::step(int pc) {
+    const Instruction& ins = fn.code[pc];
+    State s = code.states[pc];
+    size_t top = s.size() - 1;  // wraps when the stack is empty; only used when it is not
+    size_t push = s.size();
+
+    switch (ins.op) {
+        case OpCode::CONSTANT: {
+            const Value& value = program.constants[ins.a];
+            if (!value.isNumber() && !value.isString()) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->movImm(RAX, bitsOf(value.isNumber() ? value.asNumber() : static_cast<double>(ins.a)));
+                as->store(slot(push), RAX);
+            }
+            s.push_back(value.isNumber() ? JitType::NUMBER : JitType::STRING);
+            break;
+        }
+
+        case OpCode::TRUE:
+        case OpCode::FALSE:
+            if (as) {
+                as->movImm(RAX, bitsOf(ins.op == OpCode::TRUE ? 1.0 : 0.0));
+                as->store(slot(push), RAX);
+            }
+            s.push_back(JitType::BOOLEAN);
+            break;
+
+        case OpCode::NIL:
+            if (as) as->store(slot(push), R13);
+            s.push_back(JitType::NIL);
+            break;
+
+        case OpCode::POP:
+            s.pop_back();
+            break;
+
+        case OpCode::LINE:
+            break;  // --profile runs without the JIT
+
+        case OpCode::GET_LOCAL: {
+            JitType& type = s[ins.a];
+            if (type == JitType::NIL) {
+                leave(pc);  // the VM reports the undefined variable
+                return;
+            }
+            if (type == JitType::MAYBE_NIL) {
+                if (as) {
+                    as->cmpMem(R13, slot(ins.a));
+                    as->jcc(CC_E, guard(pc));
+                }
+                type = JitType::NUMBER;
+            }
+            if (as) {
+                as->load(RAX, slot(ins.a));
+                as->store(slot(push), RAX);
+            }
+            s.push_back(type);
+            break;
+        }
+
+        case OpCode::SET_LOCAL:
+            if (s[top] == JitType::STRING) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->load(RAX, slot(top));
+                as->store(slot(ins.a), RAX);
+            }
+            s[ins.a] = s[top];
+            s.pop_back();
+            break;
+
+        case OpCode::INIT_LOCAL:
+            if (as) {
+                as->movImm32(RSI, static_cast<uint32_t>(ins.b));
+                callHook(reinterpret_cast<const void*>(hooks.getGlobal));
+                as->testEax();
+                as->jcc(CC_NE, guard(pc));
+                as->storesd(slot(ins.a), XMM0);
+            }
+            s[ins.a] = JitType::MAYBE_NIL;
+            break;
+
+        case OpCode::INC_LOCAL: {
+            JitType type = s[ins.a];
+            if (type != JitType::NUMBER && type != JitType::MAYBE_NIL) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                if (type == JitType::MAYBE_NIL) {
+                    as->cmpMem(R13, slot(ins.a));
+                    as->jcc(CC_E, guard(pc));
+                }
+                as->loadsd(XMM0, slot(ins.a));
+                as->storesd(slot(push), XMM0);
+                as->movImm(RAX, bitsOf(1.0));
+                as->movq(XMM1, RAX);
+                as->addsd(XMM0, XMM1);
+                as->storesd(slot(ins.a), XMM0);
+            }
+            s[ins.a] = JitType::NUMBER;
+            s.push_back(JitType::NUMBER);
+            break;
+        }
+
+        case OpCode::GET_CACHED_LOCAL: {
+            JitType type = s[ins.a];
+            if (type == JitType::NIL) break;  // never cached yet
+            State cached = s;
+            if (type == JitType::MAYBE_NIL) {
+                cached[ins.a] = JitType::NUMBER;
+                s[ins.a] = JitType::NIL;
+            }
+            cached.push_back(cached[ins.a]);
+            if (as) {
+                int compute = as->newLabel();
+                if (type == JitType::MAYBE_NIL) {
+                    as->cmpMem(R13, slot(ins.a));
+                    as->jcc(CC_E, compute);
+                }
+                as->load(RAX, slot(ins.a));
+                as->store(slot(push), RAX);
+                as->jmp(pcLabels[ins.b]);
+                as->bind(compute);
+            }
+            flow(ins.b, cached);
+            if (type != JitType::MAYBE_NIL) return;
+            break;
+        }
+
+        case OpCode::GET_GLOBAL:
+        case OpCode::GET_CACHED_GLOBAL:
+            if (as) {
+                as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                callHook(reinterpret_cast<const void*>(hooks.getGlobal));
+                as->testEax();
+                as->jcc(CC_NE, guard(pc));
+                as->storesd(slot(push), XMM0);
+                as->cmpMem(R13, slot(push));
+                if (ins.op == OpCode::GET_GLOBAL) {
+                    as->jcc(CC_E, guard(pc));
+                } else {
+                    as->jcc(CC_NE, pcLabels[ins.b]);
+                }
+            }
+            if (ins.op == OpCode::GET_CACHED_GLOBAL) {
+                State cached = s;
+                cached.push_back(JitType::NUMBER);
+                flow(ins.b, cached);
+            } else {
+                s.push_back(JitType::NUMBER);
+            }
+            break;
+
+        case OpCode::SET_GLOBAL:
+            if (s[top] == JitType::STRING) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                as->movImm32(RDX, static_cast<uint32_t>(s[top]));
+                as->loadsd(XMM0, slot(top));
+                callHook(reinterpret_cast<const void*>(hooks.setGlobal));
+            }
+            s.pop_back();
+            break;
+
+        case OpCode::INC_GLOBAL:
+            if (as) {
+                as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                callHook(reinterpret_cast<const void*>(hooks.incGlobal));
+                as->testEax();
+                as->jcc(CC_NE, guard(pc));
+                as->storesd(slot(push), XMM0);
+            }
+            s.push_back(JitType::NUMBER);
+            break;
+
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+            // Anything but two numbers means concatenation or an error
+            if (s[top - 1] != JitType::NUMBER || s[top] != JitType::NUMBER) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->loadsd(XMM0, slot(top - 1));
+                as->loadsd(XMM1, slot(top));
+                switch (ins.op) {
+                    case OpCode::ADD: as->addsd(XMM0, XMM1); break;
+                    case OpCode::SUB: as->subsd(XMM0, XMM1); break;
+                    case OpCode::MUL: as->mulsd(XMM0, XMM1); break;
+                    default: {
+                        int nonZero = as->newLabel();
+                        as->zero(XMM2);
+                        as->ucomisd(XMM1, XMM2);
+                        as->jcc(CC_P, nonZero);
+                        as->jcc(CC_E, guard(pc));
+                        as->bind(nonZero);
+                        as->divsd(XMM0, XMM1);
+                        break;
+                    }
+                }
+                as->storesd(slot(top - 1), XMM0);
+            }
+            s.pop_back();
+            break;
+
+        case OpCode::ADD_TO_GLOBAL:
+        case OpCode::ADD_TO_LOCAL:
+            // The copy of the variable and the value; strings go to the VM
+            if (s[top - 1] != JitType::NUMBER || s[top] != JitType::NUMBER) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->loadsd(XMM0, slot(top - 1));
+                as->loadsd(XMM1, slot(top));
+                as->addsd(XMM0, XMM1);
+                if (ins.op == OpCode::ADD_TO_LOCAL) {
+                    as->storesd(slot(ins.a), XMM0);
+                } else {
+                    as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                    as->movImm32(RDX, static_cast<uint32_t>(JitType::NUMBER));
+                    callHook(reinterpret_cast<const void*>(hooks.setGlobal));
+                }
+            }
+            if (ins.op == OpCode::ADD_TO_LOCAL) s[ins.a] = JitType::NUMBER;
+            s.pop_back();
+            s.pop_back();
+            break;
+
+        case OpCode::LT:
+        case OpCode::GT:
+        case OpCode::LE:
+        case OpCode::GE:
+            if (s[top - 1] != JitType::NUMBER || s[top] != JitType::NUMBER) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                // Unordered operands set CF and ZF, so NaN compares false
+                as->loadsd(XMM0, slot(top - 1));
+                as->loadsd(XMM1, slot(top));
+                bool swap = ins.op == OpCode::LT || ins.op == OpCode::LE;
+                as->ucomisd(swap ? XMM1 : XMM0, swap ? XMM0 : XMM1);
+                as->setcc(ins.op == OpCode::LT || ins.op == OpCode::GT ? CC_A : CC_AE, RAX);
+                setBoolean(slot(top - 1));
+            }
+            s.pop_back();
+            s[top - 1] = JitType::BOOLEAN;
+            break;
+
+        case OpCode::EQ:
+        case OpCode::NE: {
+            JitType l = s[top - 1];
+            JitType r = s[top];
+            if ((l != JitType::NUMBER && l != JitType::BOOLEAN) || (r != JitType::NUMBER && r != JitType::BOOLEAN)) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                if (l != r) {
+                    // A number never prints as s7i7 or ghalat
+                    as->movImm(RAX, bitsOf(ins.op == OpCode::NE ? 1.0 : 0.0));
+                    as->store(slot(top - 1), RAX);
+                } else {
+                    as->loadsd(XMM0, slot(top - 1));
+                    as->loadsd(XMM1, slot(top));
+                    as->ucomisd(XMM0, XMM1);
+                    if (ins.op == OpCode::EQ) {
+                        as->setcc(CC_E, RAX);
+                        as->setcc(CC_NP, RCX);
+                        as->andByte(RAX, RCX);
+                    } else {
+                        as->setcc(CC_NE, RAX);
+                        as->setcc(CC_P, RCX);
+                        as->orByte(RAX, RCX);
+                    }
+                    setBoolean(slot(top - 1));
+                }
+            }
+            s.pop_back();
+            s[top - 1] = JitType::BOOLEAN;
+            break;
+        }
+
+        case OpCode::AND:
+        case OpCode::OR: {
+            JitType l = s[top - 1];
+            JitType r = s[top];
+            if ((l != JitType::NUMBER && l != JitType::BOOLEAN) || (r != JitType::NUMBER && r != JitType::BOOLEAN)) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                // Truthy means != 0, which NaN is
+                as->zero(XMM2);
+                as->loadsd(XMM0, slot(top - 1));
+                as->ucomisd(XMM0, XMM2);
+                as->setcc(CC_NE, RAX);
+                as->setcc(CC_P, RCX);
+                as->orByte(RAX, RCX);
+                as->loadsd(XMM1, slot(top));
+                as->ucomisd(XMM1, XMM2);
+                as->setcc(CC_NE, RDX);
+                as->setcc(CC_P, RCX);
+                as->orByte(RDX, RCX);
+                if (ins.op == OpCode::AND) {
+                    as->andByte(RAX, RDX);
+                } else {
+                    as->orByte(RAX, RDX);
+                }
+                setBoolean(slot(top - 1));
+            }
+            s.pop_back();
+            s[top - 1] = JitType::BOOLEAN;
+            break;
+        }
+
+        case OpCode::NEG:
+            if (s[top] != JitType::NUMBER) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->load(RAX, slot(top));
+                as->flipSign(RAX);
+                as->store(slot(top), RAX);
+            }
+            break;
+
+        case OpCode::DUP2:  // only used for a[i] op= v
+        case OpCode::ARRAY:
+        case OpCode::MAP:
+        case OpCode::GET_INDEX:
+        case OpCode::SET_INDEX:
+        case OpCode::BUILTIN:
+            // Arrays and maps are left to the VM
+            leave(pc);
+            return;
+
+        case OpCode::JUMP:
+            if (as) as->jmp(pcLabels[ins.a]);
+            flow(ins.a, s);
+            return;
+
+        case OpCode::JUMP_IF_FALSE: {
+            JitType type = s[top];
+            if (type != JitType::NUMBER && type != JitType::BOOLEAN) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                int truthy = as->newLabel();
+                as->loadsd(XMM0, slot(top));
+                as->zero(XMM2);
+                as->ucomisd(XMM0, XMM2);
+                as->jcc(CC_P, truthy);
+                as->jcc(CC_E, pcLabels[ins.a]);
+                as->bind(truthy);
+            }
+            s.pop_back();
+            flow(ins.a, s);
+            break;
+        }
+
+        case OpCode::PRINT_ARG:
+            if (as) {
+                as->movImm32(RSI, static_cast<uint32_t>(s[top]));
+                as->movImm32(RDX, static_cast<uint32_t>(ins.a));
+                as->loadsd(XMM0, slot(top));
+                callHook(reinterpret_cast<const void*>(hooks.printArg));
+            }
+            s.pop_back();
+            break;
+
+        case OpCode::PRINT_END:
+            if (as) callHook(reinterpret_cast<const void*>(hooks.printEnd));
+            break;
+
+        case OpCode::DEFINE_FUNCTION:
+            if (as) {
+                as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                as->movImm32(RDX, static_cast<uint32_t>(ins.b));
+                callHook(reinterpret_cast<const void*>(hooks.defineFunction));
+            }
+            break;
+
+        case OpCode::CALL:
+        case OpCode::TAIL_CALL: {
+            // Parameters are numbers or nil; anything else is left to the VM
+            size_t args = push - ins.b;
+            for (size_t i = args; i < push; ++i) {
+                if (s[i] != JitType::NUMBER && s[i] != JitType::NIL) {
+                    leave(pc);
+                    return;
+                }
+            }
+            s.resize(args);
+            if (ins.op == OpCode::TAIL_CALL) {
+                if (as) {
+                    as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                    as->lea(RDX, slot(args));
+                    as->mov(RCX, RBX);
+                    callHook(reinterpret_cast<const void*>(hooks.tailCall));
+                    as->testRax();
+                    as->jcc(CC_E, guard(pc));
+                    as->jmp(RAX);
+                }
+                return;
+            }
+            if (as) {
+                int slow = as->newLabel();
+                int notBoolean = as->newLabel();
+                int done = as->newLabel();
+                as->movImm32(RSI, static_cast<uint32_t>(ins.a));
+                as->lea(RDX, slot(args));
+                callHook(reinterpret_cast<const void*>(hooks.call));
+                as->testEax();
+                as->jcc(CC_NE, slow);
+                as->storesd(slot(args), XMM0);
+                as->jmp(done);
+
+                // The callee returned a boolean, gave up part way, or was
+                // never entered; the VM carries on after or at the call
+                as->bind(slow);
+                as->cmpEax(static_cast<int8_t>(JitResult::BOOLEAN));
+                as->jcc(CC_NE, notBoolean);
+                as->storesd(slot(args), XMM0);
+                State returned = s;
+                returned.push_back(JitType::BOOLEAN);
+                as->jmp(exitTo(pc + 1, returned));
+                as->bind(notBoolean);
+                as->cmpEax(static_cast<int8_t>(JitResult::DECLINED));
+                as->jcc(CC_E, guard(pc));
+                as->jmp(exitTo(pc + 1, s));
+                as->bind(done);
+            }
+            s.push_back(JitType::NUMBER);
+            break;
+        }
+
+        case OpCode::RETURN: {
+            JitType type = s[top];
+            if (type != JitType::NUMBER && type != JitType::BOOLEAN) {
+                leave(pc);
+                return;
+            }
+            if (as) {
+                as->loadsd(XMM0, slot(top));
+                as->movImm32(RAX, static_cast<uint32_t>(type == JitType::NUMBER ? JitResult::NUMBER : JitResult::BOOLEAN));
+                as->jmp(epilogue);
+            }
+            return;
+        }
+    }
+
+    flow(pc + 1, s);
+}
+
+}  // namespace
+
+bool Jit::available() {
+    return true;
+}
+
+Jit::~Jit() {
+    for (const auto& [memory, size] : regions) {
+        munmap(memory, size);
+    }
+}
+
+const JitCode* Jit::compile(int index) {
+    auto code = std::make_unique<JitCode>();
+    code->function = index;
+    Translator translator(program, hooks, *code);
+    if (!translator.analyze()) return nullptr;
+    Assembler as;
+    translator.emit(as);
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (as.bytes.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    std::memcpy(memory, as.bytes.data(), as.bytes.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    regions.emplace_back(memory, size);
+
+    const uint8_t* base = static_cast<const uint8_t*>(memory);
+    code->entry = reinterpret_cast<JitEntry>(memory);
+    for (size_t pc = 0; pc < code->labels.size(); ++pc) {
+        int64_t offset = translator.offset(pc);
+        if (offset >= 0) code->labels[pc] = base + offset;
+    }
+    codes.push_back(std::move(code));
+    return codes.back().get();
+}
+
+#else
+
+bool Jit::available() {
+    return false;
+}
+
+Jit::~Jit() {}
+
+const JitCode* Jit::compile(int) {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef LFI3A_JIT_HPP
+#define LFI3A_JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "Bytecode.hpp"
+#include "Value.hpp"
+
+// What native code knows about a local or operand stack slot at one point
+// of a function. Every slot holds a double: numbers as themselves, booleans
+// as 0 or 1, nil as Jit::NIL_BITS and string constants as their index into
+// the constant pool.
+enum class JitType : uint8_t {
+    NIL,
+    NUMBER,
+    BOOLEAN,
+    MAYBE_NIL,  // a number or nil, checked whenever it is read
+    STRING      // a string constant; only ever on the operand stack
+};
+
+// Returned by native code and by most hooks. Two eightbytes of different
+// classes, so it comes back in xmm0 and rax.
+struct JitResult {
+    enum : int64_t {
+        NUMBER,    // value is the result
+        BOOLEAN,   // value is 0 or 1
+        DEOPT,     // the call continues on the VM, see JitHooks::deopt
+        DECLINED   // the hook did nothing; the VM has to do it instead
+    };
+    double value;
+    int64_t status;
+};
+
+struct JitCode;
+
+// Entry point of compiled code: runs from `start` (the address of some
+// instruction) with `frame` holding the function's locals and stack.
+using JitEntry = JitResult (*)(void* context, double* frame, const void* start);
+
+// Functions the generated code calls back into. `context` is passed
+// through unchanged; the VM passes itself.
+struct JitHooks {
+    JitResult (*call)(void* context, int32_t site, double* args);
+    // Rebinds `frame` to the callee and returns where to continue, or null
+    const void* (*tailCall)(void* context, int32_t site, double* args, double* frame);
+    JitResult (*getGlobal)(void* context, int32_t slot);  // NUMBER for numbers and nil
+    void (*setGlobal)(void* context, int32_t slot, double value, int32_t type);
+    JitResult (*incGlobal)(void* context, int32_t slot);
+    void (*printArg)(void* context, double value, int32_t type, int32_t space);
+    void (*printEnd)(void* context);
+    void (*defineFunction)(void* context, int32_t name, int32_t index);
+    // Hands the frame back to the VM at code->exits[exit]; returns DEOPT
+    JitResult (*deopt)(void* context, const JitCode* code, int32_t exit, const double* frame);
+};
+
+// A point where native code gives up and the VM carries on.
+struct JitExit {
+    int32_t pc;                  // instruction the VM resumes at
+    std::vector<JitType> slots;  // locals, then the operand stack
+};
+
+struct JitCode {
+    int function = 0;  // index into BytecodeProgram::functions
+    JitEntry entry = nullptr;
+    std::vector<const void*> labels;           // per instruction, null if unreachable
+    std::vector<std::vector<JitType>> states;  // slot types on reaching each instruction
+    std::vector<JitExit> exits;
+};
+
+// Compiles bytecode functions to x86-64 machine code, specialized for
+// number and boolean operands. Anything else (string operations, a value
+// whose type differs from what the code expects) leaves through an exit
+// that rebuilds the frame for the VM.
+class Jit {
+public:
+    static constexpr uint32_t DEFAULT_THRESHOLD = 1000;
+    static constexpr uint64_t NIL_BITS = 0x7ff4000000000001ULL;  // a signalling NaN, which arithmetic never produces
+
+    // Whether this build can run generated code (x86-64 Linux only).
+    static bool available();
+
+    Jit(const BytecodeProgram& program, const JitHooks& hooks) : program(program), hooks(hooks) {}
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Native code for program.functions[index], or null if it cannot be compiled.
+    // The code lives as long as the Jit.
+    const JitCode* compile(int index);
+
+private:
+    const BytecodeProgram& program;
+    JitHooks hooks;
+    std::vector<std::unique_ptr<JitCode>> codes;
+    std::vector<std::pair<void*, size_t>> regions;  // mmap'd code
+};
+
+// Converts a VM value to a slot of the given type; false if it does not fit.
+bool toJitSlot(const Value& value, JitType type, double& slot);
+Value fromJitSlot(double slot, JitType type, const BytecodeProgram& program);
+
+#endif
@@ -1,8 +1,12 @@
 #include "Lexer.hpp"
+#include "CharScan.hpp"
 #include <cctype>
-#include <unordered_map>
 
-Lexer::Lexer(const std::string& src) : src(src), pos(0), line(1), column(1) {}
+static_assert(keywordType("ma7ad") == MA7AD && keywordType("w") == W && keywordType("wl") == IDENT,
+              "keyword recognizer is evaluated at compile time");
+
+Lexer::Lexer(std::string_view src, SymbolTable& symbols)
+    : src(src), symbols(symbols), pos(0), line(1), column(1) {}
 
 char Lexer::peek(size_t offset) {
     return pos + offset < src.size() ? src[pos + offset] : '\0';
@@ -20,198 +24,216 @@ char Lexer::advance() {
     return c;
 }
 
-void Lexer::skipWhitespace() {
-    while (isspace(peek())) {
-        advance();
+void Lexer::advanceBy(size_t n) {
+    // Line and column follow from the newlines inside the skipped bytes
+    size_t lines = countNewlines(src.data() + pos, n);
+    if (lines > 0) {
+        size_t lastNewline = pos + n - 1;
+        while (src[lastNewline] != '\n') lastNewline--;
+        line += static_cast<int>(lines);
+        column = static_cast<int>(pos + n - lastNewline);
+    } else {
+        column += static_cast<int>(n);
     }
+    pos += n;
+}
+
+void Lexer::skipWhitespace() {
+    advanceBy(whitespaceRun(src.data() + pos, src.size() - pos));
 }
 
 void Lexer::skipComment() {
     if (peek() == '/' && peek(1) == '/') {
         advance(); // skip /
         advance(); // skip /
-        while (peek() != '\n' && peek() != '\0') {
-            advance();
-        }
+        // The comment runs to the end of the line and contains no newline
+        size_t n = findLineEnd(src.data() + pos, src.size() - pos);
+        pos += n;
+        column += static_cast<int>(n);
     }
 }
 
+Token Lexer::makeToken(TokenType type, size_t start, int startLine, int startColumn) {
+    return {type, src.substr(start, pos - start), startLine, startColumn};
+}
+
 Token Lexer::string() {
+    int startLine = line;
+    int startColumn = column;
     advance();  // skip opening "
-    std::string result;
-    while (peek() != '"' && peek() != '\0') {
-        if (peek() == '\\') {
-            advance();
-            char escaped = advance();
-            switch (escaped) {
-                case 'n': result += '\n'; break;
-                case 't': result += '\t'; break;
-                case '\\': result += '\\'; break;
-                case '"': result += '"'; break;
-                default: result += escaped;
+    
+    // Without escapes the literal is just a slice of the source
+    size_t start = pos;
+    advanceBy(findStringEnd(src.data() + pos, src.size() - pos));
+    std::string_view text = src.substr(start, pos - start);
+    
+    if (peek() == '\\') {
+        std::string result(text);
+        while (peek() != '"' && peek() != '\0') {
+            if (peek() == '\\') {
+                advance();
+                char escaped = advance();
+                switch (escaped) {
+                    case 'n': result += '\n'; break;
+                    case 't': result += '\t'; break;
+                    case '\\': result += '\\'; break;
+                    case '"': result += '"'; break;
+                    default: result += escaped;
+                }
+            } else {
+                result += advance();
             }
-        } else {
-            result += advance();
         }
+        std::string& buffer = unescaped[unescapedNext++ % STRING_BUFFERS];
+        buffer = std::move(result);
+        text = buffer;
     }
+    
     if (peek() == '"') advance();  // skip closing "
-    return {STRING, result};
+    return {STRING, text, startLine, startColumn};
 }
 
 Token Lexer::identifier() {
-    std::string result;
-    while (isalnum(peek()) || peek() == '_') {
-        result += advance();
-    }
+    int startLine = line;
+    int startColumn = column;
+    size_t start = pos;
+    size_t n = identifierRun(src.data() + pos, src.size() - pos);
+    pos += n;
+    column += static_cast<int>(n);
+    std::string_view result = src.substr(start, pos - start);
     
     // Check for keywords
-    static const std::unordered_map<std::string, TokenType> keywords = {
-        {"dir", DIR},
-        {"kteb", KTEB},
-        {"ila", ILA},
-        {"wila", WILA},
-        {"wla", WLA},
-        {"ma7ad", MA7AD},
-        {"kol", KOL},
-        {"dalla", DALLA},
-        {"kalla", KALLA},
-        {"rje3", RJE3},
-        {"s7i7", S7I7},
-        {"ghalat", GHALAT},
-        {"w", W}
-    };
-    
-    auto it = keywords.find(result);
-    if (it != keywords.end()) {
-        return {it->second, result};
+    TokenType type = keywordType(result);
+    if (type != IDENT) {
+        return {type, result, startLine, startColumn};
     }
     
-    return {IDENT, result};
+    return {IDENT, result, startLine, startColumn, symbols.intern(result)};
 }
 
 Token Lexer::number() {
-    std::string result;
-    while (isdigit(peek())) {
-        result += advance();
-    }
+    int startLine = line;
+    int startColumn = column;
+    size_t start = pos;
+    size_t n = digitRun(src.data() + pos, src.size() - pos);
     
     // Handle decimals
-    if (peek() == '.' && isdigit(peek(1))) {
-        result += advance(); // add .
-        while (isdigit(peek())) {
-            result += advance();
-        }
+    if (pos + n + 1 < src.size() && src[pos + n] == '.' && isdigit(static_cast<unsigned char>(src[pos + n + 1]))) {
+        n += 1 + digitRun(src.data() + pos + n + 1, src.size() - pos - n - 1);
     }
+    pos += n;
+    column += static_cast<int>(n);
     
-    return {NUMBER, result};
+    return makeToken(NUMBER, start, startLine, startColumn);
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
-
-    while (peek() != '\0') {
+Token Lexer::next() {
+    skipWhitespace();
+    
+    while (peek() == '/' && peek(1) == '/') {
+        skipComment();
         skipWhitespace();
-        
-        if (peek() == '/' && peek(1) == '/') {
-            skipComment();
-            skipWhitespace();
-        }
+    }
 
-        char c = peek();
-        if (c == '\0') break;
+    char c = peek();
+    if (c == '\0') return {END, "", line, column};
 
-        // Strings
-        if (c == '"') {
-            tokens.push_back(string());
-            continue;
-        }
+    // Strings
+    if (c == '"') return string();
 
-        // Identifiers and keywords
-        if (isalpha(c) || c == '_') {
-            tokens.push_back(identifier());
-            continue;
-        }
+    // Identifiers and keywords
+    if (isalpha(c) || c == '_') return identifier();
 
-        // Numbers
-        if (isdigit(c)) {
-            tokens.push_back(number());
-            continue;
-        }
+    // Numbers
+    if (isdigit(c)) return number();
 
-        // Single and multi-character operators
-        if (c == '(') {
-            advance();
-            tokens.push_back({LPAREN, "("});
-        } else if (c == ')') {
-            advance();
-            tokens.push_back({RPAREN, ")"});
-        } else if (c == '{') {
-            advance();
-            tokens.push_back({LBRACE, "{"});
-        } else if (c == '}') {
-            advance();
-            tokens.push_back({RBRACE, "}"});
-        } else if (c == ';') {
-            advance();
-            tokens.push_back({SEMICOLON, ";"});
-        } else if (c == ',') {
-            advance();
-            tokens.push_back({COMMA, ","});
-        } else if (c == '+') {
-            advance();
-            if (peek() == '+') {
-                advance();
-                tokens.push_back({PLUS_PLUS, "++"});
-            } else {
-                tokens.push_back({PLUS, "+"});
-            }
-        } else if (c == '-') {
-            advance();
-            tokens.push_back({MINUS, "-"});
-        } else if (c == '*') {
+    // Single and multi-character operators
+    size_t start = pos;
+    int startLine = line;
+    int startColumn = column;
+    TokenType type;
+    advance();
+    
+    if (c == '(') {
+        type = LPAREN;
+    } else if (c == ')') {
+        type = RPAREN;
+    } else if (c == '{') {
+        type = LBRACE;
+    } else if (c == '}') {
+        type = RBRACE;
+    } else if (c == '[') {
+        type = LBRACKET;
+    } else if (c == ']') {
+        type = RBRACKET;
+    } else if (c == ';') {
+        type = SEMICOLON;
+    } else if (c == ',') {
+        type = COMMA;
+    } else if (c == ':') {
+        type = COLON;
+    } else if (c == '+') {
+        if (peek() == '+') {
+            advance();
+            type = PLUS_PLUS;
+        } else if (peek() == '=') {
+            advance();
+            type = PLUS_EQUAL;
+        } else {
+            type = PLUS;
+        }
+    } else if (c == '-') {
+        if (peek() == '=') {
             advance();
-            tokens.push_back({STAR, "*"});
-        } else if (c == '/') {
+            type = MINUS_EQUAL;
+        } else {
+            type = MINUS;
+        }
+    } else if (c == '*') {
+        if (peek() == '=') {
             advance();
-            tokens.push_back({SLASH, "/"});
-        } else if (c == '=') {
+            type = STAR_EQUAL;
+        } else {
+            type = STAR;
+        }
+    } else if (c == '/') {
+        if (peek() == '=') {
             advance();
-            if (peek() == '=') {
-                advance();
-                tokens.push_back({EQ_EQ, "=="});
-            } else {
-                tokens.push_back({EQUAL, "="});
-            }
-        } else if (c == '!') {
+            type = SLASH_EQUAL;
+        } else {
+            type = SLASH;
+        }
+    } else if (c == '=') {
+        if (peek() == '=') {
             advance();
-            if (peek() == '=') {
-                advance();
-                tokens.push_back({NOT_EQ, "!="});
-            } else {
-                tokens.push_back({UNKNOWN, "!"});
-            }
-        } else if (c == '<') {
+            type = EQ_EQ;
+        } else {
+            type = EQUAL;
+        }
+    } else if (c == '!') {
+        if (peek() == '=') {
             advance();
-            if (peek() == '=') {
-                advance();
-                tokens.push_back({LE, "<="});
-            } else {
-                tokens.push_back({LT, "<"});
-            }
-        } else if (c == '>') {
+            type = NOT_EQ;
+        } else {
+            type = UNKNOWN;
+        }
+    } else if (c == '<') {
+        if (peek() == '=') {
             advance();
-            if (peek() == '=') {
-                advance();
-                tokens.push_back({GE, ">="});
-            } else {
-                tokens.push_back({GT, ">"});
-            }
+            type = LE;
         } else {
+            type = LT;
+        }
+    } else if (c == '>') {
+        if (peek() == '=') {
             advance();
-            tokens.push_back({UNKNOWN, std::string(1, c)});
+            type = GE;
+        } else {
+            type = GT;
         }
+    } else {
+        type = UNKNOWN;
     }
-
-    tokens.push_back({END, ""});
-    return tokens;
+    
+    return makeToken(type, start, startLine, startColumn);
 }
@@ -2,7 +2,8 @@
 #define LFI3A_LEXER_HPP
 
 #include <string>
-#include <vector>
+#include <string_view>
+#include "Symbols.hpp"
 
 enum TokenType {
     // Literals
@@ -30,8 +31,11 @@ enum TokenType {
     RPAREN,     // )
     LBRACE,     // {
     RBRACE,     // }
+    LBRACKET,   // [
+    RBRACKET,   // ]
     SEMICOLON,  // ;
     COMMA,      // ,
+    COLON,      // :
     EQUAL,      // =
     PLUS,       // +
     MINUS,      // -
@@ -44,37 +48,86 @@ enum TokenType {
     LE,         // <=
     GE,         // >=
     PLUS_PLUS,  // ++
+    PLUS_EQUAL,   // +=
+    MINUS_EQUAL,  // -=
+    STAR_EQUAL,   // *=
+    SLASH_EQUAL,  // /=
     
     // Special
     END,
     UNKNOWN
 };
 
+// Token text is a slice of the source, or of the lexer's own storage for
+// string literals with escapes. The latter is recycled, so the text of a
+// string token stays valid only until STRING_BUFFERS more such literals
+// have been lexed.
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
     int line = 1;
     int column = 1;
+    Symbol symbol = 0;  // IDENT only
 };
 
+// Keyword recognizer: a switch on length, then on spelling. IDENT for
+// anything that is not a keyword.
+constexpr TokenType keywordType(std::string_view word) {
+    switch (word.size()) {
+        case 1:
+            if (word[0] == 'w') return W;
+            break;
+        case 3:
+            if (word == "dir") return DIR;
+            if (word == "ila") return ILA;
+            if (word == "wla") return WLA;
+            if (word == "kol") return KOL;
+            break;
+        case 4:
+            if (word == "kteb") return KTEB;
+            if (word == "wila") return WILA;
+            if (word == "rje3") return RJE3;
+            if (word == "s7i7") return S7I7;
+            break;
+        case 5:
+            if (word == "ma7ad") return MA7AD;
+            if (word == "dalla") return DALLA;
+            if (word == "kalla") return KALLA;
+            break;
+        case 6:
+            if (word == "ghalat") return GHALAT;
+            break;
+    }
+    return IDENT;
+}
+
 class Lexer {
 public:
-    Lexer(const std::string& src);
-    std::vector<Token> tokenize();
+    static constexpr size_t STRING_BUFFERS = 8;
+
+    Lexer(std::string_view src, SymbolTable& symbols);
+
+    // Scans the next token; returns END once the source is exhausted.
+    Token next();
 
 private:
-    std::string src;
+    std::string_view src;
+    SymbolTable& symbols;
+    std::string unescaped[STRING_BUFFERS];  // string literals that had escapes
+    size_t unescapedNext = 0;
     size_t pos = 0;
     int line = 1;
     int column = 1;
 
     char peek(size_t offset = 0);
     char advance();
+    void advanceBy(size_t n);
     void skipWhitespace();
     void skipComment();
     Token string();
     Token identifier();
     Token number();
+    Token makeToken(TokenType type, size_t start, int startLine, int startColumn);
 };
 
 #endif
@@ -0,0 +1,85 @@
+#include "Lfi3a.hpp"
+#include <algorithm>
+#include <utility>
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+
+namespace lfi3a {
+
+// Node text points into source.
+struct Script::Compiled {
+    std::string source;
+    Program program;
+    std::vector<NativeFunction> natives;  // indexed by the slot of NATIVE nodes
+};
+
+void Engine::define(const std::string& name, NativeFunction function) {
+    auto found = std::find(names.begin(), names.end(), name);
+    if (found != names.end()) {
+        functions[found - names.begin()] = std::move(function);
+        return;
+    }
+    names.push_back(name);
+    functions.push_back(std::move(function));
+}
+
+Result Engine::compile(std::string_view source, Script& script) const {
+    auto compiled = std::make_shared<Script::Compiled>();
+    compiled->source = source;
+    compiled->natives = functions;
+    try {
+        auto symbols = std::make_shared<SymbolTable>();
+        Lexer lexer(compiled->source, *symbols);
+        Parser parser(lexer, symbols);
+        compiled->program = parser.parse();
+    } catch (const ScriptError& e) {
+        return {Result::Status::SYNTAX_ERROR, e.what()};
+    }
+
+    Resolver resolver;
+    resolver.resolve(compiled->program, names);
+    if (optimize) {
+        // Globals the host sets and natives can hold arrays and maps
+        Optimizer optimizer;
+        optimizer.optimize(compiled->program, true);
+    }
+
+    script.compiled = std::move(compiled);
+    script.initial.clear();
+    script.globals.clear();
+    return {};
+}
+
+bool Script::setGlobal(std::string_view name, Value value) {
+    Symbol symbol;
+    if (!compiled || !compiled->program.symbols->find(name, symbol)) return false;
+    if (initial.size() <= symbol) initial.resize(compiled->program.symbols->size());
+    initial[symbol] = std::move(value);
+    return true;
+}
+
+Value Script::getGlobal(std::string_view name) const {
+    Symbol symbol;
+    if (!compiled || !compiled->program.symbols->find(name, symbol) || symbol >= globals.size()) return Value();
+    return globals[symbol];
+}
+
+Result Script::run(Output::Sink output) {
+    if (!compiled) return {Result::Status::RUNTIME_ERROR, "No program compiled"};
+    Result result;
+    Interpreter interpreter(Output::Flush::AUTO, Output::DEFAULT_LIMIT, std::move(output));
+    interpreter.setNatives(compiled->natives);
+    try {
+        interpreter.run(compiled->program, initial);
+    } catch (const std::exception& e) {
+        // ScriptError, or whatever a native function let through
+        result = {Result::Status::RUNTIME_ERROR, e.what()};
+    }
+    globals = interpreter.globalValues();
+    return result;
+}
+
+}  // namespace lfi3a
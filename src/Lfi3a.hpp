@@ -0,0 +1,99 @@
+#ifndef LFI3A_LFI3A_HPP
+#define LFI3A_LFI3A_HPP
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Builtins.hpp"
+#include "Error.hpp"
+#include "Output.hpp"
+#include "Value.hpp"
+
+// lfi3a as a library, for C++ programs that run scripts in-process. Build
+// the host together with every file in src/ except main.cpp:
+//
+//   lfi3a::Engine engine;
+//   engine.define("square", [](const Value* args, size_t argc) {
+//       if (argc != 1 || !args[0].isNumber()) throw ScriptError("square takes a number");
+//       return Value::number(args[0].asNumber() * args[0].asNumber());
+//   });
+//   lfi3a::Script script;
+//   lfi3a::Result result = engine.compile("dir y = square(x)", script);
+//   script.setGlobal("x", Value::number(7));
+//   if (result) result = script.run();
+//   if (result) std::cout << script.getGlobal("y").toString() << "\n";
+//   else std::cerr << "Error: " << result.message << "\n";
+//
+// Nothing here ends the process: syntax errors, runtime errors and errors
+// thrown by native functions all come back as a Result. Scripts run on
+// the tree-walker, on the calling thread's stack, and a call that would
+// leave less than STACK_MARGIN (Stack.hpp) of it ends the run with a
+// RUNTIME_ERROR, whatever size the thread's stack is.
+namespace lfi3a {
+
+struct Result {
+    enum class Status { OK, SYNTAX_ERROR, RUNTIME_ERROR };
+
+    Status status = Status::OK;
+    std::string message;  // what lfi3a prints after "Error: "
+
+    explicit operator bool() const { return status == Status::OK; }
+};
+
+class Script;
+
+// Compiles scripts, which can call the native functions defined so far.
+class Engine {
+public:
+    // Makes function callable by name from scripts compiled afterwards. A
+    // native comes before a builtin of the same name, and a dalla in the
+    // script before both. Defining a name again replaces its function.
+    void define(const std::string& name, NativeFunction function);
+
+    // Skip the optimizer in scripts compiled afterwards, like --no-opt.
+    void setOptimize(bool on) { optimize = on; }
+
+    // Lexes, parses and resolves source once, for any number of runs. On
+    // a syntax error, script is left as it was.
+    Result compile(std::string_view source, Script& script) const;
+
+private:
+    std::vector<std::string> names;
+    std::vector<NativeFunction> functions;
+    bool optimize = true;
+};
+
+// A compiled program, the values its globals start with, and the values
+// they had when it last ran. Copies share the program, which never
+// changes, so they can run on different threads at once (calling the
+// natives from each); a single Script runs on one thread at a time.
+class Script {
+public:
+    // Whether Engine::compile() has filled it in.
+    bool valid() const { return compiled != nullptr; }
+
+    // The value global name starts out with in every later run. Returns
+    // false, and does nothing, if the script never mentions the name.
+    bool setGlobal(std::string_view name, Value value);
+
+    // The value of global name when the last run ended, nil before the
+    // first or if it had none.
+    Value getGlobal(std::string_view name) const;
+
+    // Runs the program from the top, handing kteb output to output, or
+    // writing it on stdout without one.
+    Result run(Output::Sink output = nullptr);
+
+private:
+    friend class Engine;
+    struct Compiled;
+
+    std::shared_ptr<const Compiled> compiled;
+    std::vector<Value> initial;  // by Symbol
+    std::vector<Value> globals;  // by Symbol, from the last run
+};
+
+}  // namespace lfi3a
+
+#endif
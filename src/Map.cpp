@@ -0,0 +1,212 @@
+#include "Map.hpp"
+#include <cmath>
+#include <cstring>
+
+#if !defined(LFI3A_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define LFI3A_SIMD_CONTROL 1
+#endif
+
+// Control bytes. A full slot holds the low 7 bits of its key's hash, so
+// EMPTY and DELETED are the only bytes with the top bit set.
+static const uint8_t EMPTY = 0x80;
+static const uint8_t DELETED = 0xFE;
+
+#ifdef LFI3A_SIMD_CONTROL
+// Bit i is set when group[i] == byte.
+static inline uint32_t matching(const uint8_t* group, uint8_t byte) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(byte)))));
+}
+
+// Bit i is set when group[i] is EMPTY or DELETED.
+static inline uint32_t freeBytes(const uint8_t* group) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+}
+#else
+static inline uint32_t matching(const uint8_t* group, uint8_t byte) {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        bits |= static_cast<uint32_t>(group[i] == byte) << i;
+    }
+    return bits;
+}
+
+static inline uint32_t freeBytes(const uint8_t* group) {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        bits |= static_cast<uint32_t>(group[i] >> 7) << i;
+    }
+    return bits;
+}
+#endif
+
+static inline size_t firstSet(uint32_t bits) {
+    return static_cast<size_t>(__builtin_ctz(bits));
+}
+
+// The MurmurHash3 finalizer: every input bit reaches the low 7 bits of
+// the control byte and the high bits that pick the group.
+static inline uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashKey(const Value& key) {
+    switch (key.type()) {
+        case Value::Type::STRING:
+            return key.stringHash();
+        case Value::Type::NUMBER: {
+            // 0 and -0 are the same key
+            double n = key.asNumber() == 0 ? 0 : key.asNumber();
+            uint64_t bits;
+            std::memcpy(&bits, &n, sizeof(bits));
+            return mix(bits);
+        }
+        default:
+            return mix(key.asBoolean() ? 2 : 1);
+    }
+}
+
+static inline bool sameKey(const Value& a, const Value& b) {
+    if (a.type() != b.type()) return false;
+    switch (a.type()) {
+        case Value::Type::STRING:
+            // The same string object, as when both come from one literal,
+            // needs no comparing
+            return a.equals(b);
+        case Value::Type::NUMBER:
+            return a.asNumber() == b.asNumber();
+        default:
+            return a.asBoolean() == b.asBoolean();
+    }
+}
+
+bool Map::isKey(const Value& key) {
+    return key.isString() || key.isBoolean() || (key.isNumber() && !std::isnan(key.asNumber()));
+}
+
+size_t Map::findSlot(const Value& key, uint64_t hash) const {
+    if (control_.empty()) return NONE;
+    size_t mask = control_.size() / GROUP - 1;
+    uint8_t tag = hash & 0x7F;
+    size_t group = (hash >> 7) & mask;
+    // Triangular steps, which reach every group of a power-of-two table
+    for (size_t step = 1;; ++step) {
+        const uint8_t* bytes = &control_[group * GROUP];
+        for (uint32_t bits = matching(bytes, tag); bits; bits &= bits - 1) {
+            size_t slot = group * GROUP + firstSet(bits);
+            const Entry& entry = entries_[slots_[slot]];
+            if (entry.hash == hash && sameKey(entry.key, key)) return slot;
+        }
+        if (matching(bytes, EMPTY)) return NONE;
+        group = (group + step) & mask;
+    }
+}
+
+size_t Map::freeSlot(uint64_t hash) const {
+    size_t mask = control_.size() / GROUP - 1;
+    size_t group = (hash >> 7) & mask;
+    for (size_t step = 1;; ++step) {
+        uint32_t bits = freeBytes(&control_[group * GROUP]);
+        if (bits) return group * GROUP + firstSet(bits);
+        group = (group + step) & mask;
+    }
+}
+
+Value* Map::find(const Value& key) {
+    size_t slot = findSlot(key, hashKey(key));
+    return slot == NONE ? nullptr : &entries_[slots_[slot]].value;
+}
+
+void Map::set(const Value& key, Value value) {
+    uint64_t hash = hashKey(key);
+    size_t slot = findSlot(key, hash);
+    if (slot != NONE) {
+        entries_[slots_[slot]].value = std::move(value);
+        return;
+    }
+    // At most 7/8 of the slots in use, so every probe meets an EMPTY byte
+    if ((used_ + 1) * 8 > control_.size() * 7 || entries_.size() == control_.size()) {
+        rehash();
+    }
+    slot = freeSlot(hash);
+    if (control_[slot] == EMPTY) ++used_;
+    control_[slot] = hash & 0x7F;
+    slots_[slot] = static_cast<uint32_t>(entries_.size());
+    entries_.push_back({hash, key, std::move(value)});
+    ++count_;
+}
+
+bool Map::remove(const Value& key) {
+    size_t slot = findSlot(key, hashKey(key));
+    if (slot == NONE) return false;
+    Entry& entry = entries_[slots_[slot]];
+    entry.key = Value();
+    entry.value = Value();
+    --count_;
+    // A group never gets an EMPTY byte back before the next rehash, so one
+    // that still has one has never been full, and no probe has gone past
+    // it: the slot can be EMPTY rather than DELETED.
+    if (matching(&control_[slot / GROUP * GROUP], EMPTY)) {
+        control_[slot] = EMPTY;
+        --used_;
+    } else {
+        control_[slot] = DELETED;
+    }
+    return true;
+}
+
+void Map::rehash() {
+    if (count_ < entries_.size()) {
+        size_t kept = 0;
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            if (entries_[i].key.isNil()) continue;
+            if (kept != i) entries_[kept] = std::move(entries_[i]);
+            ++kept;
+        }
+        entries_.resize(kept);
+    }
+
+    // Doubled, unless removed keys took up most of the room
+    size_t capacity = control_.empty() ? GROUP : control_.size();
+    if ((count_ + 1) * 16 > capacity * 7) capacity *= 2;
+    control_.assign(capacity, EMPTY);
+    slots_.assign(capacity, 0);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        size_t slot = freeSlot(entries_[i].hash);
+        control_[slot] = entries_[i].hash & 0x7F;
+        slots_[slot] = static_cast<uint32_t>(i);
+    }
+    used_ = count_;
+}
+
+std::string mapToString(const Map& map) {
+    // Maps being printed, outermost first
+    static thread_local std::vector<const Map*> printing;
+    for (const Map* outer : printing) {
+        if (outer == &map) return "{...}";
+    }
+    printing.push_back(&map);
+    std::string text = "{";
+    bool first = true;
+    for (const Map::Entry& entry : map.entries()) {
+        if (entry.key.isNil()) continue;
+        if (!first) text += ", ";
+        first = false;
+        text += entry.key.toString();
+        text += ": ";
+        text += entry.value.toString();
+    }
+    printing.pop_back();
+    return text + "}";
+}
+
+std::string invalidKey(const Value& key) {
+    if (key.isNumber()) return "NaN can't be a map key";
+    return "Map keys must be numbers, strings or booleans, not '" + key.toString() + "'";
+}
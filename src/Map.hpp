@@ -0,0 +1,64 @@
+#ifndef LFI3A_MAP_HPP
+#define LFI3A_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Value.hpp"
+
+// The entries of a map value, kept in the order their keys were first
+// added. Keys are numbers (other than NaN), strings or booleans, and
+// compare by type as well as value: 1 and "1" are different keys.
+//
+// Lookups go through an open-addressing table laid out like Abseil's
+// SwissTable. Every slot has a control byte, EMPTY, DELETED or the low 7
+// bits of its key's hash, and the index of its entry. Probing compares a
+// group of 16 control bytes at once (with SSE2 when available) and only
+// looks at the entries whose bits match. Entries keep their full hash, so
+// a mismatch rarely gets as far as comparing keys, and growing the table
+// never hashes a key again.
+class Map {
+public:
+    struct Entry {
+        uint64_t hash;
+        Value key;  // nil once the entry is removed
+        Value value;
+    };
+
+    // Whether key can be a map key.
+    static bool isKey(const Value& key);
+
+    size_t size() const { return count_; }
+
+    // The value stored under key, or null. These three take a key for
+    // which isKey() holds.
+    Value* find(const Value& key);
+    void set(const Value& key, Value value);
+    bool remove(const Value& key);
+
+    // In insertion order, removed entries included (with a nil key).
+    const std::vector<Entry>& entries() const { return entries_; }
+
+private:
+    static constexpr size_t GROUP = 16;
+    static constexpr size_t NONE = SIZE_MAX;
+
+    std::vector<Entry> entries_;
+    std::vector<uint8_t> control_;  // one byte per slot
+    std::vector<uint32_t> slots_;   // the entry in each full slot
+    size_t count_ = 0;              // keys in the map
+    size_t used_ = 0;               // slots that are not EMPTY
+
+    size_t findSlot(const Value& key, uint64_t hash) const;
+    size_t freeSlot(uint64_t hash) const;
+    void rehash();
+};
+
+// {a: 1, 2: s7i7}; a map that contains itself prints as "{...}" in there.
+std::string mapToString(const Map& map);
+
+// The message for a key that isKey() rejects.
+std::string invalidKey(const Value& key);
+
+#endif
@@ -0,0 +1,102 @@
+#include "Memo.hpp"
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+
+static uint64_t numberBits(double n) {
+    uint64_t bits;
+    std::memcpy(&bits, &n, sizeof(bits));
+    return bits;
+}
+
+size_t MemoTable::KeyHash::operator()(const Key* key) const {
+    size_t h = key->size();
+    for (const Value& value : *key) {
+        size_t v;
+        switch (value.type()) {
+            case Value::Type::NUMBER:
+                v = std::hash<uint64_t>()(numberBits(value.asNumber()));
+                break;
+            case Value::Type::STRING:
+                v = value.stringHash();
+                break;
+            case Value::Type::BOOLEAN:
+                v = value.asBoolean() ? 1 : 2;
+                break;
+            default:
+                v = 3;
+                break;
+        }
+        h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+bool MemoTable::KeyEqual::operator()(const Key* a, const Key* b) const {
+    if (a->size() != b->size()) return false;
+    for (size_t i = 0; i < a->size(); ++i) {
+        const Value& x = (*a)[i];
+        const Value& y = (*b)[i];
+        if (x.type() != y.type()) return false;
+        switch (x.type()) {
+            case Value::Type::NUMBER:
+                if (numberBits(x.asNumber()) != numberBits(y.asNumber())) return false;
+                break;
+            case Value::Type::STRING:
+                if (x.asString() != y.asString()) return false;
+                break;
+            case Value::Type::BOOLEAN:
+                if (x.asBoolean() != y.asBoolean()) return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+static bool hasContainer(const MemoTable::Key& key) {
+    for (const Value& value : key) {
+        if (value.isContainer()) return true;
+    }
+    return false;
+}
+
+const Value* MemoTable::find(const Key& key) {
+    if (hasContainer(key)) {
+        misses++;
+        return nullptr;
+    }
+    auto it = index.find(&key);
+    if (it == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return &it->second->result;
+}
+
+void MemoTable::insert(Key key, Value result) {
+    if (capacity == 0 || result.isContainer() || hasContainer(key)) return;
+    
+    auto it = index.find(&key);
+    if (it != index.end()) {
+        it->second->result = std::move(result);
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+    if (entries.size() >= capacity) {
+        index.erase(&entries.back().key);
+        entries.pop_back();
+        evictions++;
+    }
+    entries.push_front({std::move(key), std::move(result)});
+    index.emplace(&entries.front().key, entries.begin());
+}
+
+void MemoTable::report(std::string_view name, std::ostream& out) const {
+    out << "memo " << name << ": " << hits << " hits, " << misses << " misses, "
+        << evictions << " evictions, " << entries.size() << " entries\n";
+}
@@ -0,0 +1,53 @@
+#ifndef LFI3A_MEMO_HPP
+#define LFI3A_MEMO_HPP
+
+#include <cstddef>
+#include <iosfwd>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Value.hpp"
+
+// Results of one pure function, keyed by its parameter values. Holds at
+// most `capacity` entries and evicts the least recently used one. Calls
+// that take or return an array or a map are never cached, since its
+// elements can change.
+class MemoTable {
+public:
+    using Key = std::vector<Value>;
+
+    static constexpr size_t DEFAULT_CAPACITY = 100000;
+
+    explicit MemoTable(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    // The cached result for key, or null. Counts a hit or a miss.
+    const Value* find(const Key& key);
+    void insert(Key key, Value result);
+
+    size_t size() const { return entries.size(); }
+    void report(std::string_view name, std::ostream& out) const;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+
+private:
+    struct Entry {
+        Key key;
+        Value result;
+    };
+    // Arguments match only if they have the same type and the same value;
+    // numbers compare bit for bit, so 0 and -0 stay apart.
+    struct KeyHash {
+        size_t operator()(const Key* key) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Key* a, const Key* b) const;
+    };
+
+    size_t capacity;
+    std::list<Entry> entries;  // most recently used first
+    std::unordered_map<const Key*, std::list<Entry>::iterator, KeyHash, KeyEqual> index;
+};
+
+#endif
@@ -0,0 +1,642 @@
+#include "Optimizer.hpp"
+#include "Builtins.hpp"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Strength reduction keeps K * i exact as long as it stays below 2^53; with
+// these bounds that takes more than 2^37 iterations.
+static constexpr double MAX_FACTOR = 4096;
+static constexpr double MAX_STEP = 16;
+static constexpr double MAX_START = 2147483648.0;
+
+static bool isIntegerWithin(double n, double limit) {
+    return n == std::floor(n) && std::fabs(n) <= limit;
+}
+
+static bool sameVariable(ASTNodePtr a, ASTNodePtr b) {
+    return a->isLocal == b->isLocal && a->slot == b->slot;
+}
+
+static bool hasContainerLiteral(ASTNodePtr node) {
+    if (!node) return false;
+    // A native function may return an array or a map too
+    if (node->type == NodeType::ARRAY || node->type == NodeType::MAP || node->type == NodeType::NATIVE) return true;
+    if (node->type == NodeType::FUNCTION_DECL && hasContainerLiteral(node->function->body)) return true;
+    for (ASTNodePtr child : node->children) {
+        if (hasContainerLiteral(child)) return true;
+    }
+    return false;
+}
+
+// Whether running node may store into an array or a map.
+static bool storesElements(ASTNodePtr node) {
+    if (!node || node->type == NodeType::FUNCTION_DECL) return false;
+    if (node->type == NodeType::SET_INDEX || node->type == NodeType::CALL || node->type == NodeType::NATIVE) return true;
+    if (node->type == NodeType::BUILTIN) {
+        Builtin builtin = static_cast<Builtin>(node->slot);
+        if (builtin == Builtin::PUSH || builtin == Builtin::DELETE) return true;
+    }
+    for (ASTNodePtr child : node->children) {
+        if (storesElements(child)) return true;
+    }
+    return false;
+}
+
+void Optimizer::optimize(Program& prog, bool hostContainers) {
+    program = &prog;
+    writes.assign(prog.symbols->size(), 0);
+    constants.assign(prog.symbols->size(), nullptr);
+    usesContainers = hostContainers;
+    
+    for (ASTNodePtr node : prog.statements) {
+        countWrites(node);
+        usesContainers = usesContainers || hasContainerLiteral(node);
+    }
+    
+    std::vector<ASTNodePtr> result;
+    for (ASTNodePtr node : prog.statements) {
+        node = statement(node);
+        if (!node) continue;
+        result.push_back(node);
+        
+        // Reads after a top-level `dir` that is the name's only assignment
+        // can only ever see its value
+        if (node->type == NodeType::VAR_DECL && !node->isLocal && writes[node->symbol] == 1) {
+            Value value;
+            if (constantValue(node->children[0], value)) {
+                constants[node->symbol] = node->children[0];
+            }
+        }
+    }
+    
+    function = nullptr;
+    for (ASTNodePtr& node : result) {
+        node = loops(node);
+    }
+    prog.statements = std::move(result);
+    program = nullptr;
+}
+
+void Optimizer::countWrites(ASTNodePtr node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+            writes[node->symbol]++;
+            break;
+        case NodeType::UNARY_OP:
+            if (node->op == Op::POST_INC && node->children[0]->type == NodeType::IDENTIFIER) {
+                writes[node->children[0]->symbol]++;
+            }
+            break;
+        case NodeType::FUNCTION_DECL:
+            countWrites(node->function->body);
+            break;
+        default:
+            break;
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        countWrites(child);
+    }
+}
+
+// Returns the optimized statement, or null when it does nothing.
+ASTNodePtr Optimizer::statement(ASTNodePtr node) {
+    if (!node) return nullptr;
+    
+    Value value;
+    switch (node->type) {
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+        case NodeType::SET_INDEX:
+        case NodeType::PRINT:
+        case NodeType::RETURN:
+            for (ASTNodePtr child : node->children) {
+                expression(child);
+            }
+            return node;
+        
+        case NodeType::IF:
+            return ifStatement(node);
+        
+        case NodeType::WHILE:
+            expression(node->children[0]);
+            if (constantValue(node->children[0], value) && !value.isTruthy()) return nullptr;
+            statement(node->children[1]);
+            return node;
+        
+        case NodeType::FOR:
+            node->children[0] = statement(node->children[0]);
+            expression(node->children[1]);
+            if (constantValue(node->children[1], value) && !value.isTruthy()) return node->children[0];
+            node->children[2] = statement(node->children[2]);
+            statement(node->children[3]);
+            return node;
+        
+        case NodeType::FUNCTION_DECL:
+            statement(node->function->body);
+            return node;
+        
+        case NodeType::BLOCK:
+            statements(node->children);
+            return node;
+        
+        default:
+            // Expression statement; a bare literal has no effect
+            expression(node);
+            return constantValue(node, value) ? nullptr : node;
+    }
+}
+
+void Optimizer::statements(Span<ASTNodePtr>& list) {
+    uint32_t kept = 0;
+    for (ASTNodePtr node : list) {
+        node = statement(node);
+        if (node) list[kept++] = node;
+    }
+    list.count = kept;
+}
+
+ASTNodePtr Optimizer::ifStatement(ASTNodePtr node) {
+    // Branches are the IF itself followed by its wila IF nodes; a trailing
+    // BLOCK is the wla branch
+    std::vector<ASTNodePtr> branches{node};
+    ASTNodePtr elseBlock = nullptr;
+    for (size_t i = 2; i < node->children.size(); ++i) {
+        ASTNodePtr child = node->children[i];
+        if (child->type == NodeType::IF) {
+            branches.push_back(child);
+        } else {
+            elseBlock = child;
+        }
+    }
+    
+    std::vector<ASTNodePtr> kept;
+    for (ASTNodePtr branch : branches) {
+        expression(branch->children[0]);
+        statement(branch->children[1]);
+        
+        Value value;
+        if (!constantValue(branch->children[0], value)) {
+            kept.push_back(branch);
+        } else if (value.isTruthy()) {
+            elseBlock = branch->children[1];  // always taken: later branches are dead
+            break;
+        }
+    }
+    if (elseBlock) statement(elseBlock);
+    
+    if (kept.empty()) return elseBlock;
+    
+    std::vector<ASTNodePtr> children{kept[0]->children[0], kept[0]->children[1]};
+    children.insert(children.end(), kept.begin() + 1, kept.end());
+    if (elseBlock) children.push_back(elseBlock);
+    if (!std::equal(children.begin(), children.end(), node->children.begin(), node->children.end())) {
+        node->children = program->arena.copy(children);
+    }
+    return node;
+}
+
+void Optimizer::expression(ASTNodePtr node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NodeType::IDENTIFIER:
+            if (!node->isLocal && constants[node->symbol]) {
+                replace(node, *constants[node->symbol]);
+            }
+            break;
+        
+        case NodeType::BINARY_OP:
+        case NodeType::UNARY_OP:
+            for (ASTNodePtr child : node->children) {
+                expression(child);
+            }
+            fold(node);
+            break;
+        
+        case NodeType::CALL:
+        case NodeType::BUILTIN:
+        case NodeType::NATIVE:
+        case NodeType::ARRAY:
+        case NodeType::INDEX:
+        case NodeType::MAP:
+            for (ASTNodePtr child : node->children) {
+                expression(child);
+            }
+            break;
+        
+        default:
+            break;
+    }
+}
+
+bool Optimizer::constantValue(ASTNodePtr node, Value& out) {
+    if (!node) return false;
+    
+    switch (node->type) {
+        case NodeType::NUMBER:
+            out = Value::number(node->number);
+            return true;
+        case NodeType::STRING:
+            out = program->strings[node->slot];
+            return true;
+        case NodeType::BOOLEAN:
+            out = Value::boolean(node->number != 0);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Folds a BINARY_OP or UNARY_OP with literal operands into a literal, with
+// the same semantics as the engines. Operations that would fail at run time
+// are left alone so the error still happens there.
+bool Optimizer::fold(ASTNodePtr node) {
+    if (node->type == NodeType::UNARY_OP) {
+        Value operand;
+        double n;
+        if (node->op != Op::NEG || !constantValue(node->children[0], operand) || !operand.tryNumber(n)) return false;
+        setLiteral(node, Value::number(-n));
+        return true;
+    }
+    
+    Value left, right;
+    if (!constantValue(node->children[0], left) || !constantValue(node->children[1], right)) return false;
+    
+    switch (node->op) {
+        case Op::EQ:
+            setLiteral(node, Value::boolean(left.equals(right)));
+            return true;
+        case Op::NE:
+            setLiteral(node, Value::boolean(!left.equals(right)));
+            return true;
+        case Op::AND:
+            setLiteral(node, Value::boolean(left.isTruthy() && right.isTruthy()));
+            return true;
+        case Op::OR:
+            setLiteral(node, Value::boolean(left.isTruthy() || right.isTruthy()));
+            return true;
+        default:
+            break;
+    }
+    
+    double l, r;
+    bool numeric = left.tryNumber(l) && right.tryNumber(r);
+    switch (node->op) {
+        case Op::ADD:
+            setLiteral(node, numeric ? Value::number(l + r) : Value::string(left.toString() + right.toString()));
+            return true;
+        case Op::SUB:
+            if (!numeric) return false;
+            setLiteral(node, Value::number(l - r));
+            return true;
+        case Op::MUL:
+            if (!numeric) return false;
+            setLiteral(node, Value::number(l * r));
+            return true;
+        case Op::DIV:
+            if (!numeric || r == 0) return false;
+            setLiteral(node, Value::number(l / r));
+            return true;
+        case Op::LT:
+            if (!numeric) return false;
+            setLiteral(node, Value::boolean(l < r));
+            return true;
+        case Op::GT:
+            if (!numeric) return false;
+            setLiteral(node, Value::boolean(l > r));
+            return true;
+        case Op::LE:
+            if (!numeric) return false;
+            setLiteral(node, Value::boolean(l <= r));
+            return true;
+        case Op::GE:
+            if (!numeric) return false;
+            setLiteral(node, Value::boolean(l >= r));
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Optimizer::setLiteral(ASTNodePtr node, const Value& value) {
+    node->op = Op::NONE;
+    node->children = Span<ASTNodePtr>();
+    switch (value.type()) {
+        case Value::Type::NUMBER:
+            node->type = NodeType::NUMBER;
+            node->number = value.asNumber();
+            node->value = program->arena.copy(formatNumber(value.asNumber()));
+            break;
+        case Value::Type::BOOLEAN:
+            node->type = NodeType::BOOLEAN;
+            node->number = value.asBoolean() ? 1 : 0;
+            node->value = value.asBoolean() ? "s7i7" : "ghalat";
+            break;
+        default:
+            node->type = NodeType::STRING;
+            node->slot = static_cast<int32_t>(program->strings.size());
+            node->value = program->arena.copy(value.asString());
+            program->strings.push_back(value);
+            break;
+    }
+}
+
+// Rewrites every loop under node, returning what should replace node.
+ASTNodePtr Optimizer::loops(ASTNodePtr node) {
+    if (!node) return node;
+    
+    switch (node->type) {
+        case NodeType::BLOCK:
+            for (ASTNodePtr& child : node->children) {
+                child = loops(child);
+            }
+            return node;
+        
+        case NodeType::IF:
+            node->children[1] = loops(node->children[1]);
+            for (size_t i = 2; i < node->children.size(); ++i) {
+                ASTNodePtr child = node->children[i];
+                if (child->type == NodeType::IF) {
+                    child->children[1] = loops(child->children[1]);
+                } else {
+                    node->children[i] = loops(child);
+                }
+            }
+            return node;
+        
+        case NodeType::FUNCTION_DECL: {
+            FunctionInfo* enclosing = function;
+            function = node->function;
+            function->body = loops(function->body);
+            function = enclosing;
+            return node;
+        }
+        
+        case NodeType::WHILE:
+        case NodeType::FOR:
+            return loop(node);
+        
+        default:
+            return node;
+    }
+}
+
+ASTNodePtr Optimizer::loop(ASTNodePtr node) {
+    bool isFor = node->type == NodeType::FOR;
+    if (isFor) reduceStrength(node);
+    
+    // Outer loops go first, so an expression is cached by the outermost
+    // loop it is invariant in
+    loopWrites.clear();
+    collectWrites(node);
+    std::vector<ASTNodePtr> clears;
+    if (!usesContainers || !storesElements(node)) {
+        for (size_t i = isFor ? 1 : 0; i < node->children.size(); ++i) {
+            hoist(node->children[i], clears);
+        }
+    }
+    
+    size_t body = isFor ? 3 : 1;
+    node->children[body] = loops(node->children[body]);
+    
+    if (clears.empty()) return node;
+    
+    // Every entry into the loop starts with empty caches
+    clears.push_back(node);
+    for (ASTNodePtr clear : clears) {
+        clear->location = node->location;
+    }
+    ASTNodePtr block = makeNode(NodeType::BLOCK, node->location, {});
+    block->children = program->arena.copy(clears);
+    return block;
+}
+
+void Optimizer::reduceStrength(ASTNodePtr node) {
+    ASTNodePtr init = node->children[0];
+    ASTNodePtr increment = node->children[2];
+    if (!init || !increment || init->type != NodeType::ASSIGNMENT || init->children[0]->type != NodeType::NUMBER) return;
+    
+    double start = init->children[0]->number;
+    double step;
+    if (!isIntegerWithin(start, MAX_START) || !inductionStep(increment, init, step)) return;
+    
+    // The counter may only change in the increment clause
+    loopWrites.clear();
+    collectWrites(node->children[1]);
+    collectWrites(node->children[3]);
+    if (isWrittenInLoop(init)) return;
+    
+    std::vector<std::pair<double, ASTNodePtr>> derived;  // factor -> hidden variable
+    replaceInduction(node->children[1], init, derived);
+    replaceInduction(node->children[3], init, derived);
+    if (derived.empty()) return;
+    
+    std::vector<ASTNodePtr> initBlock{init};
+    std::vector<ASTNodePtr> incrementBlock{increment};
+    for (const auto& entry : derived) {
+        ASTNodePtr initial = makeNode(NodeType::NUMBER, init->location, {});
+        setLiteral(initial, Value::number(entry.first * start));
+        ASTNodePtr first = program->arena.make<ASTNode>(*entry.second);
+        first->type = NodeType::ASSIGNMENT;
+        first->location = init->location;
+        first->children = program->arena.copy({initial});
+        initBlock.push_back(first);
+        
+        ASTNodePtr delta = makeNode(NodeType::NUMBER, increment->location, {});
+        setLiteral(delta, Value::number(entry.first * step));
+        ASTNodePtr current = program->arena.make<ASTNode>(*entry.second);
+        current->location = increment->location;
+        ASTNodePtr sum = makeNode(NodeType::BINARY_OP, increment->location, {current, delta});
+        sum->op = Op::ADD;
+        ASTNodePtr next = program->arena.make<ASTNode>(*entry.second);
+        next->type = NodeType::ASSIGNMENT;
+        next->inPlace = true;
+        next->location = increment->location;
+        next->children = program->arena.copy({sum});
+        incrementBlock.push_back(next);
+    }
+    node->children[0] = makeNode(NodeType::BLOCK, init->location, {});
+    node->children[0]->children = program->arena.copy(initBlock);
+    node->children[2] = makeNode(NodeType::BLOCK, increment->location, {});
+    node->children[2]->children = program->arena.copy(incrementBlock);
+}
+
+// Recognizes i++, i = i + c, i = c + i and i = i - c for the counter.
+bool Optimizer::inductionStep(ASTNodePtr increment, ASTNodePtr counter, double& step) {
+    if (increment->type == NodeType::UNARY_OP && increment->op == Op::POST_INC) {
+        ASTNodePtr target = increment->children[0];
+        step = 1;
+        return target->type == NodeType::IDENTIFIER && sameVariable(target, counter);
+    }
+    if (increment->type != NodeType::ASSIGNMENT || !sameVariable(increment, counter)) return false;
+    
+    ASTNodePtr value = increment->children[0];
+    if (value->type != NodeType::BINARY_OP) return false;
+    ASTNodePtr left = value->children[0];
+    ASTNodePtr right = value->children[1];
+    bool leftIsCounter = left->type == NodeType::IDENTIFIER && sameVariable(left, counter);
+    bool rightIsCounter = right->type == NodeType::IDENTIFIER && sameVariable(right, counter);
+    
+    if (value->op == Op::ADD && leftIsCounter && right->type == NodeType::NUMBER) {
+        step = right->number;
+    } else if (value->op == Op::ADD && rightIsCounter && left->type == NodeType::NUMBER) {
+        step = left->number;
+    } else if (value->op == Op::SUB && leftIsCounter && right->type == NodeType::NUMBER) {
+        step = -right->number;
+    } else {
+        return false;
+    }
+    return isIntegerWithin(step, MAX_STEP);
+}
+
+void Optimizer::replaceInduction(ASTNodePtr node, ASTNodePtr counter, std::vector<std::pair<double, ASTNodePtr>>& derived) {
+    if (!node || node->type == NodeType::FUNCTION_DECL) return;
+    
+    if (node->type == NodeType::BINARY_OP && node->op == Op::MUL) {
+        ASTNodePtr left = node->children[0];
+        ASTNodePtr right = node->children[1];
+        ASTNodePtr factor = nullptr;
+        if (left->type == NodeType::NUMBER && right->type == NodeType::IDENTIFIER && sameVariable(right, counter)) {
+            factor = left;
+        } else if (right->type == NodeType::NUMBER && left->type == NodeType::IDENTIFIER && sameVariable(left, counter)) {
+            factor = right;
+        }
+        
+        if (factor && isIntegerWithin(factor->number, MAX_FACTOR)) {
+            ASTNodePtr variable = nullptr;
+            for (const auto& entry : derived) {
+                if (entry.first == factor->number) variable = entry.second;
+            }
+            if (!variable) {
+                variable = hiddenVariable("$sr");
+                derived.emplace_back(factor->number, variable);
+            }
+            replace(node, *variable);
+            return;
+        }
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        replaceInduction(child, counter, derived);
+    }
+}
+
+void Optimizer::collectWrites(ASTNodePtr node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NodeType::FUNCTION_DECL:
+            return; // assignments in there belong to another frame
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+            loopWrites.emplace_back(node->isLocal, node->slot);
+            break;
+        case NodeType::UNARY_OP:
+            if (node->op == Op::POST_INC && node->children[0]->type == NodeType::IDENTIFIER) {
+                loopWrites.emplace_back(node->children[0]->isLocal, node->children[0]->slot);
+            }
+            break;
+        default:
+            break;
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        collectWrites(child);
+    }
+}
+
+bool Optimizer::isWrittenInLoop(ASTNodePtr variable) {
+    for (const auto& write : loopWrites) {
+        if (write.first == variable->isLocal && write.second == variable->slot) return true;
+    }
+    return false;
+}
+
+bool Optimizer::isInvariant(ASTNodePtr node) {
+    switch (node->type) {
+        case NodeType::NUMBER:
+        case NodeType::STRING:
+        case NodeType::BOOLEAN:
+        case NodeType::CACHED:
+            return true;
+        case NodeType::IDENTIFIER:
+            return !isWrittenInLoop(node);
+        case NodeType::BINARY_OP:
+            return isInvariant(node->children[0]) && isInvariant(node->children[1]);
+        case NodeType::UNARY_OP:
+            return node->op == Op::NEG && isInvariant(node->children[0]);
+        default:
+            return false;
+    }
+}
+
+// Caches the largest invariant operator expressions under node, adding a
+// CLEAR_CACHE for each to clears.
+void Optimizer::hoist(ASTNodePtr node, std::vector<ASTNodePtr>& clears) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NodeType::FUNCTION_DECL:
+        case NodeType::CACHED:
+            return;
+        case NodeType::BINARY_OP:
+        case NodeType::UNARY_OP:
+            if (isInvariant(node)) {
+                ASTNodePtr expression = program->arena.make<ASTNode>(*node);
+                ASTNodePtr variable = hiddenVariable("$inv");
+                replace(node, *variable);
+                node->type = NodeType::CACHED;
+                node->children = program->arena.copy({expression});
+                
+                ASTNodePtr clear = program->arena.make<ASTNode>(*variable);
+                clear->type = NodeType::CLEAR_CACHE;
+                clears.push_back(clear);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        hoist(child, clears);
+    }
+}
+
+// A fresh variable no program can name: a local of the current function,
+// or a global at top level.
+ASTNodePtr Optimizer::hiddenVariable(const char* prefix) {
+    Symbol symbol = program->symbols->intern(prefix + std::to_string(hiddenCount++));
+    ASTNodePtr node = makeNode(NodeType::IDENTIFIER, {}, {});
+    node->symbol = symbol;
+    node->value = program->symbols->name(symbol);
+    if (function) {
+        std::vector<int> locals(function->localGlobals.begin(), function->localGlobals.end());
+        node->isLocal = true;
+        node->slot = static_cast<int32_t>(function->params.size() + locals.size());
+        locals.push_back(static_cast<int>(symbol));  // starts out nil, like the global
+        function->localGlobals = program->arena.copy(locals);
+    } else {
+        node->slot = static_cast<int32_t>(symbol);
+    }
+    return node;
+}
+
+ASTNodePtr Optimizer::makeNode(NodeType type, SourceLocation location, std::initializer_list<ASTNodePtr> children) {
+    ASTNodePtr node = program->arena.make<ASTNode>();
+    node->type = type;
+    node->location = location;
+    node->children = program->arena.copy(children);
+    return node;
+}
+
+void Optimizer::replace(ASTNodePtr node, const ASTNode& with) {
+    SourceLocation location = node->location;
+    *node = with;
+    node->location = location;
+}
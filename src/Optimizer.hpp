@@ -0,0 +1,63 @@
+#ifndef LFI3A_OPTIMIZER_HPP
+#define LFI3A_OPTIMIZER_HPP
+
+#include <utility>
+#include <vector>
+#include "AST.hpp"
+
+// AST pass run after Resolver, before either engine:
+//
+// - BINARY_OP/UNARY_OP nodes whose operands are literals are folded into
+//   a literal, unless evaluating them would be a runtime error.
+// - A global that is written exactly once, by a top-level `dir` with a
+//   constant value, is replaced by that value wherever it is read after
+//   the declaration.
+// - IF branches and WHILE/FOR loops with constant conditions are pruned.
+// - Inside a loop, an expression that reads nothing the loop writes is
+//   CACHED: computed on first use and reused until the loop is entered
+//   again. Only the same frame can write a variable, so calls in the loop
+//   cannot invalidate it. Elements are another matter: in a script with
+//   array or map literals, a loop that may store into an array or a map
+//   (a[i] = v, push, delete, or any call) caches nothing. The same goes for
+//   every script when the host can hand it arrays and maps (see Lfi3a.hpp).
+// - In a kol loop that starts its counter at a literal and steps it by a
+//   constant, K * i becomes a hidden variable that is updated by K * step
+//   next to the counter.
+class Optimizer {
+public:
+    void optimize(Program& program, bool hostContainers = false);
+
+private:
+    Program* program = nullptr;
+    std::vector<int> writes;               // Symbol -> number of assignments to it
+    std::vector<ASTNodePtr> constants;     // Symbol -> literal it always holds, or null
+    FunctionInfo* function = nullptr;      // function whose loops are rewritten, null at top level
+    std::vector<std::pair<bool, int32_t>> loopWrites;  // (isLocal, slot) of variables the loop assigns
+    int hiddenCount = 0;
+    bool usesContainers = false;           // the program has an array or map literal, or the host one
+    
+    void countWrites(ASTNodePtr node);
+    ASTNodePtr statement(ASTNodePtr node);
+    void statements(Span<ASTNodePtr>& list);
+    void expression(ASTNodePtr node);
+    ASTNodePtr ifStatement(ASTNodePtr node);
+    
+    ASTNodePtr loops(ASTNodePtr node);
+    ASTNodePtr loop(ASTNodePtr node);
+    void reduceStrength(ASTNodePtr node);
+    bool inductionStep(ASTNodePtr increment, ASTNodePtr counter, double& step);
+    void replaceInduction(ASTNodePtr node, ASTNodePtr counter, std::vector<std::pair<double, ASTNodePtr>>& derived);
+    void collectWrites(ASTNodePtr node);
+    bool isWrittenInLoop(ASTNodePtr variable);
+    bool isInvariant(ASTNodePtr node);
+    void hoist(ASTNodePtr node, std::vector<ASTNodePtr>& clears);
+    ASTNodePtr hiddenVariable(const char* prefix);
+    ASTNodePtr makeNode(NodeType type, SourceLocation location, std::initializer_list<ASTNodePtr> children);
+    void replace(ASTNodePtr node, const ASTNode& with);  // keeps node's location
+    
+    bool constantValue(ASTNodePtr node, Value& out);
+    bool fold(ASTNodePtr node);
+    void setLiteral(ASTNodePtr node, const Value& value);
+};
+
+#endif
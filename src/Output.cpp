@@ -0,0 +1,78 @@
+#include "Output.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define LFI3A_HAVE_UNISTD 1
+#endif
+
+Output::Output(Flush policy, size_t limit, Sink sink) : policy(policy), limit(limit), sink(std::move(sink)) {
+    if (policy == Flush::AUTO && this->sink) {
+        this->policy = Flush::BYTES;
+    } else if (policy == Flush::AUTO) {
+#ifdef LFI3A_HAVE_UNISTD
+        this->policy = isatty(STDOUT_FILENO) ? Flush::LINE : Flush::BYTES;
+#else
+        this->policy = Flush::BYTES;
+#endif
+    }
+    if (this->policy == Flush::BYTES) buffer.reserve(limit + 256);
+}
+
+Output::~Output() {
+    flush();
+}
+
+void Output::write(const Value& value) {
+    switch (value.type()) {
+        case Value::Type::NUMBER: {
+            char buf[32];
+            buffer.append(buf, formatNumber(value.asNumber(), buf, sizeof(buf)));
+            break;
+        }
+        case Value::Type::BOOLEAN:
+            buffer.append(value.asBoolean() ? "s7i7" : "ghalat");
+            break;
+        case Value::Type::STRING:
+            buffer.append(value.asString());
+            break;
+        case Value::Type::ARRAY:
+        case Value::Type::MAP:
+            buffer.append(value.toString());
+            break;
+        case Value::Type::NIL:
+            break;
+    }
+}
+
+void Output::flush() {
+    if (buffer.empty()) return;
+    if (sink) {
+        sink(buffer);
+        writes++;
+        buffer.clear();
+        return;
+    }
+    
+#ifdef LFI3A_HAVE_UNISTD
+    const char* p = buffer.data();
+    size_t left = buffer.size();
+    while (left > 0) {
+        ssize_t n = ::write(STDOUT_FILENO, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        writes++;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+#else
+    std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+    std::fflush(stdout);
+    writes++;
+#endif
+    buffer.clear();
+}
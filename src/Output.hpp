@@ -0,0 +1,55 @@
+#ifndef LFI3A_OUTPUT_HPP
+#define LFI3A_OUTPUT_HPP
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include "Value.hpp"
+
+// Buffered writer for kteb output on stdout, or on a sink given instead.
+// The buffer is handed over according to the flush policy, and always
+// before anything is written to stderr and when the Output is destroyed.
+class Output {
+public:
+    enum class Flush {
+        AUTO,    // LINE when stdout is a terminal, BYTES otherwise
+        AT_EXIT, // only when flushed explicitly or destroyed
+        BYTES,   // whenever a line leaves at least `limit` bytes buffered
+        LINE     // after every line
+    };
+
+    static constexpr size_t DEFAULT_LIMIT = 64 * 1024;
+
+    // Takes each flushed chunk in place of stdout. It must not throw, as
+    // the destructor flushes too. AUTO means BYTES with a sink.
+    using Sink = std::function<void(std::string_view)>;
+
+    explicit Output(Flush policy = Flush::AUTO, size_t limit = DEFAULT_LIMIT, Sink sink = nullptr);
+    ~Output();
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void write(std::string_view text) { buffer.append(text); }
+    void write(char c) { buffer.push_back(c); }
+    void write(const Value& value);
+
+    // Ends a line and flushes if the policy asks for it.
+    void endLine() {
+        buffer.push_back('\n');
+        if (policy == Flush::LINE || (policy == Flush::BYTES && buffer.size() >= limit)) flush();
+    }
+
+    void flush();
+
+    Flush flushPolicy() const { return policy; }
+    size_t writeCalls() const { return writes; }  // write(2) calls so far
+
+private:
+    std::string buffer;
+    Flush policy;
+    size_t limit;
+    Sink sink;
+    size_t writes = 0;
+};
+
+#endif
@@ -1,20 +1,32 @@
 #include "Parser.hpp"
-#include <iostream>
+#include "Error.hpp"
 #include <stdexcept>
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), pos(0) {}
+static SourceLocation locationOf(const Token& token) {
+    return {static_cast<uint32_t>(token.line), static_cast<uint32_t>(token.column)};
+}
+
+Parser::Parser(Lexer& lexer, std::shared_ptr<SymbolTable> symbols)
+    : lexer(lexer), symbols(std::move(symbols)) {}
 
-Token Parser::peek() {
-    return pos < tokens.size() ? tokens[pos] : tokens.back();
+const Token& Parser::peek(size_t offset) {
+    while (count <= offset) {
+        lookahead[(head + count) & (LOOKAHEAD - 1)] = lexer.next();
+        count++;
+    }
+    return lookahead[(head + offset) & (LOOKAHEAD - 1)];
 }
 
-Token Parser::peekNext() {
-    return pos + 1 < tokens.size() ? tokens[pos + 1] : tokens.back();
+const Token& Parser::peekNext() {
+    return peek(1);
 }
 
 Token Parser::advance() {
     Token t = peek();
-    if (pos < tokens.size()) pos++;
+    if (t.type != END) {
+        head = (head + 1) & (LOOKAHEAD - 1);
+        count--;
+    }
     return t;
 }
 
@@ -32,11 +44,67 @@ bool Parser::check(TokenType type) {
 
 Token Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
-    std::cerr << "Error: " << message << " at token: " << peek().value << std::endl;
-    exit(1);
+    throw ScriptError(message + " at token: " + std::string(peek().value));
+}
+
+ASTNodePtr Parser::makeNode(NodeType type, const Token& start) {
+    ASTNodePtr node = program->arena.make<ASTNode>();
+    node->type = type;
+    node->location = locationOf(start);
+    return node;
 }
 
-std::vector<ASTNodePtr> Parser::parse() {
+ASTNodePtr Parser::makeNamed(NodeType type, const Token& name) {
+    ASTNodePtr node = makeNode(type, name);
+    node->symbol = name.symbol;
+    node->value = symbols->name(name.symbol);
+    return node;
+}
+
+ASTNodePtr Parser::makeBinary(Op op, ASTNodePtr left, ASTNodePtr right) {
+    ASTNodePtr node = program->arena.make<ASTNode>();
+    node->type = NodeType::BINARY_OP;
+    node->op = op;
+    node->location = left->location;
+    node->children = program->arena.copy({left, right});
+    return node;
+}
+
+ASTNodePtr Parser::makeUnary(Op op, ASTNodePtr operand, SourceLocation location) {
+    ASTNodePtr node = program->arena.make<ASTNode>();
+    node->type = NodeType::UNARY_OP;
+    node->op = op;
+    node->location = location;
+    node->children = program->arena.copy({operand});
+    return node;
+}
+
+Op Parser::binaryOp(TokenType type) {
+    switch (type) {
+        case PLUS:
+        case PLUS_EQUAL: return Op::ADD;
+        case MINUS:
+        case MINUS_EQUAL: return Op::SUB;
+        case STAR:
+        case STAR_EQUAL: return Op::MUL;
+        case SLASH:
+        case SLASH_EQUAL: return Op::DIV;
+        case EQ_EQ: return Op::EQ;
+        case NOT_EQ: return Op::NE;
+        case LT: return Op::LT;
+        case GT: return Op::GT;
+        case LE: return Op::LE;
+        case GE: return Op::GE;
+        case W: return Op::AND;
+        case WLA: return Op::OR;
+        default: return Op::NONE;
+    }
+}
+
+Program Parser::parse() {
+    Program result;
+    result.symbols = symbols;
+    program = &result;
     std::vector<ASTNodePtr> nodes;
     
     while (!check(END)) {
@@ -47,7 +115,9 @@ std::vector<ASTNodePtr> Parser::parse() {
         while (match(SEMICOLON)) {}
     }
     
-    return nodes;
+    result.statements = std::move(nodes);
+    program = nullptr;
+    return result;
 }
 
 ASTNodePtr Parser::statement() {
@@ -72,6 +142,7 @@ ASTNodePtr Parser::statement() {
         case RJE3:
             return returnStatement();
         case LBRACE:
+            advance();
             return block();
         default:
             return assignmentOrExpression();
@@ -79,42 +150,42 @@ ASTNodePtr Parser::statement() {
 }
 
 ASTNodePtr Parser::varDeclaration() {
-    consume(DIR, "Expected 'dir'");
+    Token keyword = consume(DIR, "Expected 'dir'");
     Token name = consume(IDENT, "Expected variable name");
     
     consume(EQUAL, "Expected '=' in variable declaration");
     
     ASTNodePtr value = expression();
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::VAR_DECL;
-    node->value = name.value;
-    node->children.push_back(value);
+    ASTNodePtr node = makeNamed(NodeType::VAR_DECL, name);
+    node->location = locationOf(keyword);
+    node->children = program->arena.copy({value});
     
     return node;
 }
 
 ASTNodePtr Parser::printStatement() {
-    consume(KTEB, "Expected 'kteb'");
+    Token keyword = consume(KTEB, "Expected 'kteb'");
     consume(LPAREN, "Expected '(' after kteb");
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::PRINT;
+    ASTNodePtr node = makeNode(NodeType::PRINT, keyword);
+    std::vector<ASTNodePtr> args;
     
     if (!check(RPAREN)) {
-        node->children.push_back(expression());
+        args.push_back(expression());
         while (match(COMMA)) {
-            node->children.push_back(expression());
+            args.push_back(expression());
         }
     }
     
     consume(RPAREN, "Expected ')' after kteb arguments");
     
+    node->children = program->arena.copy(args);
     return node;
 }
 
 ASTNodePtr Parser::ifStatement() {
-    consume(ILA, "Expected 'ila'");
+    Token keyword = consume(ILA, "Expected 'ila'");
     consume(LPAREN, "Expected '(' after ila");
     
     ASTNodePtr condition = expression();
@@ -124,14 +195,12 @@ ASTNodePtr Parser::ifStatement() {
     
     ASTNodePtr thenBlock = block();
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::IF;
-    node->children.push_back(condition);
-    node->children.push_back(thenBlock);
+    ASTNodePtr node = makeNode(NodeType::IF, keyword);
+    std::vector<ASTNodePtr> branches{condition, thenBlock};
     
     // Handle wila (else if) and wla (else)
     while (peek().type == WILA) {
-        advance();
+        Token elseif = advance();
         consume(LPAREN, "Expected '(' after wila");
         
         ASTNodePtr elseifCond = expression();
@@ -141,12 +210,10 @@ ASTNodePtr Parser::ifStatement() {
         
         ASTNodePtr elseifBlock = block();
         
-        auto elseifNode = std::make_shared<ASTNode>();
-        elseifNode->type = NodeType::IF;
-        elseifNode->children.push_back(elseifCond);
-        elseifNode->children.push_back(elseifBlock);
+        ASTNodePtr elseifNode = makeNode(NodeType::IF, elseif);
+        elseifNode->children = program->arena.copy({elseifCond, elseifBlock});
         
-        node->children.push_back(elseifNode);
+        branches.push_back(elseifNode);
     }
     
     if (peek().type == WLA && peekNext().type != W) { // wla alone means else
@@ -154,14 +221,15 @@ ASTNodePtr Parser::ifStatement() {
         consume(LBRACE, "Expected '{' for else block");
         
         ASTNodePtr elseBlock = block();
-        node->children.push_back(elseBlock);
+        branches.push_back(elseBlock);
     }
     
+    node->children = program->arena.copy(branches);
     return node;
 }
 
 ASTNodePtr Parser::whileStatement() {
-    consume(MA7AD, "Expected 'ma7ad'");
+    Token keyword = consume(MA7AD, "Expected 'ma7ad'");
     consume(LPAREN, "Expected '(' after ma7ad");
     
     ASTNodePtr condition = expression();
@@ -171,16 +239,14 @@ ASTNodePtr Parser::whileStatement() {
     
     ASTNodePtr body = block();
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::WHILE;
-    node->children.push_back(condition);
-    node->children.push_back(body);
+    ASTNodePtr node = makeNode(NodeType::WHILE, keyword);
+    node->children = program->arena.copy({condition, body});
     
     return node;
 }
 
 ASTNodePtr Parser::forStatement() {
-    consume(KOL, "Expected 'kol'");
+    Token keyword = consume(KOL, "Expected 'kol'");
     consume(LPAREN, "Expected '(' after kol");
     
     // Parse init
@@ -198,56 +264,54 @@ ASTNodePtr Parser::forStatement() {
     consume(LBRACE, "Expected '{' for for block");
     ASTNodePtr body = block();
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::FOR;
-    node->children.push_back(init);
-    node->children.push_back(condition);
-    node->children.push_back(increment);
-    node->children.push_back(body);
+    ASTNodePtr node = makeNode(NodeType::FOR, keyword);
+    node->children = program->arena.copy({init, condition, increment, body});
     
     return node;
 }
 
 ASTNodePtr Parser::functionDeclaration() {
-    consume(DALLA, "Expected 'dalla'");
+    Token keyword = consume(DALLA, "Expected 'dalla'");
     Token name = consume(IDENT, "Expected function name");
     
     consume(LPAREN, "Expected '(' after function name");
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::FUNCTION_DECL;
-    node->value = name.value;
+    ASTNodePtr node = makeNamed(NodeType::FUNCTION_DECL, name);
+    node->location = locationOf(keyword);
+    node->function = program->arena.make<FunctionInfo>();
     
     // Parse parameters
+    std::vector<Symbol> params;
     if (!check(RPAREN)) {
-        node->params.push_back(consume(IDENT, "Expected parameter name").value);
+        params.push_back(consume(IDENT, "Expected parameter name").symbol);
         while (match(COMMA)) {
-            node->params.push_back(consume(IDENT, "Expected parameter name").value);
+            params.push_back(consume(IDENT, "Expected parameter name").symbol);
         }
     }
     
     consume(RPAREN, "Expected ')' after parameters");
     consume(LBRACE, "Expected '{' for function body");
     
-    node->body = block();
+    node->function->params = program->arena.copy(params);
+    node->function->body = block();
     
     return node;
 }
 
 ASTNodePtr Parser::returnStatement() {
-    consume(RJE3, "Expected 'rje3'");
+    Token keyword = consume(RJE3, "Expected 'rje3'");
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::RETURN;
+    ASTNodePtr node = makeNode(NodeType::RETURN, keyword);
     
     if (!check(SEMICOLON) && !check(RBRACE)) {
-        node->children.push_back(expression());
+        node->children = program->arena.copy({expression()});
     }
     
     return node;
 }
 
 ASTNodePtr Parser::block() {
+    Token start = peek();
     std::vector<ASTNodePtr> statements;
     
     while (!check(RBRACE) && !check(END)) {
@@ -259,9 +323,8 @@ ASTNodePtr Parser::block() {
     
     if (check(RBRACE)) advance();
     
-    auto node = std::make_shared<ASTNode>();
-    node->type = NodeType::BLOCK;
-    node->children = statements;
+    ASTNodePtr node = makeNode(NodeType::BLOCK, start);
+    node->children = program->arena.copy(statements);
     
     return node;
 }
@@ -269,14 +332,37 @@ ASTNodePtr Parser::block() {
 ASTNodePtr Parser::assignmentOrExpression() {
     ASTNodePtr expr = expression();
     
-    // Check for assignment
-    if (match(EQUAL)) {
+    // Check for assignment, plain or compound (+=, -=, *=, /=)
+    TokenType type = peek().type;
+    bool compound = type == PLUS_EQUAL || type == MINUS_EQUAL || type == STAR_EQUAL || type == SLASH_EQUAL;
+    if (compound || check(EQUAL)) {
+        advance();
+        Op op = compound ? binaryOp(type) : Op::NONE;
+        if (expr->type == NodeType::INDEX) {
+            // a[i] = v keeps a and i as they are; a[i] += v evaluates them
+            // once, and the op on the node says what to do with a[i] and v
+            ASTNodePtr node = program->arena.make<ASTNode>();
+            node->type = NodeType::SET_INDEX;
+            node->op = op;
+            node->location = expr->location;
+            node->children = program->arena.copy({expr->children[0], expr->children[1], expression()});
+            return node;
+        }
+        if (expr->type != NodeType::IDENTIFIER) {
+            throw ScriptError("Invalid assignment target");
+        }
         ASTNodePtr value = expression();
+        if (compound) {
+            // x += v is x = x + v, the variable read before v
+            value = makeBinary(op, expr, value);
+        }
         
-        auto node = std::make_shared<ASTNode>();
+        ASTNodePtr node = program->arena.make<ASTNode>();
         node->type = NodeType::ASSIGNMENT;
-        node->value = expr->value; // Variable name
-        node->children.push_back(value);
+        node->location = expr->location;
+        node->symbol = expr->symbol; // Variable name
+        node->value = expr->value;
+        node->children = program->arena.copy({value});
         
         return node;
     }
@@ -292,15 +378,9 @@ ASTNodePtr Parser::logicalOr() {
     ASTNodePtr expr = logicalAnd();
     
     while (peek().type == WLA && peekNext().type != W) { // wla alone is or
-        Token op = advance();
+        Op op = binaryOp(advance().type);
         ASTNodePtr right = logicalAnd();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BINARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        node->children.push_back(right);
-        expr = node;
+        expr = makeBinary(op, expr, right);
     }
     
     return expr;
@@ -310,15 +390,9 @@ ASTNodePtr Parser::logicalAnd() {
     ASTNodePtr expr = equality();
     
     while (peek().type == W) {
-        Token op = advance();
+        Op op = binaryOp(advance().type);
         ASTNodePtr right = equality();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BINARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        node->children.push_back(right);
-        expr = node;
+        expr = makeBinary(op, expr, right);
     }
     
     return expr;
@@ -328,15 +402,9 @@ ASTNodePtr Parser::equality() {
     ASTNodePtr expr = comparison();
     
     while (peek().type == EQ_EQ || peek().type == NOT_EQ) {
-        Token op = advance();
+        Op op = binaryOp(advance().type);
         ASTNodePtr right = comparison();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BINARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        node->children.push_back(right);
-        expr = node;
+        expr = makeBinary(op, expr, right);
     }
     
     return expr;
@@ -346,15 +414,9 @@ ASTNodePtr Parser::comparison() {
     ASTNodePtr expr = addition();
     
     while (peek().type == LT || peek().type == GT || peek().type == LE || peek().type == GE) {
-        Token op = advance();
+        Op op = binaryOp(advance().type);
         ASTNodePtr right = addition();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BINARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        node->children.push_back(right);
-        expr = node;
+        expr = makeBinary(op, expr, right);
     }
     
     return expr;
@@ -364,15 +426,9 @@ ASTNodePtr Parser::addition() {
     ASTNodePtr expr = multiplication();
     
     while (peek().type == PLUS || peek().type == MINUS) {
-        Token op = advance();
+        Op op = binaryOp(advance().type);
         ASTNodePtr right = multiplication();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BINARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        node->children.push_back(right);
-        expr = node;
+        expr = makeBinary(op, expr, right);
     }
     
     return expr;
@@ -382,15 +438,9 @@ ASTNodePtr Parser::multiplication() {
     ASTNodePtr expr = unary();
     
     while (peek().type == STAR || peek().type == SLASH) {
-        Token op = advance();
+        Op op = binaryOp(advance().type);
         ASTNodePtr right = unary();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BINARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        node->children.push_back(right);
-        expr = node;
+        expr = makeBinary(op, expr, right);
     }
     
     return expr;
@@ -398,15 +448,9 @@ ASTNodePtr Parser::multiplication() {
 
 ASTNodePtr Parser::unary() {
     if (peek().type == MINUS) {
-        Token op = advance();
+        Token minus = advance();
         ASTNodePtr expr = unary();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::UNARY_OP;
-        node->op = op.value;
-        node->children.push_back(expr);
-        
-        return node;
+        return makeUnary(Op::NEG, expr, locationOf(minus));
     }
     
     return postfix();
@@ -415,44 +459,49 @@ ASTNodePtr Parser::unary() {
 ASTNodePtr Parser::postfix() {
     ASTNodePtr expr = primary();
     
-    while (peek().type == PLUS_PLUS) {
-        Token op = advance();
-        
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::UNARY_OP;
-        node->op = "post++";
-        node->children.push_back(expr);
-        expr = node;
+    for (;;) {
+        if (match(LBRACKET)) {
+            ASTNodePtr index = expression();
+            consume(RBRACKET, "Expected ']' after index");
+            ASTNodePtr node = program->arena.make<ASTNode>();
+            node->type = NodeType::INDEX;
+            node->location = expr->location;
+            node->children = program->arena.copy({expr, index});
+            expr = node;
+        } else if (match(PLUS_PLUS)) {
+            expr = makeUnary(Op::POST_INC, expr, expr->location);
+        } else {
+            return expr;
+        }
     }
-    
-    return expr;
 }
 
 ASTNodePtr Parser::primary() {
     // Numbers
     if (peek().type == NUMBER) {
         Token num = advance();
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::NUMBER;
-        node->value = num.value;
+        ASTNodePtr node = makeNode(NodeType::NUMBER, num);
+        node->value = program->arena.copy(num.value);
+        parseNumber(num.value, node->number);
         return node;
     }
     
     // Strings
     if (peek().type == STRING) {
         Token str = advance();
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::STRING;
-        node->value = str.value;
+        ASTNodePtr node = makeNode(NodeType::STRING, str);
+        node->value = program->arena.copy(str.value);
+        node->slot = static_cast<int32_t>(program->strings.size());
+        program->strings.push_back(Value::string(std::string(str.value)));
         return node;
     }
     
     // Booleans
     if (peek().type == S7I7 || peek().type == GHALAT) {
         Token bool_tok = advance();
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::BOOLEAN;
-        node->value = bool_tok.value;
+        ASTNodePtr node = makeNode(NodeType::BOOLEAN, bool_tok);
+        node->value = program->arena.copy(bool_tok.value);
+        node->number = bool_tok.type == S7I7 ? 1 : 0;
         return node;
     }
     
@@ -464,26 +513,63 @@ ASTNodePtr Parser::primary() {
         if (peek().type == LPAREN) {
             advance();
             
-            auto node = std::make_shared<ASTNode>();
-            node->type = NodeType::CALL;
-            node->value = ident.value;
+            ASTNodePtr node = makeNamed(NodeType::CALL, ident);
             
+            std::vector<ASTNodePtr> args;
             if (!check(RPAREN)) {
-                node->children.push_back(expression());
+                args.push_back(expression());
                 while (match(COMMA)) {
-                    node->children.push_back(expression());
+                    args.push_back(expression());
                 }
             }
             
             consume(RPAREN, "Expected ')' after function arguments");
             
+            node->children = program->arena.copy(args);
             return node;
         }
         
         // Just an identifier
-        auto node = std::make_shared<ASTNode>();
-        node->type = NodeType::IDENTIFIER;
-        node->value = ident.value;
+        ASTNodePtr node = makeNamed(NodeType::IDENTIFIER, ident);
+        return node;
+    }
+    
+    // Array literals
+    if (peek().type == LBRACKET) {
+        Token open = advance();
+        ASTNodePtr node = makeNode(NodeType::ARRAY, open);
+        
+        std::vector<ASTNodePtr> elements;
+        if (!check(RBRACKET)) {
+            elements.push_back(expression());
+            while (match(COMMA)) {
+                elements.push_back(expression());
+            }
+        }
+        
+        consume(RBRACKET, "Expected ']' after array elements");
+        
+        node->children = program->arena.copy(elements);
+        return node;
+    }
+    
+    // Map literals: keys and values alternate in children
+    if (peek().type == LBRACE) {
+        Token open = advance();
+        ASTNodePtr node = makeNode(NodeType::MAP, open);
+        
+        std::vector<ASTNodePtr> entries;
+        if (!check(RBRACE)) {
+            do {
+                entries.push_back(expression());
+                consume(COLON, "Expected ':' after map key");
+                entries.push_back(expression());
+            } while (match(COMMA));
+        }
+        
+        consume(RBRACE, "Expected '}' after map entries");
+        
+        node->children = program->arena.copy(entries);
         return node;
     }
     
@@ -495,6 +581,5 @@ ASTNodePtr Parser::primary() {
         return expr;
     }
     
-    std::cerr << "Error: Unexpected token: " << peek().value << std::endl;
-    exit(1);
+    throw ScriptError("Unexpected token: " + std::string(peek().value));
 }
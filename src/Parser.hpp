@@ -1,27 +1,34 @@
 #ifndef LFI3A_PARSER_HPP
 #define LFI3A_PARSER_HPP
 
-#include <vector>
 #include <memory>
 #include "Lexer.hpp"
 #include "AST.hpp"
 
+// Pulls tokens from the lexer on demand. Only the few tokens of
+// lookahead the grammar needs are buffered, so memory does not grow with
+// the size of the script.
 class Parser {
 public:
-    Parser(const std::vector<Token>& tokens);
-    std::vector<ASTNodePtr> parse();
+    Parser(Lexer& lexer, std::shared_ptr<SymbolTable> symbols);
+    Program parse();
 
 private:
-    std::vector<Token> tokens;
-    size_t pos = 0;
+    static constexpr size_t LOOKAHEAD = 4;  // power of two, at least 2
 
-    Token peek();
-    Token peekNext();
+    Lexer& lexer;
+    std::shared_ptr<SymbolTable> symbols;
+    Token lookahead[LOOKAHEAD];
+    size_t head = 0;   // index of the current token in lookahead
+    size_t count = 0;  // tokens buffered from head on
+    Program* program = nullptr;
+
+    const Token& peek(size_t offset = 0);
+    const Token& peekNext();
     Token advance();
     bool match(TokenType type);
     bool check(TokenType type);
     Token consume(TokenType type, const std::string& message);
-    Token peekNext() const;
     
     ASTNodePtr statement();
     ASTNodePtr declaration();
@@ -45,6 +52,12 @@ private:
     ASTNodePtr unary();
     ASTNodePtr postfix();
     ASTNodePtr primary();
+    
+    ASTNodePtr makeNode(NodeType type, const Token& start);
+    ASTNodePtr makeNamed(NodeType type, const Token& name);
+    ASTNodePtr makeBinary(Op op, ASTNodePtr left, ASTNodePtr right);
+    ASTNodePtr makeUnary(Op op, ASTNodePtr operand, SourceLocation location);
+    Op binaryOp(TokenType type);
 };
 
 #endif
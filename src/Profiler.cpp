@@ -0,0 +1,156 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+Profiler::Profiler(std::string_view source, const SymbolTable& symbols)
+    : source(source), symbols(symbols), functions(symbols.size() + 1) {
+    lineStarts.push_back(0);
+    for (const char* p = source.data(), *end = p + source.size();
+         (p = static_cast<const char*>(std::memchr(p, '\n', end - p))); ++p) {
+        lineStarts.push_back(p + 1 - source.data());
+    }
+    lines.resize(lineStarts.size() + 1);
+
+    // Every timed span includes one clock read, which matters when it is
+    // multiplied by the sample period
+    readCost = UINT64_MAX;
+    for (int i = 0; i < 16; ++i) {
+        uint64_t first = ticks();
+        readCost = std::min(readCost, ticks() - first);
+    }
+
+    functions[0].count = 1;
+    startTime = std::chrono::steady_clock::now();
+    startTicks = ticks();
+    startSample(startTicks, 1);
+}
+
+void Profiler::switchLine(uint32_t line) {
+    uint64_t now = ticks();
+    endSample(now);
+    current = line;
+    if (countdown == 0) startSample(now, SAMPLE_PERIOD);
+}
+
+// The clock has been read anyway, so the time up to the next event is
+// measured exactly.
+void Profiler::enter(Symbol callee) {
+    uint64_t now = ticks();
+    endSample(now);
+    calls.push_back({function, current, now});
+    ++lines[current].callers;
+    function = callee + 1;
+    ++functions[function].count;
+    ++functions[function].callers;
+    current = 0;
+    startSample(now, 1);
+}
+
+void Profiler::leave() {
+    if (calls.empty()) return;
+    uint64_t now = ticks();
+    endSample(now);
+    const Call& call = calls.back();
+    if (--functions[function].callers == 0) functions[function].total += now - call.start;
+    if (--lines[call.line].callers == 0) lines[call.line].total += now - call.start;
+    function = call.function;
+    current = call.line;
+    calls.pop_back();
+    startSample(now, 1);
+}
+
+void Profiler::startSample(uint64_t now, uint64_t weight) {
+    sampleStart = now;
+    sampleWeight = weight;
+    if (countdown == 0) {
+        // xorshift; periods from 1 to 2 * SAMPLE_PERIOD - 1
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        countdown = 1 + random % (2 * SAMPLE_PERIOD - 1);
+    }
+}
+
+void Profiler::endSample(uint64_t now) {
+    if (sampleStart == 0) return;
+    uint64_t span = now - sampleStart;
+    uint64_t time = (span > readCost ? span - readCost : 0) * sampleWeight;
+    lines[current].self += time;
+    functions[function].self += time;
+    // Otherwise the call that put the line on the stack covers it
+    if (lines[current].callers == 0) lines[current].total += time;
+    sampleStart = 0;
+}
+
+std::string_view Profiler::lineText(uint32_t line) const {
+    size_t start = lineStarts[line - 1];
+    size_t end = line < lineStarts.size() ? lineStarts[line] - 1 : source.size();
+    std::string_view text = source.substr(start, end - start);
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    return text.substr(0, 60);
+}
+
+void Profiler::report(std::ostream& out) {
+    while (!calls.empty()) {
+        leave();
+    }
+    uint64_t now = ticks();
+    endSample(now);
+    functions[0].total = now - startTicks;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double msPerTick = now > startTicks ? seconds * 1000 / (now - startTicks) : 0;
+    char row[128];
+    std::snprintf(row, sizeof(row), "profile: %.3f s, line times sampled\n", seconds);
+    out << row;
+
+    std::vector<uint32_t> order;
+    for (uint32_t i = 1; i < lines.size(); ++i) {
+        if (lines[i].count > 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return lines[a].self != lines[b].self ? lines[a].self > lines[b].self : a < b;
+    });
+    out << "    line        count     self ms    total ms  source\n";
+    for (size_t i = 0; i < order.size() && i < REPORT_LINES; ++i) {
+        const Entry& entry = lines[order[i]];
+        std::snprintf(row, sizeof(row), "%8u %12llu %11.2f %11.2f  ", order[i],
+                      static_cast<unsigned long long>(entry.count), entry.self * msPerTick, entry.total * msPerTick);
+        out << row << lineText(order[i]) << "\n";
+    }
+    if (order.size() > REPORT_LINES) {
+        out << "    (" << order.size() - REPORT_LINES << " more lines)\n";
+    }
+
+    order.clear();
+    for (uint32_t i = 0; i < functions.size(); ++i) {
+        if (functions[i].count > 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return functions[a].self != functions[b].self ? functions[a].self > functions[b].self : a < b;
+    });
+    out << "function              calls     self ms    total ms\n";
+    for (uint32_t i : order) {
+        const Entry& entry = functions[i];
+        std::string name = i == 0 ? "<script>" : std::string(symbols.name(i - 1));
+        std::snprintf(row, sizeof(row), "%-16s %10llu %11.2f %11.2f\n", name.c_str(),
+                      static_cast<unsigned long long>(entry.count), entry.self * msPerTick, entry.total * msPerTick);
+        out << row;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef LFI3A_PROFILER_HPP
+#define LFI3A_PROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+#include "Symbols.hpp"
+
+// Execution counts and times per source line and per function, for
+// --profile. Engines call line() as each statement starts and enter() and
+// leave() around each call.
+//
+// Counts are exact. The clock is read at every call and return, so call
+// times are exact too, but only about one line change in SAMPLE_PERIOD
+// reads it: the time until the next event is measured and weighted by the
+// period. The period varies randomly so that it cannot line up with a
+// loop. A statement on the same line as the previous one costs a counter
+// increment.
+//
+// A line's self time is the time it was running; its total time also
+// counts the calls it made. Functions are the same over their own lines
+// and their callees. Time inside a recursive call is not counted again
+// for a line or function already on the stack.
+class Profiler {
+public:
+    Profiler(std::string_view source, const SymbolTable& symbols);
+
+    void line(uint32_t line) {
+        if (line >= lines.size()) line = 0;
+        ++lines[line].count;
+        if (line == current) return;
+        if (--countdown != 0 && sampleStart == 0) {
+            current = line;
+            return;
+        }
+        switchLine(line);
+    }
+
+    void enter(Symbol function);
+    void leave();
+
+    // Ends the calls still running and prints both tables, slowest first.
+    // Call once, after the program has finished.
+    void report(std::ostream& out);
+
+private:
+    static constexpr uint32_t SAMPLE_PERIOD = 16;
+    static constexpr size_t REPORT_LINES = 20;
+
+    struct Entry {
+        uint64_t count = 0;   // statements started on the line, or calls
+        uint64_t self = 0;    // in ticks
+        uint64_t total = 0;
+        uint32_t callers = 0; // calls in progress from this line, or into this function
+    };
+    struct Call {
+        uint32_t function;
+        uint32_t line;   // the caller's line, resumed on return
+        uint64_t start;
+    };
+
+    std::string_view source;
+    const SymbolTable& symbols;
+    std::vector<size_t> lineStarts;  // offset of each line in source, from line 1
+    std::vector<Entry> lines;        // line 0 collects statements with no location
+    std::vector<Entry> functions;    // Symbol + 1; 0 is the script itself
+    std::vector<Call> calls;
+    uint32_t current = 0;            // running line
+    uint32_t function = 0;           // running function
+    uint32_t countdown = 1;          // line changes until the next sample
+    uint32_t random = 0x9e3779b9;
+    uint64_t sampleStart = 0;        // ticks when the running span began, if it is timed
+    uint64_t sampleWeight = 0;
+    uint64_t readCost = 0;           // ticks between two back-to-back clock reads
+    uint64_t startTicks = 0;
+    std::chrono::steady_clock::time_point startTime;
+
+    void switchLine(uint32_t line);
+    void startSample(uint64_t now, uint64_t weight);
+    void endSample(uint64_t now);
+    std::string_view lineText(uint32_t line) const;
+};
+
+#endif
@@ -0,0 +1,443 @@
+#include "ProgramCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define LFI3A_HAVE_GETPID 1
+#endif
+
+// Layout: Header, the node stream, then the text bytes that names and
+// literals point into.
+//
+// The stream holds the symbol names, the string literals, every node and
+// the top-level statements, with integers as LEB128 varints. Nodes are
+// written children first and refer to a child by how far back it is (0
+// for a missing one, which the Parser never leaves), which keeps the
+// numbers small and rules out cycles without any further check.
+namespace {
+
+constexpr char MAGIC[4] = {'L', 'F', '3', 'C'};
+constexpr uint32_t VERSION = 5;               // bump whenever the layout or ASTNode changes
+constexpr uint32_t ENDIAN_MARK = 0x01020304;  // caches from other architectures do not match
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t endianMark;
+    uint32_t nodes;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t payloadHash;
+    uint64_t streamSize;
+    uint64_t textSize;
+    uint32_t symbols;
+    uint32_t strings;
+    uint32_t statements;
+    uint32_t callSites;
+};
+
+// Node flags
+constexpr uint8_t IS_LOCAL = 1;
+constexpr uint8_t HAS_FUNCTION = 2;
+constexpr uint8_t HAS_NUMBER = 4;  // number is not 0
+constexpr uint8_t HAS_VALUE = 8;   // value is not empty
+constexpr uint8_t IN_PLACE = 16;
+
+// How many children each NodeType the Parser builds has. The Optimizer and
+// the engines index them without checking, so a node outside these bounds,
+// or with a missing child, must never load.
+struct Arity {
+    uint32_t min;
+    uint32_t max;
+};
+constexpr uint32_t ANY = UINT32_MAX;
+constexpr Arity ARITY[] = {
+    {0, 0},    // NUMBER
+    {0, 0},    // STRING
+    {0, 0},    // BOOLEAN
+    {0, 0},    // IDENTIFIER
+    {2, 2},    // BINARY_OP
+    {1, 1},    // UNARY_OP
+    {0, ANY},  // CALL: the arguments
+    {0, ANY},  // ARRAY
+    {2, 2},    // INDEX
+    {0, ANY},  // MAP: keys and values, so an even number
+    {1, 1},    // VAR_DECL
+    {0, ANY},  // PRINT
+    {2, ANY},  // IF: condition, block, then wila IFs and a wla block
+    {2, 2},    // WHILE
+    {4, 4},    // FOR: init, condition, increment, body
+    {0, 0},    // FUNCTION_DECL: the body hangs off the FunctionInfo
+    {0, 1},    // RETURN
+    {0, ANY},  // BLOCK
+    {1, 1},    // ASSIGNMENT
+    {3, 3},    // SET_INDEX
+};
+static_assert(sizeof(ARITY) / sizeof(ARITY[0]) == size_t(NodeType::SET_INDEX) + 1, "one Arity per NodeType stored");
+
+bool validChildren(NodeType type, Span<ASTNodePtr> children) {
+    const Arity& arity = ARITY[static_cast<size_t>(type)];
+    if (children.size() < arity.min || children.size() > arity.max) return false;
+    if (type == NodeType::MAP && children.size() % 2 != 0) return false;
+    for (size_t i = 0; i < children.size(); ++i) {
+        if (!children[i]) return false;
+        if (type == NodeType::IF && i >= 2 && children[i]->type != NodeType::IF &&
+            children[i]->type != NodeType::BLOCK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Type, op and flags bytes plus symbol, slot, site, line, column and
+// child count
+constexpr uint64_t MIN_NODE_SIZE = 9;
+
+// Not cryptographic; it only has to notice edits and damaged files.
+uint64_t hashBytes(const char* data, size_t size) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    if (size > i) std::memcpy(&tail, data + i, size - i);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 29);
+}
+
+// Slots and sites are usually -1 or small, so they are stored zigzagged
+uint32_t zigzag(int32_t n) {
+    return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
+
+int32_t unzigzag(uint32_t n) {
+    return static_cast<int32_t>((n >> 1) ^ (0u - (n & 1)));
+}
+
+class Writer {
+public:
+    Writer(const Program& program, std::string_view source) : program(program), source(source) {}
+
+    // The whole cache file, or "" if the program cannot be stored
+    std::string image() {
+        for (size_t i = 0; i < program.symbols->size(); ++i) {
+            text(program.symbols->name(static_cast<Symbol>(i)));
+        }
+        for (const Value& value : program.strings) {
+            if (!value.isString()) return std::string();
+            text(value.asString());
+        }
+        std::vector<uint32_t> statements;
+        for (ASTNodePtr node : program.statements) {
+            if (!node) return std::string();
+            statements.push_back(visit(node));
+        }
+        for (uint32_t index : statements) {
+            number(index);
+        }
+        // Offsets are 32 bits; a program too big for that is not cached
+        if (chars.size() > UINT32_MAX || nodes > UINT32_MAX) return std::string();
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.endianMark = ENDIAN_MARK;
+        header.nodes = static_cast<uint32_t>(nodes);
+        header.sourceHash = hashBytes(source.data(), source.size());
+        header.sourceSize = source.size();
+        header.streamSize = stream.size();
+        header.textSize = chars.size();
+        header.symbols = static_cast<uint32_t>(program.symbols->size());
+        header.strings = static_cast<uint32_t>(program.strings.size());
+        header.statements = static_cast<uint32_t>(statements.size());
+        header.callSites = program.callSites;
+
+        std::string result(sizeof(header), '\0');
+        result += stream;
+        result += chars;
+        header.payloadHash = hashBytes(result.data() + sizeof(header), result.size() - sizeof(header));
+        std::memcpy(&result[0], &header, sizeof(header));
+        return result;
+    }
+
+private:
+    const Program& program;
+    std::string_view source;
+    // Keyed by views of the program's own text, which outlives the Writer
+    std::unordered_map<std::string_view, uint32_t> textOffsets;
+    std::string stream;
+    std::string chars;
+    std::vector<uint32_t> pending;  // child indices of the nodes being visited
+    size_t nodes = 0;
+
+    // The Parser builds a tree, so each node is reached exactly once
+    uint32_t visit(ASTNodePtr node) {
+        size_t first = pending.size();
+        for (ASTNodePtr child : node->children) {
+            uint32_t index = child ? visit(child) : UINT32_MAX;
+            pending.push_back(index);
+        }
+        uint32_t body = UINT32_MAX;
+        if (node->function && node->function->body) body = visit(node->function->body);
+
+        uint32_t index = static_cast<uint32_t>(nodes++);
+        uint8_t flags = (node->isLocal ? IS_LOCAL : 0) | (node->function ? HAS_FUNCTION : 0) |
+                        (node->number != 0 ? HAS_NUMBER : 0) | (!node->value.empty() ? HAS_VALUE : 0) |
+                        (node->inPlace ? IN_PLACE : 0);
+        stream += static_cast<char>(node->type);
+        stream += static_cast<char>(node->op);
+        stream += static_cast<char>(flags);
+        number(node->symbol);
+        number(zigzag(node->slot));
+        number(zigzag(node->site));
+        number(node->location.line);
+        number(node->location.column);
+        if (flags & HAS_VALUE) text(node->value);
+        if (flags & HAS_NUMBER) stream.append(reinterpret_cast<const char*>(&node->number), sizeof(double));
+        number(static_cast<uint32_t>(pending.size() - first));
+        for (size_t c = first; c < pending.size(); ++c) {
+            number(distance(index, pending[c]));
+        }
+        pending.resize(first);
+        if (node->function) {
+            const FunctionInfo& function = *node->function;
+            number(static_cast<uint32_t>(function.params.size()));
+            for (Symbol param : function.params) {
+                number(param);
+            }
+            number(static_cast<uint32_t>(function.localGlobals.size()));
+            for (int global : function.localGlobals) {
+                number(static_cast<uint32_t>(global));
+            }
+            number(distance(index, body));
+            number(zigzag(function.memoSlot));
+        }
+        return index;
+    }
+
+    static uint32_t distance(uint32_t from, uint32_t to) {
+        return to == UINT32_MAX ? 0 : from - to;
+    }
+
+    void number(uint32_t n) {
+        while (n >= 0x80) {
+            stream += static_cast<char>((n & 0x7f) | 0x80);
+            n >>= 7;
+        }
+        stream += static_cast<char>(n);
+    }
+
+    // Each distinct text is stored once; names repeat a lot
+    void text(std::string_view s) {
+        auto inserted = textOffsets.emplace(s, static_cast<uint32_t>(chars.size()));
+        if (inserted.second) chars.append(s);
+        number(inserted.first->second);
+        number(static_cast<uint32_t>(s.size()));
+    }
+};
+
+// Decodes the stream. Every read is bounds-checked; after the first
+// failure, reads return 0 and `ok` stays false.
+class Reader {
+public:
+    Reader(const char* data, size_t size, std::string_view chars) : p(data), end(data + size), chars(chars) {}
+
+    bool ok = true;
+
+    bool atEnd() const { return p == end; }
+
+    uint8_t byte() {
+        if (p == end) return fail();
+        return static_cast<uint8_t>(*p++);
+    }
+
+    uint32_t number() {
+        uint32_t n = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p == end) return fail();
+            uint8_t b = static_cast<uint8_t>(*p++);
+            if (shift == 28 && b > 0x0f) return fail();
+            n |= static_cast<uint32_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return n;
+        }
+        return fail();
+    }
+
+    double real() {
+        double n = 0;
+        if (static_cast<size_t>(end - p) < sizeof(n)) return fail();
+        std::memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        return n;
+    }
+
+    std::string_view text() {
+        uint32_t offset = number();
+        uint32_t length = number();
+        if (uint64_t(offset) + length > chars.size()) {
+            fail();
+            return std::string_view();
+        }
+        return chars.substr(offset, length);
+    }
+
+private:
+    const char* p;
+    const char* end;
+    std::string_view chars;
+
+    uint32_t fail() {
+        ok = false;
+        p = end;
+        return 0;
+    }
+};
+
+}  // namespace
+
+std::string programCachePath(const std::string& sourcePath) {
+    return sourcePath + "c";
+}
+
+bool loadProgramCache(std::string_view image, std::string_view source, Program& result) {
+    Header header;
+    if (image.size() < sizeof(header)) return false;
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.endianMark != ENDIAN_MARK) {
+        return false;
+    }
+    if (header.sourceSize != source.size() || header.sourceHash != hashBytes(source.data(), source.size())) {
+        return false;
+    }
+    uint64_t payloadSize = image.size() - sizeof(header);
+    if (header.streamSize > payloadSize || header.textSize != payloadSize - header.streamSize) return false;
+    const char* payload = image.data() + sizeof(header);
+    if (header.payloadHash != hashBytes(payload, payloadSize)) return false;
+    // The header is not hashed, so check its counts before allocating for them
+    uint64_t minimumSize = uint64_t(header.nodes) * MIN_NODE_SIZE + (uint64_t(header.symbols) + header.strings) * 2 +
+                           header.statements;
+    if (minimumSize > header.streamSize) return false;
+
+    Reader in(payload, header.streamSize, std::string_view(payload + header.streamSize, header.textSize));
+    Program program;
+    program.symbols = std::make_shared<SymbolTable>();
+    for (uint32_t i = 0; i < header.symbols; ++i) {
+        // A repeated name would not get its own Symbol
+        if (program.symbols->intern(in.text()) != i || !in.ok) return false;
+    }
+    for (uint32_t i = 0; i < header.strings; ++i) {
+        program.strings.push_back(Value::string(std::string(in.text())));
+    }
+
+    std::vector<ASTNodePtr> nodes(header.nodes);
+    // A node `back` places before node i; false if that is not a node
+    auto earlier = [&](uint32_t i, uint32_t back, ASTNodePtr& node) {
+        if (back > i) return false;
+        node = back == 0 ? nullptr : nodes[i - back];
+        return true;
+    };
+    std::vector<ASTNodePtr> children;
+    std::vector<Symbol> params;
+    std::vector<int> locals;
+    for (uint32_t i = 0; i < header.nodes && in.ok; ++i) {
+        uint8_t type = in.byte();
+        uint8_t op = in.byte();
+        uint8_t flags = in.byte();
+        if (type > static_cast<uint8_t>(NodeType::SET_INDEX) || op > static_cast<uint8_t>(Op::POST_INC)) return false;
+
+        ASTNodePtr node = program.arena.make<ASTNode>();
+        node->type = static_cast<NodeType>(type);
+        node->op = static_cast<Op>(op);
+        node->isLocal = (flags & IS_LOCAL) != 0;
+        node->inPlace = (flags & IN_PLACE) != 0;
+        node->symbol = in.number();
+        node->slot = unzigzag(in.number());
+        node->site = unzigzag(in.number());
+        node->location.line = in.number();
+        node->location.column = in.number();
+        if (flags & HAS_VALUE) node->value = in.text();
+        if (flags & HAS_NUMBER) node->number = in.real();
+        if (node->symbol >= header.symbols && node->symbol != 0) return false;
+        if (node->type == NodeType::STRING && (node->slot < 0 || uint32_t(node->slot) >= header.strings)) return false;
+        if (node->site >= 0 && uint32_t(node->site) >= header.callSites) return false;
+
+        children.clear();
+        for (uint32_t c = in.number(); c > 0 && in.ok; --c) {
+            ASTNodePtr child;
+            if (!earlier(i, in.number(), child)) return false;
+            children.push_back(child);
+        }
+        node->children = program.arena.copy(children);
+        if (!validChildren(node->type, node->children)) return false;
+
+        if (flags & HAS_FUNCTION) {
+            params.clear();
+            for (uint32_t n = in.number(); n > 0 && in.ok; --n) {
+                Symbol param = in.number();
+                if (param >= header.symbols) return false;
+                params.push_back(param);
+            }
+            locals.clear();
+            for (uint32_t n = in.number(); n > 0 && in.ok; --n) {
+                uint32_t global = in.number();
+                if (global >= header.symbols) return false;
+                locals.push_back(static_cast<int>(global));
+            }
+            FunctionInfo* function = program.arena.make<FunctionInfo>();
+            function->params = program.arena.copy(params);
+            function->localGlobals = program.arena.copy(locals);
+            if (!earlier(i, in.number(), function->body) || !function->body) return false;
+            function->memoSlot = unzigzag(in.number());
+            node->function = function;
+        } else if (node->type == NodeType::FUNCTION_DECL) {
+            return false;
+        }
+        nodes[i] = node;
+    }
+
+    for (uint32_t s = 0; s < header.statements && in.ok; ++s) {
+        uint32_t index = in.number();
+        if (index >= header.nodes) return false;
+        program.statements.push_back(nodes[index]);
+    }
+    if (!in.ok || !in.atEnd()) return false;
+    program.callSites = header.callSites;
+
+    result = std::move(program);
+    return true;
+}
+
+void storeProgramCache(const std::string& path, std::string_view source, const Program& program) {
+    // Only what the Parser produces can be stored
+    if (!program.pureFunctions.empty()) return;
+    std::string image = Writer(program, source).image();
+    if (image.empty()) return;
+
+    // Write a private file, then rename it over the cache in one step
+    std::string temp = path + ".tmp";
+#ifdef LFI3A_HAVE_GETPID
+    temp += std::to_string(getpid());
+#endif
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file) return;
+        file.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if (!file.flush()) {
+            file.close();
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef LFI3A_PROGRAM_CACHE_HPP
+#define LFI3A_PROGRAM_CACHE_HPP
+
+#include <string>
+#include <string_view>
+#include "AST.hpp"
+
+// On-disk cache of parsed programs, so a script that has not changed since
+// its last run skips the Lexer and Parser. The cache of x.lfi3a is
+// x.lfi3ac: a versioned binary image of the Program as the Parser built
+// it, tagged with a hash of the source text. Resolver and the later passes
+// still run on every start, so one cache serves every combination of
+// options.
+
+// Where the cache of the script at `sourcePath` lives.
+std::string programCachePath(const std::string& sourcePath);
+
+// Rebuilds the program from `image`, the contents of a cache file, in one
+// pass that checks every index and offset, and that each node has the
+// children its type needs. Returns false, leaving
+// `program` untouched, if the cache is for other source text, from
+// another version, or damaged. Node text points into `image`, which must
+// outlive the program.
+bool loadProgramCache(std::string_view image, std::string_view source, Program& program);
+
+// Writes the cache of `program`, freshly parsed from `source`. The file is
+// replaced atomically, so concurrent runs never see half of one. Failures
+// are ignored: the next run simply parses again.
+void storeProgramCache(const std::string& path, std::string_view source, const Program& program);
+
+#endif
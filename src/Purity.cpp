@@ -0,0 +1,179 @@
+#include "Purity.hpp"
+
+void Purity::analyze(Program& program) {
+    declarations.clear();
+    declarationCount.assign(program.symbols->size(), 0);
+    indexOf.assign(program.symbols->size(), -1);
+    for (ASTNodePtr node : program.statements) {
+        collect(node);
+    }
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        Symbol name = declarations[i]->symbol;
+        if (declarationCount[name] == 1) indexOf[name] = static_cast<int>(i);
+    }
+    
+    // Start from "everything is pure" and strike out functions until
+    // nothing changes, so recursive functions can stay pure
+    pure.assign(declarations.size(), 1);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < declarations.size(); ++i) {
+            if (pure[i] && !isPure(declarations[i])) {
+                pure[i] = 0;
+                changed = true;
+            }
+        }
+    }
+    
+    program.pureFunctions.clear();
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        FunctionInfo& function = *declarations[i]->function;
+        function.memoSlot = -1;
+        if (pure[i]) {
+            function.memoSlot = static_cast<int32_t>(program.pureFunctions.size());
+            program.pureFunctions.push_back(declarations[i]);
+        }
+    }
+}
+
+void Purity::collect(ASTNodePtr node) {
+    if (!node) return;
+    
+    if (node->type == NodeType::FUNCTION_DECL) {
+        declarations.push_back(node);
+        declarationCount[node->symbol]++;
+        collect(node->function->body);
+    }
+    for (ASTNodePtr child : node->children) {
+        collect(child);
+    }
+}
+
+bool Purity::isPure(ASTNodePtr declaration) {
+    const FunctionInfo& function = *declaration->function;
+    std::vector<char> assigned(function.params.size() + function.localGlobals.size(), 0);
+    for (size_t i = 0; i < function.params.size(); ++i) {
+        assigned[i] = 1;
+    }
+    impure = false;
+    statement(function.body, assigned);
+    return !impure;
+}
+
+// Walks a statement, tracking which locals are certainly assigned by now.
+void Purity::statement(ASTNodePtr node, std::vector<char>& assigned) {
+    if (!node || impure) return;
+    
+    switch (node->type) {
+        case NodeType::PRINT:
+        case NodeType::FUNCTION_DECL:
+            impure = true;
+            break;
+        
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+            expression(node->children[0], assigned);
+            if (node->isLocal) assigned[node->slot] = 1;
+            break;
+        
+        case NodeType::BLOCK:
+            for (ASTNodePtr child : node->children) {
+                statement(child, assigned);
+            }
+            break;
+        
+        case NodeType::IF: {
+            // After the IF, a local is assigned if every way through assigned it
+            expression(node->children[0], assigned);
+            std::vector<char> merged = assigned;
+            statement(node->children[1], merged);
+            bool hasElse = false;
+            for (size_t i = 2; i < node->children.size(); ++i) {
+                ASTNodePtr child = node->children[i];
+                std::vector<char> branch = assigned;
+                if (child->type == NodeType::IF) {
+                    expression(child->children[0], assigned);
+                    statement(child->children[1], branch);
+                } else {
+                    statement(child, branch);
+                    hasElse = true;
+                }
+                for (size_t slot = 0; slot < merged.size(); ++slot) {
+                    merged[slot] = merged[slot] && branch[slot];
+                }
+            }
+            if (hasElse) assigned = std::move(merged);
+            break;
+        }
+        
+        case NodeType::WHILE: {
+            expression(node->children[0], assigned);
+            std::vector<char> body = assigned;
+            statement(node->children[1], body);
+            break;
+        }
+        
+        case NodeType::FOR: {
+            statement(node->children[0], assigned);
+            expression(node->children[1], assigned);
+            std::vector<char> body = assigned;
+            statement(node->children[3], body);
+            statement(node->children[2], body);
+            break;
+        }
+        
+        case NodeType::RETURN:
+            for (ASTNodePtr child : node->children) {
+                expression(child, assigned);
+            }
+            break;
+        
+        case NodeType::CLEAR_CACHE:
+            break;
+        
+        default:
+            expression(node, assigned);
+            break;
+    }
+}
+
+void Purity::expression(ASTNodePtr node, std::vector<char>& assigned) {
+    if (!node || impure) return;
+    
+    switch (node->type) {
+        case NodeType::IDENTIFIER:
+            if (!node->isLocal || !assigned[node->slot]) impure = true;
+            return;
+        
+        case NodeType::UNARY_OP:
+            if (node->op == Op::POST_INC) {
+                ASTNodePtr target = node->children[0];
+                if (target->type != NodeType::IDENTIFIER || !target->isLocal || !assigned[target->slot]) impure = true;
+                return;
+            }
+            break;
+        
+        case NodeType::CALL: {
+            int callee = indexOf[node->symbol];
+            if (callee < 0 || !pure[callee]) impure = true;
+            break;
+        }
+        
+        case NodeType::NATIVE:
+            // Whatever the host does, it is not memoizable
+            impure = true;
+            return;
+        
+        case NodeType::CACHED:
+            // The hidden variable starts out nil in every frame
+            break;
+        
+        default:
+            break;
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        expression(child, assigned);
+    }
+}
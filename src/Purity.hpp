@@ -0,0 +1,36 @@
+#ifndef LFI3A_PURITY_HPP
+#define LFI3A_PURITY_HPP
+
+#include <vector>
+#include "AST.hpp"
+
+// Finds functions whose result depends only on their arguments, so calls
+// to them can be memoized. A function is pure when its body
+//
+// - never prints and declares no functions,
+// - reads no global, and reads a non-parameter local only after
+//   assigning it (a local starts out as the global's value),
+// - calls only functions that are declared exactly once and are pure
+//   themselves (recursion included).
+//
+// Functions can never assign globals, so nothing else needs checking.
+// Pure functions get a FunctionInfo::memoSlot and are listed in
+// Program::pureFunctions.
+class Purity {
+public:
+    void analyze(Program& program);
+
+private:
+    std::vector<ASTNodePtr> declarations;  // every FUNCTION_DECL in the program
+    std::vector<int> declarationCount;     // Symbol -> number of dalla with that name
+    std::vector<char> pure;                // parallel to declarations
+    std::vector<int> indexOf;              // Symbol -> index in declarations if declared once, else -1
+    bool impure = false;
+    
+    void collect(ASTNodePtr node);
+    bool isPure(ASTNodePtr declaration);
+    void statement(ASTNodePtr node, std::vector<char>& assigned);
+    void expression(ASTNodePtr node, std::vector<char>& assigned);
+};
+
+#endif
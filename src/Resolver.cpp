@@ -0,0 +1,202 @@
+#include "Resolver.hpp"
+#include "Builtins.hpp"
+
+void Resolver::resolve(Program& prog, const std::vector<std::string>& natives) {
+    program = &prog;
+    localSlots.assign(prog.symbols->size(), -1);
+    prog.callSites = 0;
+    scope.clear();
+    inFunction = false;
+    declared.assign(prog.symbols->size(), false);
+    nativeOf.assign(prog.symbols->size(), -1);
+    for (size_t i = 0; i < natives.size(); ++i) {
+        Symbol symbol;
+        if (prog.symbols->find(natives[i], symbol)) nativeOf[symbol] = static_cast<int32_t>(i);
+    }
+    
+    for (ASTNodePtr node : program->statements) {
+        collectFunctions(node);
+    }
+    for (ASTNodePtr node : program->statements) {
+        resolveNode(node);
+    }
+    program = nullptr;
+}
+
+// Whether node has an x++ of symbol in it.
+static bool increments(ASTNodePtr node, Symbol symbol) {
+    if (!node) return false;
+    if (node->type == NodeType::UNARY_OP && node->op == Op::POST_INC) {
+        ASTNodePtr target = node->children[0];
+        if (target->type == NodeType::IDENTIFIER && target->symbol == symbol) return true;
+    }
+    for (ASTNodePtr child : node->children) {
+        if (increments(child, symbol)) return true;
+    }
+    return false;
+}
+
+// Whether node might see the value of symbol: it names it, or calls a
+// dalla, which can read a global.
+static bool mightRead(ASTNodePtr node, Symbol symbol, bool global) {
+    if (!node) return false;
+    if (node->type == NodeType::IDENTIFIER && node->symbol == symbol) return true;
+    if (node->type == NodeType::CALL && global) return true;
+    for (ASTNodePtr child : node->children) {
+        if (mightRead(child, symbol, global)) return true;
+    }
+    return false;
+}
+
+// x = x + e1 + ... + en, which the engines run as x = x + e1, ...,
+// x = x + en. With one term that only needs e1 not to change x: the only
+// way an expression assigns is x++, and a dalla never assigns its
+// caller's variables. With more, no term may see x halfway either.
+static bool addsToItself(ASTNodePtr assignment) {
+    std::vector<ASTNodePtr> terms;
+    ASTNodePtr sum = assignment->children[0];
+    while (sum->type == NodeType::BINARY_OP && sum->op == Op::ADD) {
+        terms.push_back(sum->children[1]);
+        sum = sum->children[0];
+    }
+    if (terms.empty() || sum->type != NodeType::IDENTIFIER || sum->symbol != assignment->symbol) return false;
+    if (terms.size() == 1) return !increments(terms[0], assignment->symbol);
+    for (ASTNodePtr term : terms) {
+        if (mightRead(term, assignment->symbol, !assignment->isLocal)) return false;
+    }
+    return true;
+}
+
+void Resolver::resolveNode(ASTNodePtr node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NodeType::IDENTIFIER:
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+            bind(node);
+            break;
+        
+        case NodeType::CALL: {
+            if (!declared[node->symbol] && nativeOf[node->symbol] >= 0) {
+                node->type = NodeType::NATIVE;
+                node->slot = nativeOf[node->symbol];
+                break;
+            }
+            Builtin builtin;
+            if (!declared[node->symbol] && findBuiltin(node->value, builtin)) {
+                node->type = NodeType::BUILTIN;
+                node->slot = static_cast<int32_t>(builtin);
+                break;
+            }
+            node->slot = static_cast<int32_t>(node->symbol);
+            node->site = static_cast<int32_t>(program->callSites++);
+            break;
+        }
+        
+        case NodeType::FUNCTION_DECL:
+            node->slot = static_cast<int32_t>(node->symbol);
+            resolveFunction(node);
+            return;
+        
+        default:
+            break;
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        resolveNode(child);
+    }
+    // Once calls to builtins, which read no variables, are told apart
+    if (node->type == NodeType::ASSIGNMENT) node->inPlace = addsToItself(node);
+}
+
+void Resolver::collectFunctions(ASTNodePtr node) {
+    if (!node) return;
+    if (node->type == NodeType::FUNCTION_DECL) {
+        declared[node->symbol] = true;
+        collectFunctions(node->function->body);
+        return;
+    }
+    for (ASTNodePtr child : node->children) {
+        collectFunctions(child);
+    }
+}
+
+void Resolver::resolveFunction(ASTNodePtr node) {
+    FunctionInfo& function = *node->function;
+    
+    // Hide the enclosing function's locals while resolving this one
+    auto enclosing = std::move(scope);
+    auto enclosingLocals = std::move(localGlobals);
+    bool enclosingInFunction = inFunction;
+    for (const auto& entry : enclosing) {
+        localSlots[entry.first] = -1;
+    }
+    scope.clear();
+    localGlobals.clear();
+    inFunction = true;
+    
+    for (size_t i = 0; i < function.params.size(); ++i) {
+        declare(function.params[i], static_cast<int>(i)); // a repeated name binds the last argument
+    }
+    collectLocals(function.body, function);
+    function.localGlobals = program->arena.copy(localGlobals);
+    
+    resolveNode(function.body);
+    
+    for (const auto& entry : scope) {
+        localSlots[entry.first] = -1;
+    }
+    scope = std::move(enclosing);
+    localGlobals = std::move(enclosingLocals);
+    inFunction = enclosingInFunction;
+    for (const auto& entry : scope) {
+        localSlots[entry.first] = entry.second;
+    }
+}
+
+void Resolver::collectLocals(ASTNodePtr node, const FunctionInfo& function) {
+    if (!node) return;
+    
+    ASTNodePtr target = nullptr;
+    switch (node->type) {
+        case NodeType::FUNCTION_DECL:
+            return; // nested functions get their own frame
+        case NodeType::VAR_DECL:
+        case NodeType::ASSIGNMENT:
+            target = node;
+            break;
+        case NodeType::UNARY_OP:
+            if (node->op == Op::POST_INC && node->children[0]->type == NodeType::IDENTIFIER) {
+                target = node->children[0];
+            }
+            break;
+        default:
+            break;
+    }
+    
+    if (target && localSlots[target->symbol] < 0) {
+        declare(target->symbol, static_cast<int>(function.params.size() + localGlobals.size()));
+        localGlobals.push_back(static_cast<int>(target->symbol));
+    }
+    
+    for (ASTNodePtr child : node->children) {
+        collectLocals(child, function);
+    }
+}
+
+void Resolver::declare(Symbol symbol, int slot) {
+    localSlots[symbol] = slot;
+    scope.emplace_back(symbol, slot);
+}
+
+void Resolver::bind(ASTNodePtr node) {
+    int local = inFunction ? localSlots[node->symbol] : -1;
+    if (local >= 0) {
+        node->slot = local;
+        node->isLocal = true;
+    } else {
+        node->slot = static_cast<int32_t>(node->symbol);
+        node->isLocal = false;
+    }
+}
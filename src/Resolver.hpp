@@ -0,0 +1,45 @@
+#ifndef LFI3A_RESOLVER_HPP
+#define LFI3A_RESOLVER_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "AST.hpp"
+
+// Static pass that maps every variable reference to a frame slot or a
+// global slot, and every function name to a function slot, so neither
+// engine has to look names up at run time. Global and function slots are
+// simply the name's Symbol.
+//
+// Inside a function, parameters and every name assigned in its body are
+// locals; all other names are globals. A local that is not a parameter
+// starts out with the value of the global of the same name, so writes
+// stay inside the call while reads of untouched globals still work.
+//
+// A call to a builtin function (see Builtins.hpp) becomes a BUILTIN node,
+// unless the script declares a dalla of that name somewhere. Native
+// functions, named in the order the host registered them, come before
+// builtins of the same name and make NATIVE nodes.
+class Resolver {
+public:
+    void resolve(Program& program, const std::vector<std::string>& natives = {});
+
+private:
+    Program* program = nullptr;
+    std::vector<int> localSlots;                  // Symbol -> slot in the current function, or -1
+    std::vector<std::pair<Symbol, int>> scope;    // the entries set in localSlots
+    std::vector<int> localGlobals;
+    std::vector<bool> declared;                   // Symbol -> some dalla has this name
+    std::vector<int32_t> nativeOf;                // Symbol -> index of the native of this name, or -1
+    bool inFunction = false;
+    
+    void collectFunctions(ASTNodePtr node);
+    void resolveNode(ASTNodePtr node);
+    void resolveFunction(ASTNodePtr node);
+    void collectLocals(ASTNodePtr node, const FunctionInfo& function);
+    void declare(Symbol symbol, int slot);
+    void bind(ASTNodePtr node);
+};
+
+#endif
@@ -0,0 +1,496 @@
+#include "Server.hpp"
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Error.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "SourceFile.hpp"
+#define LFI3A_HAVE_SOCKETS 1
+#endif
+
+#ifdef LFI3A_HAVE_SOCKETS
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t MAX_REQUEST_LINE = 4096;
+const size_t MAX_SOURCE = size_t(16) << 20;
+// A client that sends nothing, or reads nothing, for this long is dropped
+// rather than holding a worker
+const int IO_TIMEOUT_SECONDS = 10;
+// Room for deep recursion. A runaway script still gets an error once it
+// comes near the end, rather than taking every request down with it.
+// Pages that are never touched cost no memory.
+const size_t WORKER_STACK = size_t(256) << 20;
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// A whole decimal number of at most 18 digits.
+bool parseSize(const std::string& digits, size_t& out) {
+    if (digits.empty() || digits.size() > 18 || digits.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    out = std::strtoull(digits.c_str(), nullptr, 10);
+    return true;
+}
+
+// Writes all of data; false once the peer has gone.
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+// Buffered reads of lines and counted byte strings from a socket.
+class Reader {
+public:
+    explicit Reader(int fd) : fd(fd) {}
+
+    // The next line, without its '\n'. False at the end of the stream or
+    // once the line is longer than max.
+    bool line(std::string& out, size_t max) {
+        out.clear();
+        for (;;) {
+            if (start == end && !fill()) return false;
+            const char* begin = buffer + start;
+            const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - start));
+            size_t length = newline ? static_cast<size_t>(newline - begin) : end - start;
+            out.append(begin, length);
+            start += length;
+            if (out.size() > max) return false;
+            if (newline) {
+                ++start;
+                return true;
+            }
+        }
+    }
+
+    // The next count bytes. The string grows as they arrive, so a size the
+    // peer only claims costs nothing.
+    bool bytes(std::string& out, size_t count) {
+        out.clear();
+        while (out.size() < count) {
+            if (start == end && !fill()) return false;
+            size_t take = std::min(count - out.size(), end - start);
+            out.append(buffer + start, take);
+            start += take;
+        }
+        return true;
+    }
+
+private:
+    int fd;
+    char buffer[64 * 1024];
+    size_t start = 0;
+    size_t end = 0;
+
+    bool fill() {
+        for (;;) {
+            ssize_t got = ::read(fd, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            start = 0;
+            end = static_cast<size_t>(got);
+            return true;
+        }
+    }
+};
+
+// The server's side of one request. Frames to a client that has gone are
+// dropped, so the script still runs to the end.
+class Connection {
+public:
+    explicit Connection(int fd) : fd(fd) {}
+
+    void frame(const char* kind, std::string_view body) {
+        if (!open) return;
+        std::string message = kind;
+        message += ' ';
+        message += std::to_string(body.size());
+        message += '\n';
+        message += body;
+        open = writeAll(fd, message);
+    }
+
+    void done(int status, long long compileUs, long long runUs, bool hit) {
+        if (!open) return;
+        open = writeAll(fd, "DONE " + std::to_string(status) + " " + std::to_string(compileUs) + " " +
+                                std::to_string(runUs) + (hit ? " hit\n" : " miss\n"));
+    }
+
+private:
+    int fd;
+    bool open = true;
+};
+
+// A compiled program. Node text points into `text`.
+struct Script {
+    std::string text;
+    Program program;
+};
+
+// Compiled programs by source text, shared by every worker. Programs are
+// never changed once compiled, so any number of requests can run one at
+// the same time. The oldest entry goes once there are capacity of them.
+class ScriptCache {
+public:
+    ScriptCache(size_t capacity, bool optimize) : capacity(capacity), optimize(optimize) {}
+
+    // Throws ScriptError for a syntax error. Compiling happens outside the
+    // lock; two requests that miss on the same text at once both compile
+    // it, and the second one's program stays.
+    std::shared_ptr<const Script> get(std::string text, bool& hit) {
+        uint64_t key = std::hash<std::string_view>()(text);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = scripts.find(key);
+            if (found != scripts.end() && found->second->text == text) {
+                hit = true;
+                return found->second;
+            }
+        }
+        hit = false;
+
+        auto script = std::make_shared<Script>();
+        script->text = std::move(text);
+        auto symbols = std::make_shared<SymbolTable>();
+        Lexer lexer(script->text, *symbols);
+        Parser parser(lexer, symbols);
+        script->program = parser.parse();
+        Resolver resolver;
+        resolver.resolve(script->program);
+        if (optimize) {
+            Optimizer optimizer;
+            optimizer.optimize(script->program);
+        }
+
+        if (capacity > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto [entry, added] = scripts.emplace(key, script);
+            if (!added) {
+                entry->second = script;
+            } else {
+                order.push_back(key);
+                if (order.size() > capacity) {
+                    scripts.erase(order.front());
+                    order.pop_front();
+                }
+            }
+        }
+        return script;
+    }
+
+private:
+    size_t capacity;
+    bool optimize;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const Script>> scripts;
+    std::deque<uint64_t> order;  // keys, oldest first
+};
+
+// Reads the request on fd, runs the script and answers it.
+void handle(int fd, ScriptCache& cache, const ServerOptions& options) {
+    Reader reader(fd);
+    Connection connection(fd);
+    std::string request;
+    if (!reader.line(request, MAX_REQUEST_LINE)) return;
+
+    std::string text;
+    std::string error;
+    size_t size = 0;
+    if (request.compare(0, 4, "RUN ") == 0) {
+        std::string path = request.substr(4);
+        SourceFile source;
+        if (!endsWith(path, ".lfi3a")) {
+            error = "Only .lfi3a files are allowed";
+        } else if (!source.open(path)) {
+            error = "Cannot open file '" + path + "'";
+        } else {
+            text = source.text();
+        }
+    } else if (request.compare(0, 5, "EVAL ") == 0) {
+        if (!parseSize(request.substr(5), size)) {
+            error = "Malformed EVAL request";
+        } else if (size > MAX_SOURCE) {
+            error = "Script is larger than " + std::to_string(MAX_SOURCE >> 20) + " MiB";
+        } else if (!reader.bytes(text, size)) {
+            error = "Malformed EVAL request";
+        }
+    } else {
+        error = "Unknown request '" + request + "'";
+    }
+    if (!error.empty()) {
+        connection.frame("ERR", error);
+        connection.done(1, 0, 0, false);
+        return;
+    }
+
+    int status = 0;
+    bool hit = false;
+    auto start = Clock::now();
+    std::shared_ptr<const Script> script;
+    try {
+        script = cache.get(std::move(text), hit);
+    } catch (const std::exception& e) {
+        connection.frame("ERR", e.what());
+        status = 1;
+    }
+    auto compiled = Clock::now();
+    if (script) {
+        try {
+            Interpreter interpreter(options.flush, options.flushLimit,
+                                    [&](std::string_view chunk) { connection.frame("OUT", chunk); });
+            interpreter.setTimeLimit(std::chrono::seconds(options.timeLimit));
+            interpreter.run(script->program);
+        } catch (const std::exception& e) {
+            connection.frame("ERR", e.what());
+            status = 1;
+        }
+    }
+    auto finished = Clock::now();
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    connection.done(status, duration_cast<microseconds>(compiled - start).count(),
+                    duration_cast<microseconds>(finished - compiled).count(), hit);
+}
+
+void work(int listener, ScriptCache& cache, const ServerOptions& options) {
+    for (;;) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            // A bad listener never gets better; anything else, like a
+            // client that hung up first or running out of descriptors, can
+            if (errno == EBADF || errno == EINVAL || errno == ENOTSOCK) return;
+            if (errno != EINTR && errno != ECONNABORTED) usleep(10000);
+            continue;
+        }
+        timeval timeout = {IO_TIMEOUT_SECONDS, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        handle(fd, cache, options);
+        ::close(fd);
+    }
+}
+
+struct Worker {
+    int listener;
+    ScriptCache* cache;
+    const ServerOptions* options;
+};
+
+void* startWorker(void* worker) {
+    const Worker& w = *static_cast<const Worker*>(worker);
+    work(w.listener, *w.cache, *w.options);
+    return nullptr;
+}
+
+// Set once the socket is bound, for the signal handler to remove
+char boundPath[sizeof(sockaddr_un::sun_path)];
+
+extern "C" void stopServing(int signal) {
+    if (boundPath[0]) ::unlink(boundPath);
+    _exit(128 + signal);
+}
+
+bool socketAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int connectTo(const sockaddr_un& address) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+bool serverAvailable() {
+    return true;
+}
+
+int serve(const ServerOptions& options) {
+    sockaddr_un address;
+    if (!socketAddress(options.socketPath, address)) {
+        std::cerr << "Error: Invalid socket path '" << options.socketPath << "'\n";
+        return 1;
+    }
+
+    // A socket left behind by a server that is gone can be replaced; a
+    // live one, or anything that is not a socket, can't
+    struct stat info;
+    if (::lstat(address.sun_path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            std::cerr << "Error: '" << options.socketPath << "' exists and is not a socket\n";
+            return 1;
+        }
+        int live = connectTo(address);
+        if (live >= 0) {
+            ::close(live);
+            std::cerr << "Error: '" << options.socketPath << "' is already in use\n";
+            return 1;
+        }
+        ::unlink(address.sun_path);
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    // Whoever can connect can run scripts as this user, so only this user can
+    if (listener < 0 || ::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::chmod(address.sun_path, 0600) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: Cannot listen on '" << options.socketPath << "': " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::memcpy(boundPath, address.sun_path, sizeof(boundPath));
+
+    std::signal(SIGPIPE, SIG_IGN);
+    struct sigaction stop = {};
+    stop.sa_handler = stopServing;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, nullptr);
+    sigaction(SIGTERM, &stop, nullptr);
+
+    unsigned workers = options.workers ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+    std::cerr << "Serving on " << options.socketPath << " with " << workers << " worker"
+              << (workers == 1 ? "" : "s") << std::endl;
+
+    // Every worker is a thread of its own, since the main thread's stack
+    // is only as big as ulimit -s makes it
+    ScriptCache cache(options.cacheEntries, options.optimize);
+    Worker worker = {listener, &cache, &options};
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, WORKER_STACK);
+    std::vector<pthread_t> threads;
+    for (unsigned i = 0; i < workers; ++i) {
+        pthread_t thread;
+        int error = pthread_create(&thread, &attributes, startWorker, &worker);
+        if (error != 0) {
+            std::cerr << "Error: Cannot start worker thread: " << std::strerror(error) << "\n";
+            break;
+        }
+        threads.push_back(thread);
+    }
+    pthread_attr_destroy(&attributes);
+    for (pthread_t thread : threads) pthread_join(thread, nullptr);
+    ::unlink(boundPath);
+    return 1;
+}
+
+int runClient(const std::string& socketPath, const std::string& path, bool showTime) {
+    std::string request;
+    if (path == "-") {
+        std::string source((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+        request = "EVAL " + std::to_string(source.size()) + "\n" + source;
+    } else {
+        if (!endsWith(path, ".lfi3a")) {
+            std::cerr << "Error: Only .lfi3a files are allowed\n";
+            return 1;
+        }
+        // The server has its own working directory
+        char* absolute = ::realpath(path.c_str(), nullptr);
+        if (!absolute) {
+            std::cerr << "Error: Cannot open file '" << path << "'\n";
+            return 1;
+        }
+        request = "RUN " + std::string(absolute) + "\n";
+        std::free(absolute);
+    }
+
+    sockaddr_un address;
+    int fd = socketAddress(socketPath, address) ? connectTo(address) : -1;
+    if (fd < 0) {
+        std::cerr << "Error: Cannot connect to '" << socketPath << "'\n";
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    writeAll(fd, request);
+
+    Reader reader(fd);
+    std::string header;
+    std::string body;
+    while (reader.line(header, MAX_REQUEST_LINE)) {
+        size_t space = header.find(' ');
+        std::string kind = header.substr(0, space);
+        std::string rest = space == std::string::npos ? "" : header.substr(space + 1);
+        size_t size = 0;
+        if (kind == "OUT" && parseSize(rest, size) && reader.bytes(body, size)) {
+            writeAll(STDOUT_FILENO, body);
+        } else if (kind == "ERR" && parseSize(rest, size) && reader.bytes(body, size)) {
+            std::cerr << "Error: " << body << "\n";
+        } else if (kind == "DONE") {
+            int status = 1;
+            long long compileUs = 0;
+            long long runUs = 0;
+            char cache[8] = "";
+            std::sscanf(rest.c_str(), "%d %lld %lld %7s", &status, &compileUs, &runUs, cache);
+            if (showTime) {
+                std::cerr << "compile: " << compileUs << " us (cache " << cache << "), run: " << runUs << " us\n";
+            }
+            ::close(fd);
+            return status;
+        } else {
+            break;
+        }
+    }
+    ::close(fd);
+    std::cerr << "Error: Lost the connection to '" << socketPath << "'\n";
+    return 1;
+}
+
+#else
+
+bool serverAvailable() {
+    return false;
+}
+
+int serve(const ServerOptions&) {
+    return 1;
+}
+
+int runClient(const std::string&, const std::string&, bool) {
+    return 1;
+}
+
+#endif
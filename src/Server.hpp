@@ -0,0 +1,46 @@
+#ifndef LFI3A_SERVER_HPP
+#define LFI3A_SERVER_HPP
+
+#include <cstddef>
+#include <string>
+#include "Output.hpp"
+
+// lfi3a --serve: a long-lived process that runs scripts for clients on a
+// Unix domain socket, so a short script pays for neither process start-up
+// nor, when it has run before, the lexer and parser. Worker threads share
+// the listening socket and a cache of compiled programs keyed by source
+// text; every request gets a fresh Interpreter, so scripts never see each
+// other's globals.
+//
+// One request per connection. The client sends one of
+//   RUN <absolute path>\n
+//   EVAL <bytes>\n<source>
+// and reads frames until DONE:
+//   OUT <bytes>\n<kteb output>
+//   ERR <bytes>\n<message>     (as after "Error: ")
+//   DONE <status> <compile us> <run us> <hit|miss>\n
+struct ServerOptions {
+    static constexpr size_t DEFAULT_CACHE_ENTRIES = 256;
+    static constexpr unsigned DEFAULT_TIME_LIMIT = 30;
+
+    std::string socketPath;
+    unsigned workers = 0;  // 0: one per hardware thread
+    bool optimize = true;
+    size_t cacheEntries = DEFAULT_CACHE_ENTRIES;
+    Output::Flush flush = Output::Flush::AUTO;
+    size_t flushLimit = Output::DEFAULT_LIMIT;
+    unsigned timeLimit = DEFAULT_TIME_LIMIT;  // seconds a script may run; 0: no limit
+};
+
+// Whether this build can serve (it needs POSIX sockets).
+bool serverAvailable();
+
+// Serves until SIGINT or SIGTERM; returns 1 if the socket can't be set up.
+int serve(const ServerOptions& options);
+
+// Sends the script at path, or standard input for "-", to the server at
+// socketPath and relays the output. Returns the script's exit status.
+// With showTime, reports compile and run times on stderr.
+int runClient(const std::string& socketPath, const std::string& path, bool showTime);
+
+#endif
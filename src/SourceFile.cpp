@@ -0,0 +1,63 @@
+#include "SourceFile.hpp"
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LFI3A_HAVE_MMAP 1
+#endif
+
+SourceFile::~SourceFile() {
+    close();
+}
+
+bool SourceFile::open(const std::string& path) {
+    close();
+    
+#ifdef LFI3A_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            ::close(fd);
+            return true;
+        }
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            ::close(fd);
+            madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            data = static_cast<const char*>(p);
+            size = static_cast<size_t>(st.st_size);
+            mapped = true;
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    
+    // Not mappable (pipe, special file, or no mmap): read it instead
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    buffer.assign((std::istreambuf_iterator<char>(file)),
+                  std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+void SourceFile::close() {
+#ifdef LFI3A_HAVE_MMAP
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+    mapped = false;
+    data = nullptr;
+    size = 0;
+    buffer.clear();
+}
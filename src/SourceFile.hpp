@@ -0,0 +1,29 @@
+#ifndef LFI3A_SOURCEFILE_HPP
+#define LFI3A_SOURCEFILE_HPP
+
+#include <string>
+#include <string_view>
+
+// Read-only view of a script on disk. The file is memory-mapped where the
+// platform allows it and read into memory otherwise; either way text()
+// stays valid for the lifetime of the SourceFile.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool open(const std::string& path);
+    std::string_view text() const { return std::string_view(data, size); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer;  // fallback when the file cannot be mapped
+
+    void close();
+};
+
+#endif
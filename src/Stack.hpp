@@ -0,0 +1,47 @@
+#ifndef LFI3A_STACK_HPP
+#define LFI3A_STACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+// Script calls nest on the C++ stack in the tree-walker and in --emit-cpp
+// programs. A call made with less than this much of the thread's stack
+// left stops the script with "Too much recursion" rather than overflow
+// it. Each call takes about 1 KiB, more when made inside loops, branches
+// or long expressions, so an 8 MiB stack holds some thousands. Tail calls
+// don't nest.
+constexpr size_t STACK_MARGIN = 256 * 1024;
+
+// The lowest address the calling thread's stack can grow down to, or 0
+// where there is no way to ask.
+inline uintptr_t stackFloor() {
+#if defined(__linux__)
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) return 0;
+    void* low = nullptr;
+    size_t size = 0;
+    int error = pthread_attr_getstack(&attributes, &low, &size);
+    pthread_attr_destroy(&attributes);
+    return error == 0 ? reinterpret_cast<uintptr_t>(low) : 0;
+#elif defined(__APPLE__)
+    pthread_t self = pthread_self();
+    return reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#else
+    return 0;
+#endif
+}
+
+// The lowest stack address a call may start at on the calling thread.
+// Without a floor to go by, counts on 1 MiB below here, the smallest
+// default stack of the usual platforms.
+inline uintptr_t callStackLimit() {
+    char here;
+    uintptr_t floor = stackFloor();
+    if (floor == 0) floor = reinterpret_cast<uintptr_t>(&here) - (1 << 20);
+    return floor + STACK_MARGIN;
+}
+
+#endif
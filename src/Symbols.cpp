@@ -0,0 +1,18 @@
+#include "Symbols.hpp"
+
+Symbol SymbolTable::intern(std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    
+    Symbol symbol = static_cast<Symbol>(names.size());
+    names.emplace_back(name);
+    ids.emplace(names.back(), symbol);
+    return symbol;
+}
+
+bool SymbolTable::find(std::string_view name, Symbol& out) const {
+    auto it = ids.find(name);
+    if (it == ids.end()) return false;
+    out = it->second;
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef LFI3A_SYMBOLS_HPP
+#define LFI3A_SYMBOLS_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Small integer ID of an interned identifier.
+using Symbol = uint32_t;
+
+// Interns every identifier of a program once. The lexer hands out the IDs
+// on tokens; everything after it compares and indexes by Symbol instead of
+// hashing names again. Names stay at a stable address for the table's
+// lifetime.
+class SymbolTable {
+public:
+    Symbol intern(std::string_view name);
+    // Looks name up without adding it; false if the program never used it.
+    bool find(std::string_view name, Symbol& out) const;
+    std::string_view name(Symbol symbol) const { return names[symbol]; }
+    size_t size() const { return names.size(); }
+
+private:
+    std::unordered_map<std::string_view, Symbol> ids;
+    std::deque<std::string> names;
+};
+
+#endif
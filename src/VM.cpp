@@ -0,0 +1,807 @@
+#include "VM.hpp"
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LFI3A_COMPUTED_GOTO 1
+#endif
+
+static constexpr size_t JIT_STACK_SLOTS = 1 << 16;
+static constexpr int MAX_NATIVE_DEPTH = 2048;  // nested native calls, bounded by the C++ stack
+static constexpr uint32_t MAX_DEOPTS = 1000;   // per function, before it stays on the VM
+
+const JitHooks VM::hooks = {
+    nativeCall,
+    nativeTailCall,
+    nativeGetGlobal,
+    nativeSetGlobal,
+    nativeIncGlobal,
+    nativePrintArg,
+    nativePrintEnd,
+    nativeDefineFunction,
+    nativeDeopt
+};
+
+static Value nativeResult(const JitResult& result) {
+    if (result.status == JitResult::BOOLEAN) return Value::boolean(result.value != 0);
+    return Value::number(result.value);
+}
+
+void VM::run(const BytecodeProgram& prog) {
+    program = &prog;
+    globals.assign(prog.globalNames.size(), Value());
+    functions.assign(prog.functionNames.size(), -1);
+    callCaches.assign(prog.callSites.size(), CallCache());
+    callWatchers.assign(prog.functionNames.size(), {});
+    memos.assign(memoize ? prog.pureFunctions : 0, MemoTable(memoCapacity));
+    memoKeys.clear();
+    frames.clear();
+    stack.assign(1024, Value());
+    if (tiered) {
+        jit = std::make_unique<Jit>(prog, hooks);
+        tiers.assign(prog.functions.size(), Tier());
+        jitStack.assign(JIT_STACK_SLOTS, 0);
+        jitTop = 0;
+        jitDepth = 0;
+        deopted.clear();
+    }
+    
+    const Value* constants = prog.constants.data();
+    const CompiledFunction& script = prog.functions[0];
+    if (static_cast<size_t>(script.maxStack) > stack.size()) {
+        stack.resize(script.maxStack);
+    }
+    
+    frames.push_back({&script, nullptr, 0});
+    Value* sp = stack.data();
+    Value* locals = stack.data();
+    const Instruction* ip = script.code.data();
+    const Instruction* ins;
+    
+#ifdef LFI3A_COMPUTED_GOTO
+    static void* const dispatchTable[] = {
+#define LFI3A_OPCODE_LABEL(name) &&op_##name,
+        LFI3A_OPCODES(LFI3A_OPCODE_LABEL)
+#undef LFI3A_OPCODE_LABEL
+    };
+#define DISPATCH() do { ins = ip++; goto *dispatchTable[static_cast<int>(ins->op)]; } while (0)
+#define CASE(name) op_##name:
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case OpCode::name:
+dispatch:
+    ins = ip++;
+    switch (ins->op) {
+#endif
+    
+    CASE(CONSTANT) {
+        *sp++ = constants[ins->a];
+        DISPATCH();
+    }
+    
+    CASE(TRUE) {
+        *sp++ = Value::boolean(true);
+        DISPATCH();
+    }
+    
+    CASE(FALSE) {
+        *sp++ = Value::boolean(false);
+        DISPATCH();
+    }
+    
+    CASE(NIL) {
+        *sp++ = Value();
+        DISPATCH();
+    }
+    
+    CASE(POP) {
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(DUP2) {
+        sp[0] = sp[-2];
+        sp[1] = sp[-1];
+        sp += 2;
+        DISPATCH();
+    }
+    
+    CASE(GET_GLOBAL) {
+        const Value& v = globals[ins->a];
+        if (v.isNil()) {
+            runtimeError("Undefined variable '" + prog.globalNames[ins->a] + "'");
+        }
+        *sp++ = v;
+        DISPATCH();
+    }
+    
+    CASE(SET_GLOBAL) {
+        globals[ins->a] = std::move(*--sp);
+        DISPATCH();
+    }
+    
+    CASE(GET_LOCAL) {
+        const Value& v = locals[ins->a];
+        if (v.isNil()) {
+            runtimeError("Undefined variable '" + frames.back().function->localNames[ins->a] + "'");
+        }
+        *sp++ = v;
+        DISPATCH();
+    }
+    
+    CASE(SET_LOCAL) {
+        locals[ins->a] = std::move(*--sp);
+        DISPATCH();
+    }
+    
+    CASE(INIT_LOCAL) {
+        locals[ins->a] = globals[ins->b];
+        DISPATCH();
+    }
+    
+    CASE(INC_GLOBAL) {
+        Value& v = globals[ins->a];
+        if (v.isNil()) {
+            runtimeError("Undefined variable '" + prog.globalNames[ins->a] + "'");
+        }
+        double n = toNumber(v);
+        *sp++ = Value::number(n);
+        v = Value::number(n + 1);
+        DISPATCH();
+    }
+    
+    CASE(INC_LOCAL) {
+        Value& v = locals[ins->a];
+        if (v.isNil()) {
+            runtimeError("Undefined variable '" + frames.back().function->localNames[ins->a] + "'");
+        }
+        double n = toNumber(v);
+        *sp++ = Value::number(n);
+        v = Value::number(n + 1);
+        DISPATCH();
+    }
+    
+    CASE(GET_CACHED_GLOBAL) {
+        // An array or a map is never reused, as its elements can change
+        const Value& v = globals[ins->a];
+        if (!v.isNil() && !v.isContainer()) {
+            *sp++ = v;
+            ip = frames.back().function->code.data() + ins->b;
+        }
+        DISPATCH();
+    }
+    
+    CASE(GET_CACHED_LOCAL) {
+        const Value& v = locals[ins->a];
+        if (!v.isNil() && !v.isContainer()) {
+            *sp++ = v;
+            ip = frames.back().function->code.data() + ins->b;
+        }
+        DISPATCH();
+    }
+    
+    CASE(ADD) {
+        Value& l = sp[-2];
+        Value& r = sp[-1];
+        if (l.isNumber() && r.isNumber()) {
+            l = Value::number(l.asNumber() + r.asNumber());
+        } else {
+            addSlow(sp);
+        }
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(ADD_TO_GLOBAL) {
+        addTo(globals[ins->a], sp);
+        sp -= 2;
+        DISPATCH();
+    }
+    
+    CASE(ADD_TO_LOCAL) {
+        addTo(locals[ins->a], sp);
+        sp -= 2;
+        DISPATCH();
+    }
+    
+    CASE(SUB) {
+        if (sp[-2].isArray() || sp[-1].isArray()) {
+            arrayArithmetic(ArrayOp::SUB, sp);
+        } else {
+            sp[-2] = Value::number(toNumber(sp[-2]) - toNumber(sp[-1]));
+        }
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(MUL) {
+        if (sp[-2].isArray() || sp[-1].isArray()) {
+            arrayArithmetic(ArrayOp::MUL, sp);
+        } else {
+            sp[-2] = Value::number(toNumber(sp[-2]) * toNumber(sp[-1]));
+        }
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(DIV) {
+        if (sp[-2].isArray() || sp[-1].isArray()) {
+            arrayArithmetic(ArrayOp::DIV, sp);
+            --sp;
+            DISPATCH();
+        }
+        double l = toNumber(sp[-2]);
+        double r = toNumber(sp[-1]);
+        if (r == 0) {
+            runtimeError("Division by zero");
+        }
+        sp[-2] = Value::number(l / r);
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(EQ) {
+        sp[-2] = Value::boolean(sp[-2].equals(sp[-1]));
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(NE) {
+        sp[-2] = Value::boolean(!sp[-2].equals(sp[-1]));
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(LT) {
+        sp[-2] = Value::boolean(toNumber(sp[-2]) < toNumber(sp[-1]));
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(GT) {
+        sp[-2] = Value::boolean(toNumber(sp[-2]) > toNumber(sp[-1]));
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(LE) {
+        sp[-2] = Value::boolean(toNumber(sp[-2]) <= toNumber(sp[-1]));
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(GE) {
+        sp[-2] = Value::boolean(toNumber(sp[-2]) >= toNumber(sp[-1]));
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(AND) {
+        sp[-2] = Value::boolean(sp[-2].isTruthy() && sp[-1].isTruthy());
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(OR) {
+        sp[-2] = Value::boolean(sp[-2].isTruthy() || sp[-1].isTruthy());
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(NEG) {
+        if (sp[-1].isArray()) {
+            arrayNegate(sp);
+        } else {
+            sp[-1] = Value::number(-toNumber(sp[-1]));
+        }
+        DISPATCH();
+    }
+    
+    CASE(ARRAY) {
+        sp -= ins->a;
+        makeArray(sp, ins->a);
+        ++sp;
+        DISPATCH();
+    }
+    
+    CASE(MAP) {
+        sp -= 2 * ins->a;
+        makeMap(sp, ins->a);
+        ++sp;
+        DISPATCH();
+    }
+    
+    CASE(GET_INDEX) {
+        if (!getElement(sp[-2], sp[-1], sp[-2])) indexFailed(sp[-2], sp[-1]);
+        --sp;
+        DISPATCH();
+    }
+    
+    CASE(SET_INDEX) {
+        if (!setElement(sp[-3], sp[-2], std::move(sp[-1]))) indexFailed(sp[-3], sp[-2]);
+        sp -= 3;
+        DISPATCH();
+    }
+    
+    CASE(BUILTIN) {
+        sp -= ins->b;
+        builtin(static_cast<Builtin>(ins->a), sp, ins->b);
+        ++sp;
+        DISPATCH();
+    }
+    
+    CASE(JUMP) {
+        ip = frames.back().function->code.data() + ins->a;
+        if (tiered && ip <= ins) {
+            // A loop came round; continue it in native code once it is hot
+            const JitCode* native = nativeCode(*frames.back().function, false);
+            JitResult result;
+            if (native && enterNative(*native, ins->a, locals, sp - locals, result)) {
+                if (result.status == JitResult::DEOPT) {
+                    Frame replaced = frames.back();
+                    frames.pop_back();
+                    size_t top = restoreFrames(replaced.base, replaced.memoSlot);
+                    sp = stack.data() + top;
+                    locals = stack.data() + frames.back().base;
+                    ip = frames.back().ip;
+                    DISPATCH();
+                }
+                sp = locals;
+                *sp++ = nativeResult(result);
+                goto returnFromFrame;
+            }
+        }
+        DISPATCH();
+    }
+    
+    CASE(JUMP_IF_FALSE) {
+        if (!(--sp)->isTruthy()) {
+            ip = frames.back().function->code.data() + ins->a;
+        }
+        DISPATCH();
+    }
+    
+    CASE(PRINT_ARG) {
+        out.write(*--sp);
+        if (ins->a) out.write(' ');
+        DISPATCH();
+    }
+    
+    CASE(PRINT_END) {
+        out.endLine();
+        DISPATCH();
+    }
+    
+    CASE(DEFINE_FUNCTION) {
+        defineFunction(ins->a, ins->b);
+        DISPATCH();
+    }
+    
+    CASE(CALL) {
+        const CallCache& cache = resolveCall(ins->a);
+        const CompiledFunction& fn = *cache.function;
+        
+        // Extra arguments are dropped, missing ones left undefined
+        sp -= cache.dropped;
+        int argc = cache.bound;
+        
+        int memoSlot = memoize ? fn.memoSlot : -1;
+        if (memoSlot >= 0) {
+            // DISPATCH() may be a computed goto, which skips destructors, so
+            // the key lives in a member rather than in this block
+            memoKey.assign(sp - argc, sp);
+            memoKey.resize(fn.arity);
+            if (const Value* cached = memos[memoSlot].find(memoKey)) {
+                sp -= argc;
+                *sp++ = *cached;
+                DISPATCH();
+            }
+            memoKeys.push_back(memoKey);
+        }
+        
+        if (tiered && memoSlot < 0) {
+            const JitCode* native = nativeCode(fn, false);
+            JitResult result;
+            if (native && enterNative(*native, 0, sp - argc, argc, result)) {
+                sp -= argc;
+                if (result.status == JitResult::DEOPT) {
+                    frames.back().ip = ip;
+                    size_t top = restoreFrames(sp - stack.data(), -1);
+                    sp = stack.data() + top;
+                    locals = stack.data() + frames.back().base;
+                    ip = frames.back().ip;
+                } else {
+                    *sp++ = nativeResult(result);
+                }
+                DISPATCH();
+            }
+        }
+        
+        size_t spIndex = sp - stack.data();
+        size_t needed = spIndex + (fn.numLocals - argc) + fn.maxStack;
+        if (needed > stack.size()) {
+            size_t localsIndex = locals - stack.data();
+            stack.resize(std::max(needed, stack.size() * 2));
+            sp = stack.data() + spIndex;
+            locals = stack.data() + localsIndex;
+        }
+        for (int i = argc; i < fn.numLocals; ++i) {
+            *sp++ = Value();
+        }
+        
+        if (profiler) profiler->enter(prog.callSites[ins->a].function);
+        frames.back().ip = ip;
+        locals = sp - fn.numLocals;
+        frames.push_back({&fn, nullptr, static_cast<size_t>(locals - stack.data()), memoSlot});
+        ip = fn.code.data();
+        DISPATCH();
+    }
+    
+    CASE(TAIL_CALL) {
+        const CallCache& cache = resolveCall(ins->a);
+        const CompiledFunction& fn = *cache.function;
+        
+        sp -= cache.dropped;
+        int argc = cache.bound;
+        
+        // Move the arguments down over the current frame and reuse it
+        Value* args = sp - argc;
+        for (int i = 0; i < argc; ++i) {
+            locals[i] = std::move(args[i]);
+        }
+        sp = locals + argc;
+        
+        if (tiered) {
+            const JitCode* native = nativeCode(fn, false);
+            JitResult result;
+            if (native && enterNative(*native, 0, locals, argc, result)) {
+                if (result.status == JitResult::DEOPT) {
+                    Frame replaced = frames.back();
+                    frames.pop_back();
+                    size_t top = restoreFrames(replaced.base, replaced.memoSlot);
+                    sp = stack.data() + top;
+                    locals = stack.data() + frames.back().base;
+                    ip = frames.back().ip;
+                    DISPATCH();
+                }
+                sp = locals;
+                *sp++ = nativeResult(result);
+                goto returnFromFrame;
+            }
+        }
+        
+        size_t localsIndex = locals - stack.data();
+        size_t needed = localsIndex + fn.numLocals + fn.maxStack;
+        if (needed > stack.size()) {
+            stack.resize(std::max(needed, stack.size() * 2));
+            locals = stack.data() + localsIndex;
+            sp = locals + argc;
+        }
+        for (int i = argc; i < fn.numLocals; ++i) {
+            *sp++ = Value();
+        }
+        
+        if (profiler) {
+            profiler->leave();
+            profiler->enter(prog.callSites[ins->a].function);
+        }
+        frames.back().function = &fn;
+        ip = fn.code.data();
+        DISPATCH();
+    }
+    
+    CASE(RETURN) {
+    returnFromFrame:
+        Value result = std::move(sp[-1]);
+        if (frames.back().memoSlot >= 0) {
+            memos[frames.back().memoSlot].insert(std::move(memoKeys.back()), result);
+            memoKeys.pop_back();
+        }
+        frames.pop_back();
+        if (frames.empty()) {
+            out.flush();
+            reportMemo();
+            return;
+        }
+        if (profiler) profiler->leave();
+        sp = locals;
+        *sp++ = std::move(result);
+        const Frame& caller = frames.back();
+        ip = caller.ip;
+        locals = stack.data() + caller.base;
+        DISPATCH();
+    }
+    
+    CASE(LINE) {
+        profiler->line(static_cast<uint32_t>(ins->a));
+        DISPATCH();
+    }
+    
+#ifndef LFI3A_COMPUTED_GOTO
+    }
+#endif
+#undef DISPATCH
+#undef CASE
+}
+
+const VM::CallCache& VM::resolveCall(int32_t site) {
+    CallCache& cache = callCaches[site];
+    if (!cache.function) {
+        const CallSite& call = program->callSites[site];
+        int index = functions[call.function];
+        if (index < 0) {
+            runtimeError("Undefined function '" + program->functionNames[call.function] + "'");
+        }
+        cache.function = &program->functions[index];
+        cache.bound = std::min(call.argc, cache.function->arity);
+        cache.dropped = call.argc - cache.bound;
+        callWatchers[call.function].push_back(site);
+    }
+    return cache;
+}
+
+void VM::defineFunction(int32_t name, int32_t index) {
+    if (functions[name] != index) {
+        // Sites that cached the previous definition resolve again
+        for (int32_t site : callWatchers[name]) {
+            callCaches[site].function = nullptr;
+        }
+        callWatchers[name].clear();
+        functions[name] = index;
+    }
+}
+
+const JitCode* VM::nativeCode(const CompiledFunction& fn, bool force) {
+    Tier& tier = tiers[&fn - program->functions.data()];
+    if (tier.failed) return nullptr;
+    if (!tier.code) {
+        if (!force && ++tier.heat < jitThreshold) return nullptr;
+        tier.code = jit->compile(static_cast<int>(&fn - program->functions.data()));
+        if (!tier.code) {
+            tier.failed = true;
+            return nullptr;
+        }
+    }
+    return tier.code;
+}
+
+bool VM::enterNative(const JitCode& code, int32_t pc, const Value* slots, size_t count, JitResult& result) {
+    // Only reached from the interpreter loop, so no native frame is live
+    const CompiledFunction& fn = program->functions[code.function];
+    const std::vector<JitType>& types = code.states[pc];
+    if (!code.labels[pc] || count > types.size() || types.size() + fn.maxStack > jitStack.size()) {
+        return false;
+    }
+    double* frame = jitStack.data();
+    for (size_t i = 0; i < types.size(); ++i) {
+        if (!toJitSlot(i < count ? slots[i] : Value(), types[i], frame[i])) {
+            // Types the code was not compiled for; give up on it if that keeps happening
+            if (++tiers[code.function].deopts >= MAX_DEOPTS) tiers[code.function].failed = true;
+            return false;
+        }
+    }
+    
+    jitTop = fn.numLocals + fn.maxStack;
+    jitDepth = 1;
+    result = code.entry(this, frame, code.labels[pc]);
+    jitTop = 0;
+    jitDepth = 0;
+    return true;
+}
+
+size_t VM::restoreFrames(size_t base, int memoSlot) {
+    // Outermost first, each frame's locals right after its caller's stack
+    size_t top = base;
+    for (auto it = deopted.rbegin(); it != deopted.rend(); ++it) {
+        const CompiledFunction& fn = *it->function;
+        size_t needed = top + fn.numLocals + fn.maxStack;
+        if (needed > stack.size()) {
+            stack.resize(std::max(needed, stack.size() * 2));
+        }
+        base = top;
+        for (Value& value : it->slots) {
+            stack[top++] = std::move(value);
+        }
+        frames.push_back({&fn, fn.code.data() + it->pc, base, memoSlot});
+        memoSlot = -1;
+    }
+    deopted.clear();
+    return top;
+}
+
+JitResult VM::nativeCall(void* context, int32_t site, double* args) {
+    VM& vm = *static_cast<VM*>(context);
+    const CallCache& cache = vm.resolveCall(site);
+    const CompiledFunction& fn = *cache.function;
+    
+    // Memoized calls, and calls too deep for the C++ stack, go through the VM
+    const JitCode* code = vm.memoize && fn.memoSlot >= 0 ? nullptr : vm.nativeCode(fn, true);
+    size_t size = fn.numLocals + fn.maxStack;
+    if (!code || vm.jitDepth >= MAX_NATIVE_DEPTH || vm.jitTop + size > vm.jitStack.size()) {
+        return {0, JitResult::DECLINED};
+    }
+    
+    double* frame = vm.jitStack.data() + vm.jitTop;
+    double nil;
+    toJitSlot(Value(), JitType::NIL, nil);
+    std::copy(args, args + cache.bound, frame);
+    std::fill(frame + cache.bound, frame + fn.numLocals, nil);
+    size_t savedTop = vm.jitTop;
+    vm.jitTop += size;
+    ++vm.jitDepth;
+    JitResult result = code->entry(context, frame, code->labels[0]);
+    vm.jitTop = savedTop;
+    --vm.jitDepth;
+    return result;
+}
+
+const void* VM::nativeTailCall(void* context, int32_t site, double* args, double* frame) {
+    VM& vm = *static_cast<VM*>(context);
+    const CallCache& cache = vm.resolveCall(site);
+    const CompiledFunction& fn = *cache.function;
+    const JitCode* code = vm.nativeCode(fn, true);
+    size_t base = frame - vm.jitStack.data();
+    if (!code || base + fn.numLocals + fn.maxStack > vm.jitStack.size()) return nullptr;
+    
+    // The caller's frame is the newest, so it can be resized in place
+    double nil;
+    toJitSlot(Value(), JitType::NIL, nil);
+    std::copy(args, args + cache.bound, frame);
+    std::fill(frame + cache.bound, frame + fn.numLocals, nil);
+    vm.jitTop = base + fn.numLocals + fn.maxStack;
+    return code->labels[0];
+}
+
+JitResult VM::nativeGetGlobal(void* context, int32_t slot) {
+    VM& vm = *static_cast<VM*>(context);
+    double value;
+    if (!toJitSlot(vm.globals[slot], JitType::MAYBE_NIL, value)) return {0, JitResult::DECLINED};
+    return {value, JitResult::NUMBER};
+}
+
+void VM::nativeSetGlobal(void* context, int32_t slot, double value, int32_t type) {
+    VM& vm = *static_cast<VM*>(context);
+    vm.globals[slot] = fromJitSlot(value, static_cast<JitType>(type), *vm.program);
+}
+
+JitResult VM::nativeIncGlobal(void* context, int32_t slot) {
+    VM& vm = *static_cast<VM*>(context);
+    Value& v = vm.globals[slot];
+    double n;
+    if (!toJitSlot(v, JitType::NUMBER, n)) return {0, JitResult::DECLINED};
+    v = Value::number(n + 1);
+    return {n, JitResult::NUMBER};
+}
+
+void VM::nativePrintArg(void* context, double value, int32_t type, int32_t space) {
+    VM& vm = *static_cast<VM*>(context);
+    vm.out.write(fromJitSlot(value, static_cast<JitType>(type), *vm.program));
+    if (space) vm.out.write(' ');
+}
+
+void VM::nativePrintEnd(void* context) {
+    static_cast<VM*>(context)->out.endLine();
+}
+
+void VM::nativeDefineFunction(void* context, int32_t name, int32_t index) {
+    static_cast<VM*>(context)->defineFunction(name, index);
+}
+
+JitResult VM::nativeDeopt(void* context, const JitCode* code, int32_t exit, const double* frame) {
+    VM& vm = *static_cast<VM*>(context);
+    const JitExit& point = code->exits[exit];
+    
+    // Only the frame that gave up counts against its function; its callers
+    // leave with it
+    if (vm.deopted.empty()) {
+        Tier& tier = vm.tiers[code->function];
+        if (++tier.deopts >= MAX_DEOPTS) tier.failed = true;
+    }
+    
+    DeoptFrame deopt{&vm.program->functions[code->function], point.pc, {}};
+    deopt.slots.reserve(point.slots.size());
+    for (size_t i = 0; i < point.slots.size(); ++i) {
+        deopt.slots.push_back(fromJitSlot(frame[i], point.slots[i], *vm.program));
+    }
+    vm.deopted.push_back(std::move(deopt));
+    return {0, JitResult::DEOPT};
+}
+
+void VM::reportMemo() {
+    for (const CompiledFunction& fn : program->functions) {
+        if (fn.memoSlot < 0 || static_cast<size_t>(fn.memoSlot) >= memos.size()) continue;
+        const MemoTable& table = memos[fn.memoSlot];
+        if (table.hits + table.misses > 0) table.report(fn.name, std::cerr);
+    }
+}
+
+// The helpers below leave their result in the first of their stack
+// slots. They keep their temporaries out of run(), where DISPATCH() would
+// skip the destructors.
+
+// sp[-2] + sp[-1] for anything but two numbers. Concatenation onto a
+// string nothing else holds appends to it in place.
+void VM::addSlow(Value* sp) {
+    Value& l = sp[-2];
+    Value& r = sp[-1];
+    double x, y;
+    if (l.tryNumber(x) && r.tryNumber(y)) {
+        l = Value::number(x + y);
+    } else if (isElementwise(l, r)) {
+        arrayArithmetic(ArrayOp::ADD, sp);
+    } else if (l.isUnsharedString()) {
+        l.append(r);
+    } else {
+        l = Value::string(l.toString() + r.toString());
+    }
+}
+
+// target += sp[-1] for ADD_TO_*. sp[-2] is the copy of target pushed
+// before sp[-1] was computed; target takes its place, which leaves a
+// string target unshared for addSlow() to append to.
+void VM::addTo(Value& target, Value* sp) {
+    if (target.isNumber() && sp[-1].isNumber()) {
+        target = Value::number(target.asNumber() + sp[-1].asNumber());
+        return;
+    }
+    sp[-2] = std::exchange(target, Value());
+    addSlow(sp);
+    target = std::move(sp[-2]);
+}
+
+void VM::arrayArithmetic(ArrayOp op, Value* sp) {
+    Value result;
+    check(elementwise(op, sp[-2], sp[-1], result));
+    sp[-2] = std::move(result);
+}
+
+void VM::arrayNegate(Value* sp) {
+    Value result;
+    check(negate(sp[-1], result));
+    sp[-1] = std::move(result);
+}
+
+void VM::makeArray(Value* values, int count) {
+    std::vector<Value> elements(std::make_move_iterator(values), std::make_move_iterator(values + count));
+    values[0] = Value::array(std::make_shared<Array>(std::move(elements)));
+}
+
+// items holds count keys, each followed by its value.
+void VM::makeMap(Value* items, int count) {
+    auto map = std::make_shared<Map>();
+    for (int i = 0; i < count; ++i) {
+        if (!Map::isKey(items[2 * i])) runtimeError(invalidKey(items[2 * i]));
+        map->set(items[2 * i], std::move(items[2 * i + 1]));
+    }
+    items[0] = Value::map(std::move(map));
+}
+
+void VM::builtin(Builtin id, Value* args, int argc) {
+    Value result;
+    check(callBuiltin(id, args, argc, result));
+    args[0] = std::move(result);
+}
+
+void VM::indexFailed(const Value& array, const Value& index) {
+    runtimeError(indexError(array, index));
+}
+
+void VM::check(const std::string& error) {
+    if (!error.empty()) runtimeError(error);
+}
+
+double VM::toNumber(const Value& value) {
+    double n;
+    if (value.tryNumber(n)) return n;
+    runtimeError("Expected a number but got '" + value.toString() + "'");
+}
+
+void VM::runtimeError(const std::string& message) {
+    // Flush first so the error lands after everything already printed
+    out.flush();
+    std::cerr << "Error: " << message << "\n";
+    exit(1);
+}
@@ -0,0 +1,119 @@
+#ifndef LFI3A_VM_HPP
+#define LFI3A_VM_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Builtins.hpp"
+#include "Bytecode.hpp"
+#include "Jit.hpp"
+#include "Memo.hpp"
+#include "Output.hpp"
+#include "Profiler.hpp"
+#include "Value.hpp"
+
+// Stack-based virtual machine for programs lowered by Compiler.
+class VM {
+public:
+    explicit VM(Output::Flush flush = Output::Flush::AUTO, size_t flushLimit = Output::DEFAULT_LIMIT)
+        : out(flush, flushLimit) {}
+    void run(const BytecodeProgram& program);
+    
+    // Caches results of pure functions, up to capacity entries each, and
+    // reports hits and misses on stderr when the program ends.
+    void enableMemo(size_t capacity) { memoCapacity = capacity; memoize = true; }
+    
+    // Compiles functions to native code once they have been called, or have
+    // looped, `threshold` times. Needs Jit::available().
+    void enableJit(uint32_t threshold) { jitThreshold = threshold; tiered = true; }
+    
+    // Reports calls to profiler, and the LINE instructions of a program
+    // compiled with Compiler::enableProfile().
+    void enableProfile(Profiler& profiler) { this->profiler = &profiler; }
+
+private:
+    struct Frame {
+        const CompiledFunction* function;
+        const Instruction* ip;  // resume point while a callee runs
+        size_t base;            // stack index of the frame's first local
+        int memoSlot = -1;      // table to store the result in, key on memoKeys
+    };
+
+    Output out;
+    bool memoize = false;
+    size_t memoCapacity = MemoTable::DEFAULT_CAPACITY;
+    std::vector<MemoTable> memos;
+    std::vector<MemoTable::Key> memoKeys;  // arguments of the calls being memoized
+    MemoTable::Key memoKey;                // arguments of the current call
+    Profiler* profiler = nullptr;
+    const BytecodeProgram* program = nullptr;
+    std::vector<Value> stack;
+    std::vector<Value> globals;
+    std::vector<int> functions;  // function name slot -> index into program->functions
+    std::vector<Frame> frames;
+    
+    // What each call site last resolved to, reset only when DEFINE_FUNCTION
+    // rebinds the name to a different function.
+    struct CallCache {
+        const CompiledFunction* function = nullptr;
+        int bound = 0;    // arguments that become parameters
+        int dropped = 0;  // extra arguments popped before the call
+    };
+    std::vector<CallCache> callCaches;               // indexed like program->callSites
+    std::vector<std::vector<int32_t>> callWatchers;  // function name slot -> sites caching it
+
+    // Native code of each function
+    struct Tier {
+        uint32_t heat = 0;    // calls and loop iterations while not compiled
+        uint32_t deopts = 0;  // native runs handed back to the VM part way
+        const JitCode* code = nullptr;
+        bool failed = false;  // cannot be compiled, or gave up too often
+    };
+    // A native frame handed back to the VM; innermost first in `deopted`
+    struct DeoptFrame {
+        const CompiledFunction* function;
+        int32_t pc;
+        std::vector<Value> slots;  // locals, then the operand stack
+    };
+
+    bool tiered = false;
+    uint32_t jitThreshold = Jit::DEFAULT_THRESHOLD;
+    std::unique_ptr<Jit> jit;
+    std::vector<Tier> tiers;
+    std::vector<double> jitStack;  // frames of the native calls in progress
+    size_t jitTop = 0;
+    int jitDepth = 0;
+    std::vector<DeoptFrame> deopted;
+
+    const CallCache& resolveCall(int32_t site);
+    void defineFunction(int32_t name, int32_t index);
+    const JitCode* nativeCode(const CompiledFunction& fn, bool force);
+    bool enterNative(const JitCode& code, int32_t pc, const Value* slots, size_t count, JitResult& result);
+    size_t restoreFrames(size_t base, int memoSlot);
+    
+    static const JitHooks hooks;
+    static JitResult nativeCall(void* context, int32_t site, double* args);
+    static const void* nativeTailCall(void* context, int32_t site, double* args, double* frame);
+    static JitResult nativeGetGlobal(void* context, int32_t slot);
+    static void nativeSetGlobal(void* context, int32_t slot, double value, int32_t type);
+    static JitResult nativeIncGlobal(void* context, int32_t slot);
+    static void nativePrintArg(void* context, double value, int32_t type, int32_t space);
+    static void nativePrintEnd(void* context);
+    static void nativeDefineFunction(void* context, int32_t name, int32_t index);
+    static JitResult nativeDeopt(void* context, const JitCode* code, int32_t exit, const double* frame);
+    
+    void addSlow(Value* sp);
+    void addTo(Value& target, Value* sp);
+    void arrayArithmetic(ArrayOp op, Value* sp);
+    void arrayNegate(Value* sp);
+    void makeArray(Value* values, int count);
+    void makeMap(Value* items, int count);
+    void builtin(Builtin id, Value* args, int argc);
+    [[noreturn]] void indexFailed(const Value& array, const Value& index);
+    void check(const std::string& error);  // reports a non-empty error from Builtins.hpp
+    double toNumber(const Value& value);
+    void reportMemo();
+    [[noreturn]] void runtimeError(const std::string& message);
+};
+
+#endif
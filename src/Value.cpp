@@ -0,0 +1,159 @@
+#include "Value.hpp"
+#include "Array.hpp"
+#include "Map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+std::string formatNumber(double n) {
+    char buf[32];
+    return std::string(buf, formatNumber(n, buf, sizeof(buf)));
+}
+
+size_t formatNumber(double n, char* buf, size_t size) {
+    // Integers below 1e15 print the same as %.15g, without the cost of it,
+    // except that -0 prints as 0
+    if (n > -1e15 && n < 1e15 && n == static_cast<long long>(n) && size >= 18) {
+        char digits[16];
+        unsigned long long u = static_cast<unsigned long long>(n < 0 ? -n : n);
+        size_t count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + u % 10);
+            u /= 10;
+        } while (u != 0);
+        size_t len = 0;
+        if (n < 0) buf[len++] = '-';
+        while (count > 0) buf[len++] = digits[--count];
+        buf[len] = '\0';
+        return len;
+    }
+    
+    int len = std::snprintf(buf, size, "%.15g", n);
+    if (len < 0) return 0;
+    return static_cast<size_t>(len) < size ? static_cast<size_t>(len) : size - 1;
+}
+
+bool parseNumber(std::string_view text, double& out) {
+    if (text.empty() || isspace(static_cast<unsigned char>(text[0]))) return false;
+    
+    // strtod needs a terminated string; numbers are short, so copy to the stack
+    char small[64];
+    std::string large;
+    const char* begin = small;
+    if (text.size() < sizeof(small)) {
+        std::memcpy(small, text.data(), text.size());
+        small[text.size()] = '\0';
+    } else {
+        // A long string is seldom a number. When strtod stops well short
+        // of the end of its first 63 characters, the rest can't make it
+        // one, so a string grown with + isn't copied just to find that
+        // out. Only nan(...) reads on arbitrarily far before deciding.
+        std::memcpy(small, text.data(), sizeof(small) - 1);
+        small[sizeof(small) - 1] = '\0';
+        char* end = nullptr;
+        std::strtod(small, &end);
+        const char* nan = small + (small[0] == '+' || small[0] == '-');
+        bool isNan = std::tolower(nan[0]) == 'n' && std::tolower(nan[1]) == 'a' && std::tolower(nan[2]) == 'n' &&
+                     nan[3] == '(';
+        if (end - small < 48 && !isNan) return false;
+        large.assign(text);
+        begin = large.c_str();
+    }
+    
+    char* end = nullptr;
+    double n = std::strtod(begin, &end);
+    if (end != begin + text.size()) return false;
+    out = n;
+    return true;
+}
+
+void Value::append(const Value& piece) {
+    Text& text = *static_cast<Text*>(const_cast<void*>(object_.get()));
+    if (piece.isString()) {
+        text.chars += piece.asString();
+    } else if (piece.isNumber()) {
+        char buf[32];
+        text.chars.append(buf, formatNumber(piece.asNumber(), buf, sizeof(buf)));
+    } else {
+        text.chars += piece.toString();
+    }
+    text.hash.store(0, std::memory_order_relaxed);
+}
+
+std::string Value::toString() const {
+    switch (type_) {
+        case Type::NUMBER:
+            return formatNumber(number_);
+        case Type::BOOLEAN:
+            return boolean_ ? "s7i7" : "ghalat";
+        case Type::STRING:
+            return asString();
+        case Type::ARRAY:
+            return arrayToString(asArray());
+        case Type::MAP:
+            return mapToString(asMap());
+        case Type::NIL:
+            break;
+    }
+    return "";
+}
+
+bool Value::tryNumber(double& out) const {
+    switch (type_) {
+        case Type::NUMBER:
+            out = number_;
+            return true;
+        case Type::STRING:
+            return parseNumber(asString(), out);
+        default:
+            return false;
+    }
+}
+
+bool Value::isTruthy() const {
+    switch (type_) {
+        case Type::NUMBER:
+            return number_ != 0;
+        case Type::BOOLEAN:
+            return boolean_;
+        case Type::STRING: {
+            const std::string& s = asString();
+            return !(s.empty() || s == "0" || s == "0.0" || s == "ghalat");
+        }
+        case Type::ARRAY:
+            return asArray().size() > 0;
+        case Type::MAP:
+            return asMap().size() > 0;
+        case Type::NIL:
+            break;
+    }
+    return false;
+}
+
+bool Value::equals(const Value& other) const {
+    if (type_ != other.type_) {
+        return toString() == other.toString();
+    }
+    switch (type_) {
+        case Type::NUMBER:
+            return number_ == other.number_;
+        case Type::BOOLEAN:
+            return boolean_ == other.boolean_;
+        case Type::STRING:
+            return object_ == other.object_ || asString() == other.asString();
+        case Type::ARRAY:
+        case Type::MAP:
+            return object_ == other.object_;
+        case Type::NIL:
+            break;
+    }
+    return true;
+}
+
+uint64_t Value::hashChars(const std::string& chars) {
+    uint64_t hash = std::hash<std::string_view>()(chars);
+    return hash != 0 ? hash : 1;
+}
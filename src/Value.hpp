@@ -0,0 +1,148 @@
+#ifndef LFI3A_VALUE_HPP
+#define LFI3A_VALUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <memory>
+
+class Array;
+class Map;
+
+// A runtime value. Numbers and booleans are stored inline; strings are
+// shared and immutable, so copying a Value never copies character data.
+// (A string only one Value holds may still grow in place; see append().)
+// Arrays and maps are shared too, but mutable: every copy sees a[i] = v.
+class Value {
+public:
+    enum class Type : unsigned char {
+        NIL,
+        NUMBER,
+        BOOLEAN,
+        STRING,
+        ARRAY,
+        MAP
+    };
+
+    Value() : type_(Type::NIL), number_(0) {}
+
+    static Value number(double n) {
+        Value v;
+        v.type_ = Type::NUMBER;
+        v.number_ = n;
+        return v;
+    }
+
+    static Value boolean(bool b) {
+        Value v;
+        v.type_ = Type::BOOLEAN;
+        v.boolean_ = b;
+        return v;
+    }
+
+    static Value string(std::string s) {
+        Value v;
+        v.type_ = Type::STRING;
+        v.object_ = std::make_shared<Text>(std::move(s));
+        return v;
+    }
+
+    static Value array(std::shared_ptr<Array> a) {
+        Value v;
+        v.type_ = Type::ARRAY;
+        v.object_ = std::move(a);
+        return v;
+    }
+
+    static Value map(std::shared_ptr<Map> m) {
+        Value v;
+        v.type_ = Type::MAP;
+        v.object_ = std::move(m);
+        return v;
+    }
+
+    Type type() const { return type_; }
+    bool isNil() const { return type_ == Type::NIL; }
+    bool isNumber() const { return type_ == Type::NUMBER; }
+    bool isBoolean() const { return type_ == Type::BOOLEAN; }
+    bool isString() const { return type_ == Type::STRING; }
+    bool isArray() const { return type_ == Type::ARRAY; }
+    bool isMap() const { return type_ == Type::MAP; }
+    // Arrays and maps: values that can change after they are made
+    bool isContainer() const { return type_ >= Type::ARRAY; }
+
+    double asNumber() const { return number_; }
+    bool asBoolean() const { return boolean_; }
+    const std::string& asString() const { return static_cast<const Text*>(object_.get())->chars; }
+    Array& asArray() const { return *static_cast<Array*>(const_cast<void*>(object_.get())); }
+    Map& asMap() const { return *static_cast<Map*>(const_cast<void*>(object_.get())); }
+
+    // Hash of a string value's characters, never 0. It is worked out the
+    // first time and kept with them, so a string used as a map key again
+    // and again, like a literal, is only hashed once.
+    uint64_t stringHash() const {
+        const Text& text = *static_cast<const Text*>(object_.get());
+        uint64_t hash = text.hash.load(std::memory_order_relaxed);
+        if (hash == 0) {
+            // Racing threads store the same hash, so relaxed is enough
+            hash = hashChars(text.chars);
+            text.hash.store(hash, std::memory_order_relaxed);
+        }
+        return hash;
+    }
+
+    // Whether this is a string no other Value shares.
+    bool isUnsharedString() const { return type_ == Type::STRING && object_.use_count() == 1; }
+
+    // Adds the textual form of piece to the end of this string, which
+    // must be unshared. The characters grow like a std::string, so a
+    // string built up piece by piece takes amortized linear time.
+    void append(const Value& piece);
+
+    // Textual form, as printed by kteb ("s7i7"/"ghalat" for booleans,
+    // "[1, 2, 3]" for arrays, "{a: 1, b: x}" for maps).
+    std::string toString() const;
+
+    // Truthiness used by conditions: nil, ghalat, 0, the empty array, the
+    // empty map and the empty string (or the strings "0", "0.0" and
+    // "ghalat") are false.
+    bool isTruthy() const;
+
+    // Equality used by == and !=. Values of different types compare by
+    // their textual form, so 5 == "5". Arrays and maps are equal only to
+    // themselves.
+    bool equals(const Value& other) const;
+
+    // Numeric interpretation: numbers as-is, strings only if the whole
+    // string is a number. Returns false when there is none.
+    bool tryNumber(double& out) const;
+
+private:
+    struct Text {
+        explicit Text(std::string chars) : chars(std::move(chars)), hash(0) {}
+        std::string chars;
+        mutable std::atomic<uint64_t> hash;
+    };
+
+    static uint64_t hashChars(const std::string& chars);
+
+    Type type_;
+    union {
+        double number_;
+        bool boolean_;
+    };
+    std::shared_ptr<const void> object_;  // the Text, Array or Map, by type
+};
+
+// Formats a number the way kteb prints it: integral values without a
+// fractional part, everything else with up to 15 significant digits.
+std::string formatNumber(double n);
+
+// Same, into buf; returns the length written (at most size - 1).
+size_t formatNumber(double n, char* buf, size_t size);
+
+// Parses the whole of `text` as a number.
+bool parseNumber(std::string_view text, double& out);
+
+#endif
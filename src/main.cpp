@@ -1,47 +1,301 @@
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <string>
+#include "Error.hpp"
+#include "SourceFile.hpp"
 #include "Lexer.hpp"
 #include "Parser.hpp"
+#include "ProgramCache.hpp"
+#include "Resolver.hpp"
+#include "Optimizer.hpp"
+#include "Purity.hpp"
+#include "Profiler.hpp"
 #include "Interpreter.hpp"
+#include "Compiler.hpp"
+#include "CppEmitter.hpp"
+#include "Jit.hpp"
+#include "Server.hpp"
+#include "VM.hpp"
 
 static bool endsWith(const std::string &s, const std::string &suffix) {
     return s.size() >= suffix.size() &&
            s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
 }
 
+static void usage() {
+    std::cerr << "Usage: lfi3a [--vm] [--jit[=<n>]] [--no-opt] [--no-cache] [--dump-ast] [--emit-cpp] [--memo[=<n>]] [--profile] [--flush=exit|line|<bytes>] <file.lfi3a>\n"
+              << "       lfi3a --serve=<socket> [--workers=<n>] [--time-limit=<s>] [--no-opt] [--no-cache] [--flush=...]\n"
+              << "       lfi3a --client=<socket> [--time] <file.lfi3a|->\n"
+              << "  --vm              run on the bytecode VM instead of the tree-walker\n"
+              << "  --jit[=<n>]       run on the VM and compile functions and loops to x86-64\n"
+              << "                    code after <n> calls or iterations (default 1000)\n"
+              << "  --no-opt          skip constant folding and dead-branch elimination\n"
+              << "  --no-cache        always parse; do not read or write <file>.lfi3ac\n"
+              << "  --dump-ast        print the (optimized) syntax tree instead of running\n"
+              << "  --emit-cpp        print the program as standalone C++ instead of running;\n"
+              << "                    build it against src/runtime (see the first lines)\n"
+              << "  --memo[=<n>]      cache results of pure functions, up to <n> per function\n"
+              << "                    (default 100000), and report hits and misses at exit\n"
+              << "  --profile         report per-line and per-function counts and times at exit\n"
+              << "  --flush=exit      write kteb output only when the program ends\n"
+              << "  --flush=line      write kteb output after every line\n"
+              << "  --flush=<bytes>   write kteb output once <bytes> are buffered\n"
+              << "                    (default: line on a terminal, 65536 otherwise)\n"
+              << "  --serve=<socket>  run scripts sent to the Unix socket <socket> until stopped,\n"
+              << "                    keeping compiled programs (--no-cache: don't)\n"
+              << "  --workers=<n>     scripts --serve runs at once (default: one per CPU)\n"
+              << "  --time-limit=<s>  stop scripts --serve runs after <s> seconds with an error\n"
+              << "                    (default 30; 0 for no limit)\n"
+              << "  --client=<socket> run <file>, or the script on stdin for -, on the server\n"
+              << "                    at <socket>\n"
+              << "  --time            report the server's compile and run times on stderr\n";
+}
+
+static bool parseFlush(const std::string& spec, Output::Flush& flush, size_t& limit) {
+    if (spec == "exit") {
+        flush = Output::Flush::AT_EXIT;
+        return true;
+    }
+    if (spec == "line") {
+        flush = Output::Flush::LINE;
+        return true;
+    }
+    if (spec.empty() || spec.find_first_not_of("0123456789") != std::string::npos) return false;
+    flush = Output::Flush::BYTES;
+    limit = std::strtoull(spec.c_str(), nullptr, 10);
+    return true;
+}
+
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: lfi3a <file.lfi3a>\n";
+    bool useVM = false;
+    bool optimize = true;
+    bool useCache = true;
+    bool dumpTree = false;
+    bool emitCpp = false;
+    bool memoize = false;
+    bool useJit = false;
+    bool profile = false;
+    uint32_t jitThreshold = Jit::DEFAULT_THRESHOLD;
+    size_t memoCapacity = MemoTable::DEFAULT_CAPACITY;
+    Output::Flush flush = Output::Flush::AUTO;
+    size_t flushLimit = Output::DEFAULT_LIMIT;
+    std::string serveSocket;
+    std::string clientSocket;
+    unsigned workers = 0;
+    unsigned timeLimit = ServerOptions::DEFAULT_TIME_LIMIT;
+    bool timeLimitGiven = false;
+    bool showTime = false;
+    std::string path;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vm") {
+            useVM = true;
+        } else if (arg == "--jit") {
+            useVM = useJit = true;
+        } else if (arg.compare(0, 6, "--jit=") == 0) {
+            std::string count = arg.substr(6);
+            if (count.empty() || count.size() > 9 || count.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Error: Invalid JIT threshold '" << count << "'\n";
+                usage();
+                return 1;
+            }
+            useVM = useJit = true;
+            jitThreshold = static_cast<uint32_t>(std::strtoul(count.c_str(), nullptr, 10));
+        } else if (arg == "--no-opt") {
+            optimize = false;
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (arg == "--dump-ast") {
+            dumpTree = true;
+        } else if (arg == "--emit-cpp") {
+            emitCpp = true;
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--memo") {
+            memoize = true;
+        } else if (arg.compare(0, 7, "--memo=") == 0) {
+            std::string count = arg.substr(7);
+            if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Error: Invalid memo size '" << count << "'\n";
+                usage();
+                return 1;
+            }
+            memoize = true;
+            memoCapacity = std::strtoull(count.c_str(), nullptr, 10);
+        } else if (arg.compare(0, 8, "--flush=") == 0) {
+            if (!parseFlush(arg.substr(8), flush, flushLimit)) {
+                std::cerr << "Error: Invalid flush policy '" << arg.substr(8) << "'\n";
+                usage();
+                return 1;
+            }
+        } else if (arg.compare(0, 8, "--serve=") == 0) {
+            serveSocket = arg.substr(8);
+        } else if (arg.compare(0, 9, "--client=") == 0) {
+            clientSocket = arg.substr(9);
+        } else if (arg.compare(0, 10, "--workers=") == 0) {
+            std::string count = arg.substr(10);
+            if (count.empty() || count.size() > 4 || count.find_first_not_of("0123456789") != std::string::npos ||
+                std::stoul(count) == 0) {
+                std::cerr << "Error: Invalid worker count '" << count << "'\n";
+                usage();
+                return 1;
+            }
+            workers = static_cast<unsigned>(std::stoul(count));
+        } else if (arg.compare(0, 13, "--time-limit=") == 0) {
+            std::string seconds = arg.substr(13);
+            if (seconds.empty() || seconds.size() > 6 || seconds.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Error: Invalid time limit '" << seconds << "'\n";
+                usage();
+                return 1;
+            }
+            timeLimit = static_cast<unsigned>(std::stoul(seconds));
+            timeLimitGiven = true;
+        } else if (arg == "--time") {
+            showTime = true;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Error: Unknown option '" << arg << "'\n";
+            usage();
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+
+    if (!serveSocket.empty() || !clientSocket.empty()) {
+        if (!serverAvailable()) {
+            std::cerr << "Error: --serve and --client need a POSIX build\n";
+            return 1;
+        }
+        // Scripts run on the server's tree-walker, with the server's options
+        if (useVM || memoize || profile || dumpTree || emitCpp || (!serveSocket.empty() && !clientSocket.empty())) {
+            std::cerr << "Error: --serve and --client only go with the options listed for them\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (!serveSocket.empty()) {
+        if (!path.empty() || showTime) {
+            usage();
+            return 1;
+        }
+        ServerOptions options;
+        options.socketPath = serveSocket;
+        options.workers = workers;
+        options.optimize = optimize;
+        options.cacheEntries = useCache ? ServerOptions::DEFAULT_CACHE_ENTRIES : 0;
+        options.flush = flush;
+        options.flushLimit = flushLimit;
+        options.timeLimit = timeLimit;
+        return serve(options);
+    }
+
+    if (!clientSocket.empty()) {
+        if (path.empty() || workers || timeLimitGiven || !optimize || !useCache || flush != Output::Flush::AUTO) {
+            usage();
+            return 1;
+        }
+        return runClient(clientSocket, path, showTime);
+    }
+
+    if (path.empty() || workers || timeLimitGiven || showTime) {
+        usage();
+        return 1;
+    }
+
+    if (useJit && !Jit::available()) {
+        std::cerr << "Error: --jit needs an x86-64 Linux build\n";
+        return 1;
+    }
+
+    if (useJit && profile) {
+        std::cerr << "Error: --profile cannot be combined with --jit\n";
         return 1;
     }
 
-    std::string path = argv[1];
     if (!endsWith(path, ".lfi3a")) {
         std::cerr << "Error: Only .lfi3a files are allowed\n";
         return 1;
     }
 
-    std::ifstream file(path);
-    if (!file.is_open()) {
+    SourceFile source;
+    if (!source.open(path)) {
         std::cerr << "Error: Cannot open file '" << path << "'\n";
         return 1;
     }
 
-    std::string code((std::istreambuf_iterator<char>(file)),
-                      std::istreambuf_iterator<char>());
+    // Syntax errors, and runtime errors on the tree-walker, end up here
+    try {
+        // A fresh cache stands in for the lexer and parser. Cached node text
+        // points into the mapped cache file, so it has to outlive the program.
+        SourceFile cacheFile;
+        Program program;
+        std::string cachePath = programCachePath(path);
+        if (!useCache || !cacheFile.open(cachePath) || !loadProgramCache(cacheFile.text(), source.text(), program)) {
+            // Lexer + parser; the parser pulls tokens as it needs them
+            auto symbols = std::make_shared<SymbolTable>();
+            Lexer lexer(source.text(), *symbols);
+            Parser parser(lexer, symbols);
+            program = parser.parse();
+            if (useCache) storeProgramCache(cachePath, source.text(), program);
+        }
 
-    // Lexer
-    Lexer lexer(code);
-    auto tokens = lexer.tokenize();
+        // Resolver
+        Resolver resolver;
+        resolver.resolve(program);
 
-    // Parser
-    Parser parser(tokens);
-    auto ast = parser.parse();
+        // Optimizer
+        if (optimize) {
+            Optimizer optimizer;
+            optimizer.optimize(program);
+        }
 
-    // Interpreter
-    Interpreter interpreter;
-    interpreter.run(ast);
+        // Purity analysis, for memoization
+        if (memoize) {
+            Purity purity;
+            purity.analyze(program);
+        }
+
+        if (dumpTree) {
+            dumpAST(program, std::cout);
+            return 0;
+        }
+
+        if (emitCpp) {
+            // Ahead-of-time: C++ for the system compiler, output policy baked in
+            CppEmitter emitter(flush, flushLimit);
+            emitter.emit(program, path, std::cout);
+            return 0;
+        }
+
+        std::unique_ptr<Profiler> profiler;
+        if (profile) profiler = std::make_unique<Profiler>(source.text(), *program.symbols);
+
+        if (useVM) {
+            // Bytecode compiler + VM
+            Compiler compiler;
+            if (profiler) compiler.enableProfile();
+            BytecodeProgram bytecode = compiler.compile(program);
+            VM vm(flush, flushLimit);
+            if (memoize) vm.enableMemo(memoCapacity);
+            if (useJit) vm.enableJit(jitThreshold);
+            if (profiler) vm.enableProfile(*profiler);
+            vm.run(bytecode);
+        } else {
+            // Interpreter
+            Interpreter interpreter(flush, flushLimit);
+            if (memoize) interpreter.enableMemo(memoCapacity);
+            if (profiler) interpreter.enableProfile(*profiler);
+            interpreter.run(program);
+        }
+
+        if (profiler) profiler->report(std::cerr);
+    } catch (const ScriptError& error) {
+        std::cerr << "Error: " << error.what() << "\n";
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,144 @@
+#include "Runtime.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include "../Stack.hpp"
+
+namespace rt {
+
+Output* out = nullptr;
+
+static const Function* pendingTail = nullptr;
+static std::vector<Value> tailArgs;
+static uintptr_t stackLimit = 0;  // lowest stack address a call may start at
+
+void start(Output::Flush flush, size_t limit) {
+    out = new Output(flush, limit);
+    stackLimit = callStackLimit();
+}
+
+void makeStrings(Value* strings, const StringData* data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        strings[i] = Value::string(std::string(data[i].text, data[i].length));
+    }
+}
+
+void finish() {
+    out->flush();
+}
+
+void print(const Value& value) {
+    out->write(value);
+}
+
+void printSpace() {
+    out->write(' ');
+}
+
+void printEnd() {
+    out->endLine();
+}
+
+void error(const std::string& message) {
+    // Flush first so the error lands after everything already printed
+    out->flush();
+    std::cerr << "Error: " << message << "\n";
+    exit(1);
+}
+
+void undefinedVariable(const char* name) {
+    error("Undefined variable '" + std::string(name) + "'");
+}
+
+void undefinedFunction(const char* name) {
+    error("Undefined function '" + std::string(name) + "'");
+}
+
+void notANumber(const Value& value) {
+    error("Expected a number but got '" + value.toString() + "'");
+}
+
+void badIndex(const Value& array, const Value& index) {
+    error(indexError(array, index));
+}
+
+double parseOperand(const Value& value) {
+    double n;
+    if (!value.tryNumber(n)) notANumber(value);
+    return n;
+}
+
+Value addSlow(const Value& l, const Value& r) {
+    double x, y;
+    if (l.tryNumber(x) && r.tryNumber(y)) return Value::number(x + y);
+    if (isElementwise(l, r)) return elementwise(ArrayOp::ADD, l, r);
+    return Value::string(l.toString() + r.toString());
+}
+
+void addToSlow(Value& variable, const Value& r) {
+    // A string only the variable holds grows in place
+    double x, y;
+    if (variable.isUnsharedString() && !(variable.tryNumber(x) && r.tryNumber(y)) && !isElementwise(variable, r)) {
+        variable.append(r);
+    } else {
+        variable = addSlow(variable, r);
+    }
+}
+
+Value elementwise(ArrayOp op, const Value& l, const Value& r) {
+    Value result;
+    std::string message = ::elementwise(op, l, r, result);
+    if (!message.empty()) error(message);
+    return result;
+}
+
+Value negate(const Value& operand) {
+    Value result;
+    std::string message = ::negate(operand, result);
+    if (!message.empty()) error(message);
+    return result;
+}
+
+Value makeArray(Value* values, int count) {
+    std::vector<Value> elements(std::make_move_iterator(values), std::make_move_iterator(values + count));
+    return Value::array(std::make_shared<Array>(std::move(elements)));
+}
+
+Value makeMap(Value* items, int count) {
+    auto map = std::make_shared<Map>();
+    for (int i = 0; i < count; i += 2) {
+        if (!Map::isKey(items[i])) error(invalidKey(items[i]));
+        map->set(items[i], std::move(items[i + 1]));
+    }
+    return Value::map(std::move(map));
+}
+
+Value builtin(int id, Value* args, int argc) {
+    Value result;
+    std::string message = callBuiltin(static_cast<Builtin>(id), args, argc, result);
+    if (!message.empty()) error(message);
+    return result;
+}
+
+Value call(const Function* function, Value* args, int argc) {
+    char here;
+    if (reinterpret_cast<uintptr_t>(&here) < stackLimit) error("Too much recursion");
+    Value result = function->body(args, argc);
+    std::vector<Value> frame;
+    while (pendingTail) {
+        const Function* next = pendingTail;
+        pendingTail = nullptr;
+        frame.swap(tailArgs);
+        result = next->body(frame.data(), static_cast<int>(frame.size()));
+    }
+    return result;
+}
+
+Value tailCall(const Function* function, Value* args, int argc) {
+    pendingTail = function;
+    tailArgs.assign(std::make_move_iterator(args), std::make_move_iterator(args + argc));
+    return Value();
+}
+
+}  // namespace rt
@@ -0,0 +1,166 @@
+#ifndef LFI3A_RUNTIME_HPP
+#define LFI3A_RUNTIME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "../Builtins.hpp"
+#include "../Output.hpp"
+#include "../Value.hpp"
+
+// Support code for programs produced by lfi3a --emit-cpp. Every operation
+// behaves exactly like the corresponding case of Interpreter::evaluate,
+// including its error messages.
+namespace rt {
+
+// A compiled dalla. The body binds its own parameters and locals.
+struct Function {
+    const char* name;
+    Value (*body)(Value* args, int argc);
+};
+
+// A string literal; the text may contain NUL bytes.
+struct StringData {
+    const char* text;
+    size_t length;
+};
+
+extern Output* out;
+
+void start(Output::Flush flush, size_t limit);
+void makeStrings(Value* strings, const StringData* data, size_t count);
+void finish();
+
+// kteb, one piece at a time
+void print(const Value& value);
+void printSpace();
+void printEnd();
+
+[[noreturn]] void error(const std::string& message);
+[[noreturn]] void undefinedVariable(const char* name);
+[[noreturn]] void undefinedFunction(const char* name);
+[[noreturn]] void notANumber(const Value& value);
+[[noreturn]] void badIndex(const Value& array, const Value& index);
+
+inline Value fromBits(uint64_t bits) {
+    double n;
+    std::memcpy(&n, &bits, sizeof(n));
+    return Value::number(n);
+}
+
+inline const Value& get(const Value& variable, const char* name) {
+    if (variable.isNil()) undefinedVariable(name);
+    return variable;
+}
+
+// Only the number cases are inline; everything else is out of line so
+// generated programs stay quick to compile.
+double parseOperand(const Value& value);
+Value addSlow(const Value& l, const Value& r);
+Value elementwise(ArrayOp op, const Value& l, const Value& r);
+Value negate(const Value& operand);
+
+inline double toNumber(const Value& value) {
+    return value.isNumber() ? value.asNumber() : parseOperand(value);
+}
+
+inline bool truthy(const Value& value) {
+    return value.isBoolean() ? value.asBoolean() : value.isTruthy();
+}
+
+inline Value add(const Value& l, const Value& r) {
+    if (l.isNumber() && r.isNumber()) return Value::number(l.asNumber() + r.asNumber());
+    return addSlow(l, r);
+}
+
+// variable = variable + r, for the x = x + e the Resolver marks inPlace
+void addToSlow(Value& variable, const Value& r);
+
+inline void addTo(Value& variable, const Value& r) {
+    if (variable.isNumber() && r.isNumber()) {
+        variable = Value::number(variable.asNumber() + r.asNumber());
+    } else {
+        addToSlow(variable, r);
+    }
+}
+
+inline Value sub(const Value& l, const Value& r) {
+    if (l.isArray() || r.isArray()) return elementwise(ArrayOp::SUB, l, r);
+    return Value::number(toNumber(l) - toNumber(r));
+}
+
+inline Value mul(const Value& l, const Value& r) {
+    if (l.isArray() || r.isArray()) return elementwise(ArrayOp::MUL, l, r);
+    return Value::number(toNumber(l) * toNumber(r));
+}
+
+inline Value div(const Value& l, const Value& r) {
+    if (l.isArray() || r.isArray()) return elementwise(ArrayOp::DIV, l, r);
+    double x = toNumber(l);
+    double y = toNumber(r);
+    if (y == 0) error("Division by zero");
+    return Value::number(x / y);
+}
+
+inline Value eq(const Value& l, const Value& r) { return Value::boolean(l.equals(r)); }
+inline Value ne(const Value& l, const Value& r) { return Value::boolean(!l.equals(r)); }
+inline Value lt(const Value& l, const Value& r) { return Value::boolean(toNumber(l) < toNumber(r)); }
+inline Value gt(const Value& l, const Value& r) { return Value::boolean(toNumber(l) > toNumber(r)); }
+inline Value le(const Value& l, const Value& r) { return Value::boolean(toNumber(l) <= toNumber(r)); }
+inline Value ge(const Value& l, const Value& r) { return Value::boolean(toNumber(l) >= toNumber(r)); }
+
+// Both sides are always evaluated; w and wla do not short-circuit
+inline Value both(const Value& l, const Value& r) { return Value::boolean(l.isTruthy() && r.isTruthy()); }
+inline Value either(const Value& l, const Value& r) { return Value::boolean(l.isTruthy() || r.isTruthy()); }
+
+inline Value neg(const Value& operand) {
+    if (operand.isArray()) return negate(operand);
+    return Value::number(-toNumber(operand));
+}
+
+Value makeArray(Value* values, int count);
+Value makeMap(Value* items, int count);  // keys and values alternate
+
+inline Value index(const Value& array, const Value& index) {
+    Value element;
+    if (!getElement(array, index, element)) badIndex(array, index);
+    return element;
+}
+
+inline void setIndex(const Value& array, const Value& index, Value value) {
+    if (!setElement(array, index, std::move(value))) badIndex(array, index);
+}
+
+Value builtin(int id, Value* args, int argc);
+
+// x++ given the value of x that was just read
+inline Value postIncrement(Value& variable, const Value& current) {
+    double n = toNumber(current);
+    variable = Value::number(n + 1);
+    return Value::number(n);
+}
+
+inline const Function* resolve(const Function* function, const char* name) {
+    if (!function) undefinedFunction(name);
+    return function;
+}
+
+// Moves min(argc, arity) arguments into the first locals; the rest stay nil.
+inline void bind(Value* locals, int arity, Value* args, int argc) {
+    int bound = argc < arity ? argc : arity;
+    for (int i = 0; i < bound; ++i) {
+        locals[i] = std::move(args[i]);
+    }
+}
+
+// Runs a call and any tail calls it hands back.
+Value call(const Function* function, Value* args, int argc);
+
+// For rje3 f(...): records the call for the enclosing call() to run once
+// the current body has returned.
+Value tailCall(const Function* function, Value* args, int argc);
+
+}  // namespace rt
+
+#endif
@@ -0,0 +1,118 @@
+#!/bin/bash
+# Cache test: a .lfi3ac whose nodes lack children their type needs, with
+# the payload hash redone to match so only the shape check can catch it,
+# is thrown away. The script runs from its source and the cache is written
+# afresh.
+#
+# tests/run.sh runs it along with the others.
+
+. "$(dirname "$0")/lib.sh"
+
+cat > "$work/x.lfi3a" << 'EOF'
+dalla add(a, b) {
+    rje3 a + b
+}
+dir i = 0
+ma7ad (i < 3) {
+    i = i + 1
+}
+kteb(add(i, 4))
+EOF
+"$LFI3A" "$work/x.lfi3a" > /dev/null || fail "first run failed"
+[ -f "$work/x.lfi3ac" ] || fail "no cache was written"
+cp "$work/x.lfi3ac" "$work/clean.lfi3ac"
+
+# Rewrites the cache in place: `drop <type>` removes the last child of the
+# first node of that NodeType, `body` cuts the first function from its body
+corrupt() {
+    python3 - "$work/x.lfi3ac" "$@" << 'PY'
+import struct, sys
+
+path, mode = sys.argv[1], sys.argv[2]
+HEADER = struct.Struct("<4sIIIQQQQQIIII")
+MASK = (1 << 64) - 1
+HAS_FUNCTION, HAS_NUMBER, HAS_VALUE = 2, 4, 8
+FUNCTION_DECL = 15
+
+def hash_bytes(data):
+    h = 0x9e3779b97f4a7c15 ^ len(data)
+    whole = len(data) - len(data) % 8
+    for i in range(0, whole, 8):
+        h = ((h ^ int.from_bytes(data[i:i + 8], "little")) * 0xff51afd7ed558ccd) & MASK
+        h ^= h >> 32
+    h = ((h ^ int.from_bytes(data[whole:], "little")) * 0xc4ceb9fe1a85ec53) & MASK
+    return h ^ (h >> 29)
+
+image = open(path, "rb").read()
+fields = list(HEADER.unpack_from(image))
+nodes, payload_hash, stream_size = fields[3], fields[6], fields[7]
+symbols, strings = fields[9], fields[10]
+payload = bytearray(image[HEADER.size:])
+if hash_bytes(payload) != payload_hash:
+    sys.exit("the cache hash does not match this test's copy of hashBytes")
+
+pos = 0
+def number():
+    global pos
+    n = shift = 0
+    while True:
+        b = payload[pos]
+        pos += 1
+        n |= (b & 0x7f) << shift
+        shift += 7
+        if b < 0x80:
+            return n
+
+for _ in range((symbols + strings) * 2):
+    number()
+for _ in range(nodes):
+    type, flags = payload[pos], payload[pos + 2]
+    pos += 3
+    for _ in range(5):
+        number()
+    if flags & HAS_VALUE:
+        number(), number()
+    if flags & HAS_NUMBER:
+        pos += 8
+    count_at = pos
+    count = number()
+    for _ in range(count):
+        last_at = pos
+        number()
+    if mode == "drop" and type == int(sys.argv[3]):
+        del payload[last_at:pos]
+        payload[count_at] = count - 1
+        break
+    if flags & HAS_FUNCTION:
+        for _ in range(2):
+            for _ in range(number()):
+                number()
+        body_at = pos
+        number()
+        if mode == "body" and type == FUNCTION_DECL:
+            payload[body_at:pos] = b"\0"
+            break
+        number()
+else:
+    sys.exit("no node to corrupt")
+
+fields[6] = hash_bytes(payload)
+fields[7] = stream_size - (len(image) - HEADER.size - len(payload))
+open(path, "wb").write(HEADER.pack(*fields) + payload)
+PY
+}
+
+check() {
+    cp "$work/clean.lfi3ac" "$work/x.lfi3ac"
+    corrupt "$@" || fail "could not corrupt the cache ($*)"
+    cmp -s "$work/x.lfi3ac" "$work/clean.lfi3ac" && fail "the cache did not change ($*)"
+    out=$("$LFI3A" "$work/x.lfi3a" 2>&1) || fail "corrupted cache ($*) failed with '$out'"
+    [ "$out" = "7" ] || fail "corrupted cache ($*) printed '$out'"
+    cmp -s "$work/x.lfi3ac" "$work/clean.lfi3ac" || fail "corrupted cache ($*) was not rewritten"
+}
+
+check drop 4   # BINARY_OP a + b with only a
+check drop 13  # WHILE without its body
+check body     # add() without a body
+
+echo "cache test passed"
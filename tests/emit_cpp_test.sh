@@ -0,0 +1,59 @@
+#!/bin/bash
+# Emitted C++ test: a program built from --emit-cpp output prints what the
+# tree-walker prints and fails the way it does, including on recursion
+# too deep for the stack.
+#
+# tests/run.sh runs it along with the others.
+
+. "$(dirname "$0")/lib.sh"
+
+# The runtime once, then each program against it
+runtime=(src/runtime/Runtime.cpp src/Value.cpp src/Array.cpp src/Map.cpp src/Builtins.cpp src/Output.cpp)
+mkdir "$work/runtime"
+for source in "${runtime[@]}"; do
+    g++ -std=c++17 -O2 -c "$source" -o "$work/runtime/$(basename "$source" .cpp).o" || fail "cannot build $source"
+done
+
+# Runs name.lfi3a on the tree-walker and as a built program, and checks
+# that both print the same, report the same and exit the same way
+same() {
+    "$LFI3A" --no-cache "$work/$1.lfi3a" > "$work/$1.want" 2> "$work/$1.want_err"
+    local want=$?
+    "$LFI3A" --emit-cpp "$work/$1.lfi3a" > "$work/$1.cpp" || fail "cannot emit $1"
+    g++ -std=c++17 -O2 -Isrc/runtime "$work/$1.cpp" "$work"/runtime/*.o -o "$work/$1" -pthread || fail "cannot build $1"
+    "$work/$1" > "$work/$1.got" 2> "$work/$1.got_err"
+    local got=$?
+    [ $got -eq $want ] || fail "$1 exited with $got, not $want"
+    cmp -s "$work/$1.got" "$work/$1.want" || fail "$1 printed '$(cat "$work/$1.got")'"
+    cmp -s "$work/$1.got_err" "$work/$1.want_err" || fail "$1 reported '$(cat "$work/$1.got_err")'"
+}
+
+cat > "$work/fib.lfi3a" << 'EOF2'
+dalla fib(n) {
+    ila (n < 2) {
+        rje3 n
+    }
+    rje3 fib(n - 1) + fib(n - 2)
+}
+kol (i = 0; i < 20; i++) {
+    kteb("fib", i, "=", fib(i))
+}
+EOF2
+same fib
+
+# "start" waits in the output buffer when the recursion runs out of stack
+cat > "$work/deep.lfi3a" << 'EOF2'
+dalla f(n) {
+    ila (n == 0) {
+        rje3 0
+    }
+    rje3 1 + f(n - 1)
+}
+kteb("start")
+kteb(f(1000000))
+EOF2
+same deep
+[ "$(cat "$work/deep.got")" = "start" ] || fail "deep printed '$(cat "$work/deep.got")'"
+grep -q "^Error: Too much recursion$" "$work/deep.got_err" || fail "deep reported '$(cat "$work/deep.got_err")'"
+
+echo "emit-cpp test passed"
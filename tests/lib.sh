@@ -0,0 +1,40 @@
+# Setup shared by the tests/*_test.sh scripts, which source it first:
+#
+#   . "$(dirname "$0")/lib.sh"
+#
+# Gives them $LFI3A, the binary under test (./lfi3a unless set), a $work
+# directory removed on exit, fail() and deepest(). A test that needs more
+# cleanup defines cleanup() after sourcing this. Every test runs on the
+# default 8 MiB stack, whatever the shell was started with.
+
+LFI3A=${LFI3A:-./lfi3a}
+work=$(mktemp -d)
+
+cleanup() {
+    :
+}
+trap 'cleanup; rm -rf "$work"' EXIT
+
+fail() {
+    echo "FAIL: $1" >&2
+    exit 1
+}
+
+ulimit -s 8192 || fail "cannot set the stack size"
+
+# The largest n up to max for which `command... n` succeeds, given that it
+# does for 1 and that it stops succeeding past some n.
+deepest() {
+    local max=$1
+    shift
+    local low=1 high=$((max + 1))
+    while [ $((high - low)) -gt 1 ]; do
+        local middle=$(((low + high) / 2))
+        if "$@" "$middle"; then
+            low=$middle
+        else
+            high=$middle
+        fi
+    done
+    echo "$low"
+}
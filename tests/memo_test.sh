@@ -0,0 +1,59 @@
+#!/bin/bash
+# Memo test: deep recursion of a pure function under --memo runs as deep as
+# it does without it, and past what the stack holds fails with an error
+# rather than a crash.
+#
+# tests/run.sh runs it along with the others.
+
+. "$(dirname "$0")/lib.sh"
+
+deep() {
+    cat > "$work/deep.lfi3a" << EOF2
+dalla f(n) {
+    ila (n == 0) {
+        rje3 0
+    }
+    rje3 1 + f(n - 1)
+}
+kteb(f($1))
+EOF2
+}
+
+# How deep plain recursion gets depends on the build and its frame sizes,
+# so find that out first
+plain() {
+    deep "$1"
+    [ "$("$LFI3A" --no-cache "$work/deep.lfi3a" 2> /dev/null)" = "$1" ]
+}
+limit=$(deepest 1000000 plain)
+[ "$limit" -ge 100 ] || fail "plain recursion stops at depth $limit"
+
+# Stack positions shift a little from run to run
+depth=$((limit * 19 / 20))
+deep $depth
+out=$("$LFI3A" --no-cache --memo "$work/deep.lfi3a" 2> "$work/err.txt") ||
+    fail "depth $depth of $limit failed: '$(cat "$work/err.txt")'"
+[ "$out" = "$depth" ] || fail "depth $depth printed '$out'"
+grep -q "^memo f: 0 hits, $((depth + 1)) misses" "$work/err.txt" || fail "depth $depth reported '$(cat "$work/err.txt")'"
+
+depth=$((limit * 2))
+deep $depth
+"$LFI3A" --no-cache --memo "$work/deep.lfi3a" > "$work/out.txt" 2> "$work/err.txt"
+status=$?
+[ $status -eq 1 ] || fail "depth $depth exited with $status, not 1"
+grep -q "^Error: Too much recursion$" "$work/err.txt" || fail "depth $depth reported '$(cat "$work/err.txt")'"
+
+# Cached results still come back
+cat > "$work/fib.lfi3a" << 'EOF2'
+dalla fib(n) {
+    ila (n < 2) {
+        rje3 n
+    }
+    rje3 fib(n - 1) + fib(n - 2)
+}
+kteb(fib(70))
+EOF2
+out=$("$LFI3A" --no-cache --memo "$work/fib.lfi3a" 2> /dev/null) || fail "fib failed"
+[ "$out" = "190392490709135" ] || fail "fib printed '$out'"
+
+echo "memo test passed"
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Recursion test: a call made deep inside nested loops and branches either
+# returns or fails with an error once the stack runs low; it never crashes.
+#
+# tests/run.sh runs it along with the others.
+
+. "$(dirname "$0")/lib.sh"
+
+nested() {
+    cat > "$work/nested.lfi3a" << EOF2
+dalla g(n) {
+    ila (n > 0) {
+        kol (i = 0; i < 1; i++) {
+            ma7ad (n > 0) {
+                ila (n > 0) {
+                    rje3 1 + g(n - 1)
+                }
+            }
+        }
+    }
+    rje3 0
+}
+kteb("before")
+kteb(g($1))
+EOF2
+}
+
+# Returns for depth n on the tree-walker, or with flags
+returns() {
+    local n=${*: -1}
+    nested "$n"
+    [ "$("$LFI3A" --no-cache "${@:1:$#-1}" "$work/nested.lfi3a" 2> /dev/null)" = "$(printf 'before\n%s' "$n")" ]
+}
+
+# Fails with an error after the output so far, for depth n
+stops() {
+    nested "$1"
+    "$LFI3A" --no-cache "$work/nested.lfi3a" > "$work/out.txt" 2> "$work/err.txt"
+    status=$?
+    [ $status -eq 1 ] || fail "depth $1 exited with $status, not 1"
+    [ "$(cat "$work/out.txt")" = "before" ] || fail "depth $1 printed '$(cat "$work/out.txt")'"
+    grep -q "^Error: Too much recursion$" "$work/err.txt" || fail "depth $1 reported '$(cat "$work/err.txt")'"
+}
+
+# How deep the calls get depends on the build's frame sizes, so look for
+# the limit on two stacks rather than assume one; the guard should give
+# the bigger stack proportionally more calls
+limits=()
+for stack in 2048 8192; do
+    limit=$(ulimit -s $stack && deepest 1000000 returns) || fail "cannot probe a $stack KiB stack"
+    [ "$limit" -ge 10 ] || fail "calls stop at depth $limit on a $stack KiB stack"
+    (
+        ulimit -s $stack
+        returns $((limit / 2)) || fail "depth $((limit / 2)) of $limit failed on a $stack KiB stack"
+        stops $((limit * 4))
+    ) || exit 1
+    limits+=("$limit")
+done
+[ "${limits[1]}" -gt $((limits[0] * 2)) ] ||
+    fail "8 MiB holds ${limits[1]} calls, not much more than the ${limits[0]} of 2 MiB"
+
+# The VM keeps its calls off the C++ stack
+depth=$((limits[1] * 4))
+returns --vm $depth || fail "depth $depth failed on the VM"
+
+echo "recursion test passed"
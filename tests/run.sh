@@ -0,0 +1,38 @@
+#!/bin/bash
+# Builds lfi3a at -O2 and runs every tests/*_test.sh against it.
+#
+#   tests/run.sh                  # all tests
+#   tests/run.sh memo recursion   # some of them, by name
+#
+# Run from anywhere. Set CXXFLAGS to build at another optimization level,
+# or LFI3A to test an existing binary instead of building one.
+
+cd "$(dirname "$0")/.." || exit 1
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+if [ -z "$LFI3A" ]; then
+    echo "building lfi3a with ${CXXFLAGS:=-O2}"
+    g++ -std=c++17 $CXXFLAGS src/*.cpp -o "$build/lfi3a" -pthread || exit 1
+    export LFI3A="$build/lfi3a"
+fi
+
+if [ $# -eq 0 ]; then
+    tests=(tests/*_test.sh)
+else
+    tests=()
+    for name in "$@"; do tests+=("tests/${name}_test.sh"); done
+fi
+
+failed=0
+for test in "${tests[@]}"; do
+    bash "$test" || {
+        echo "$test failed" >&2
+        failed=$((failed + 1))
+    }
+done
+if [ $failed -gt 0 ]; then
+    echo "$failed of ${#tests[@]} tests failed" >&2
+    exit 1
+fi
+echo "all ${#tests[@]} tests passed"
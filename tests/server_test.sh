@@ -0,0 +1,109 @@
+#!/bin/bash
+# Server test: a script that recurses without end gets an error of its own,
+# and the server goes on answering the requests after it, as it does after
+# oversized, stalled and endless requests.
+#
+# tests/run.sh runs it along with the others.
+
+. "$(dirname "$0")/lib.sh"
+socket="$work/lfi3a.sock"
+server=
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+}
+
+"$LFI3A" --serve="$socket" --workers=2 --time-limit=3 2> "$work/server.txt" &
+server=$!
+for _ in $(seq 50); do
+    [ -S "$socket" ] && break
+    sleep 0.1
+done
+[ -S "$socket" ] || fail "the server did not start"
+
+cat > "$work/runaway.lfi3a" << 'EOF'
+dalla f(n) {
+    rje3 1 + f(n + 1)
+}
+kteb("before")
+kteb(f(0))
+EOF
+"$LFI3A" --client="$socket" "$work/runaway.lfi3a" > "$work/out.txt" 2> "$work/err.txt"
+status=$?
+[ $status -eq 1 ] || fail "runaway script exited with $status, not 1"
+[ "$(cat "$work/out.txt")" = "before" ] || fail "runaway script printed '$(cat "$work/out.txt")'"
+grep -q "^Error: Too much recursion$" "$work/err.txt" || fail "runaway script reported '$(cat "$work/err.txt")'"
+
+# Recursion under the limit still works, on both workers
+cat > "$work/deep.lfi3a" << 'EOF'
+dalla f(n) {
+    ila (n == 0) {
+        rje3 0
+    }
+    rje3 1 + f(n - 1)
+}
+kteb(f(9000))
+EOF
+for _ in 1 2 3 4; do
+    out=$("$LFI3A" --client="$socket" "$work/deep.lfi3a") || fail "deep script failed after the runaway one"
+    [ "$out" = "9000" ] || fail "deep script printed '$out'"
+done
+
+# Oversized EVAL requests are turned away before any body is read, and
+# clients that go quiet are dropped instead of holding a worker each
+ask() {
+    python3 - "$socket" "$1" << 'PY'
+import socket, sys
+client = socket.socket(socket.AF_UNIX)
+client.connect(sys.argv[1])
+client.sendall(sys.argv[2].encode())
+client.settimeout(30)
+reply = b""
+while b"DONE" not in reply:
+    chunk = client.recv(4096)
+    if not chunk:
+        break
+    reply += chunk
+sys.stdout.write(reply.decode())
+PY
+}
+reply=$(ask $'EVAL 1000000000\n')
+[[ "$reply" == *"Script is larger than 16 MiB"*"DONE 1 "* ]] || fail "oversized EVAL got '$reply'"
+
+ask $'EVAL 100\n' > "$work/quiet1.txt" &
+quiet1=$!
+ask '' > "$work/quiet2.txt" &
+quiet2=$!
+sleep 1
+out=$("$LFI3A" --client="$socket" "$work/deep.lfi3a") || fail "request behind quiet clients failed"
+[ "$out" = "9000" ] || fail "request behind quiet clients printed '$out'"
+wait $quiet1 $quiet2
+grep -q "Malformed EVAL request" "$work/quiet1.txt" || fail "quiet EVAL client got '$(cat "$work/quiet1.txt")'"
+
+# Scripts that never end are stopped at the time limit, so as many of them
+# as there are workers don't take the server with them
+cat > "$work/endless.lfi3a" << 'EOF'
+kteb("start")
+ma7ad (s7i7) {
+}
+EOF
+cat > "$work/endless_calls.lfi3a" << 'EOF'
+dalla f(n) {
+    rje3 f(n + 1)
+}
+f(0)
+EOF
+"$LFI3A" --client="$socket" "$work/endless.lfi3a" > "$work/endless1.txt" 2>&1 &
+endless1=$!
+"$LFI3A" --client="$socket" "$work/endless_calls.lfi3a" > "$work/endless2.txt" 2>&1 &
+endless2=$!
+wait $endless1 && fail "endless loop succeeded"
+wait $endless2 && fail "endless calls succeeded"
+[ "$(cat "$work/endless1.txt")" = "$(printf 'start\nError: Script ran for longer than 3 s')" ] ||
+    fail "endless loop got '$(cat "$work/endless1.txt")'"
+[ "$(cat "$work/endless2.txt")" = "Error: Script ran for longer than 3 s" ] ||
+    fail "endless calls got '$(cat "$work/endless2.txt")'"
+out=$("$LFI3A" --client="$socket" "$work/deep.lfi3a") || fail "deep script failed after endless ones"
+[ "$out" = "9000" ] || fail "deep script printed '$out' after endless ones"
+
+kill -0 "$server" 2>/dev/null || fail "the server is gone"
+echo "server test passed"
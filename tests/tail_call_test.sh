@@ -0,0 +1,46 @@
+#!/bin/bash
+# Tail call test: rje3 f(...) recursion a million levels deep finishes with
+# the right result on the tree-walker, the VM and the JIT.
+#
+# tests/run.sh runs it along with the others.
+
+. "$(dirname "$0")/lib.sh"
+
+cat > "$work/tail.lfi3a" << 'EOF2'
+dalla sumTo(n, acc) {
+    ila (n == 0) {
+        rje3 acc
+    }
+    rje3 sumTo(n - 1, acc + n)
+}
+
+dalla isEven(n) {
+    ila (n == 0) {
+        rje3 s7i7
+    }
+    rje3 isOdd(n - 1)
+}
+
+dalla isOdd(n) {
+    ila (n == 0) {
+        rje3 ghalat
+    }
+    rje3 isEven(n - 1)
+}
+
+kteb(sumTo(1000000, 0))
+kteb(isEven(1000001))
+EOF2
+
+# A million nested frames would never fit in the 8 MiB stack lib.sh sets
+for flags in "" --vm --jit; do
+    out=$("$LFI3A" --no-cache $flags "$work/tail.lfi3a" 2> "$work/err.txt")
+    status=$?
+    if [ $status -ne 0 ] && grep -q "needs an x86-64 Linux build" "$work/err.txt"; then
+        continue
+    fi
+    [ $status -eq 0 ] || fail "failed with '$flags': '$(cat "$work/err.txt")'"
+    [ "$out" = "$(printf '500000500000\nghalat')" ] || fail "printed '$out' with '$flags'"
+done
+
+echo "tail call test passed"